@@ -1,25 +1,27 @@
-QT += core gui widgets
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++17
-
-TARGET = FileModifier
-TEMPLATE = app
-
-SOURCES += \
-    main.cpp \
-    mainwindow.cpp \
-    fileprocessor.cpp
-
-HEADERS += \
-    mainwindow.h \
-    fileprocessor.h
-
-FORMS += \
-    mainwindow.ui
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target 
\ No newline at end of file
+QT += core gui widgets
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++17
+
+TARGET = FileModifier
+TEMPLATE = app
+
+include(core.pri)
+
+SOURCES += \
+    main.cpp \
+    mainwindow.cpp \
+    operationlog.cpp
+
+HEADERS += \
+    mainwindow.h \
+    operationlog.h
+
+FORMS += \
+    mainwindow.ui
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target 
@@ -0,0 +1,165 @@
+#include "datasetgenerator.h"
+#include <QRandomGenerator>
+#include <QByteArray>
+#include <QFile>
+#include <QDir>
+
+namespace {
+
+const int BlockSize = 1024 * 1024;
+
+} // namespace
+
+DatasetGenerator::DatasetGenerator(quint32 seed)
+    : m_seed(seed)
+    , m_depth(1)
+    , m_fanout(0)
+    , m_filesPerDirectory(100)
+    , m_minFileSize(4096)
+    , m_maxFileSize(4096)
+    , m_matchingRatio(1.0)
+    , m_sameFileNames(false)
+{
+}
+
+void DatasetGenerator::setSeed(quint32 seed)
+{
+    m_seed = seed;
+}
+
+void DatasetGenerator::setDepth(int depth)
+{
+    m_depth = qMax(1, depth);
+}
+
+void DatasetGenerator::setFanout(int fanout)
+{
+    m_fanout = qMax(0, fanout);
+}
+
+void DatasetGenerator::setFilesPerDirectory(int count)
+{
+    m_filesPerDirectory = qMax(0, count);
+}
+
+void DatasetGenerator::setFileSize(qint64 minBytes, qint64 maxBytes)
+{
+    m_minFileSize = qMax<qint64>(0, minBytes);
+    m_maxFileSize = qMax(m_minFileSize, maxBytes);
+}
+
+void DatasetGenerator::setMatchingRatio(double ratio)
+{
+    m_matchingRatio = qBound(0.0, ratio, 1.0);
+}
+
+void DatasetGenerator::setSameFileNames(bool same)
+{
+    m_sameFileNames = same;
+}
+
+bool DatasetGenerator::generate(const QString &rootPath, Summary *summary)
+{
+    Summary local;
+    m_errorString.clear();
+    
+    if (!QDir().mkpath(rootPath)) {
+        m_errorString = QString("Не удалось создать папку: %1").arg(rootPath);
+        return false;
+    }
+    
+    quint64 fileCounter = 0;
+    const bool ok = generateDirectory(rootPath, 1, &fileCounter, &local);
+    if (summary) {
+        *summary = local;
+    }
+    return ok;
+}
+
+QString DatasetGenerator::errorString() const
+{
+    return m_errorString;
+}
+
+bool DatasetGenerator::generateDirectory(const QString &path, int level, quint64 *fileCounter, Summary *summary)
+{
+    ++summary->directories;
+    
+    for (int i = 0; i < m_filesPerDirectory; ++i) {
+        // One generator per file: the shape of one part of the tree does not
+        // depend on how many files came before it in another part
+        const quint32 fileSeed = m_seed ^ quint32(*fileCounter * 0x9E3779B1u);
+        QRandomGenerator generator(fileSeed);
+        ++*fileCounter;
+        
+        const bool matching = generator.generateDouble() < m_matchingRatio;
+        const qint64 size = m_minFileSize == m_maxFileSize
+                ? m_minFileSize
+                : m_minFileSize + qint64(generator.generateDouble() * double(m_maxFileSize - m_minFileSize + 1));
+        const QString name = m_sameFileNames
+                ? QString("data_%1").arg(i)
+                : QString("f%1").arg(*fileCounter, 8, 10, QChar('0'));
+        const QString filePath = path + '/' + name + (matching ? ".bin" : ".skip");
+        
+        if (!writeFile(filePath, size, fileSeed)) {
+            m_errorString = QString("Не удалось записать файл: %1").arg(filePath);
+            return false;
+        }
+        
+        ++summary->files;
+        if (matching) {
+            ++summary->matchingFiles;
+            summary->matchingBytes += size;
+        }
+    }
+    
+    if (level >= m_depth) {
+        return true;
+    }
+    
+    QDir dir(path);
+    for (int i = 0; i < m_fanout; ++i) {
+        const QString name = QString("d%1").arg(i, 4, 10, QChar('0'));
+        if (!dir.mkdir(name)) {
+            m_errorString = QString("Не удалось создать папку: %1").arg(dir.filePath(name));
+            return false;
+        }
+        if (!generateDirectory(dir.filePath(name), level + 1, fileCounter, summary)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DatasetGenerator::writeFile(const QString &path, qint64 size, quint32 seed)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    
+    // Multi-GB inputs would spend most of their setup time in the generator;
+    // one random block is repeated with a varying rotation instead
+    QRandomGenerator generator(seed);
+    const int blockSize = int(qMin<qint64>(size, BlockSize));
+    QByteArray block(blockSize, Qt::Uninitialized);
+    generator.fillRange(reinterpret_cast<quint32 *>(block.data()), blockSize / int(sizeof(quint32)));
+    for (int i = blockSize & ~3; i < blockSize; ++i) {
+        block[i] = char(generator.generate());
+    }
+    
+    int rotation = 0;
+    for (qint64 written = 0; written < size; written += blockSize) {
+        const qint64 length = qMin<qint64>(blockSize, size - written);
+        if (length == blockSize && rotation > 0) {
+            if (file.write(block.constData() + rotation, blockSize - rotation) != blockSize - rotation
+                || file.write(block.constData(), rotation) != rotation) {
+                return false;
+            }
+        } else if (file.write(block.constData(), length) != length) {
+            return false;
+        }
+        rotation = (rotation + 4099) % qMax(1, blockSize);
+    }
+    return true;
+}
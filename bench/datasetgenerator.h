@@ -0,0 +1,57 @@
+#ifndef DATASETGENERATOR_H
+#define DATASETGENERATOR_H
+
+#include <QtGlobal>
+#include <QString>
+
+// Builds a synthetic input tree for the benchmarks. The same seed and shape
+// always produce the same directories, names and file contents, so results
+// from different versions are measured on identical data.
+//
+// Every directory down to the given depth holds filesPerDirectory files and
+// fanout subdirectories. A file matches the "*.bin" mask with probability
+// matchingRatio; the others get a ".skip" suffix.
+class DatasetGenerator
+{
+public:
+    struct Summary {
+        int directories = 0;
+        int files = 0;
+        int matchingFiles = 0;
+        qint64 matchingBytes = 0;
+    };
+
+    explicit DatasetGenerator(quint32 seed = 42);
+
+    void setSeed(quint32 seed);
+    void setDepth(int depth);
+    void setFanout(int fanout);
+    void setFilesPerDirectory(int count);
+    // Sizes are drawn uniformly from [minBytes, maxBytes]
+    void setFileSize(qint64 minBytes, qint64 maxBytes);
+    void setMatchingRatio(double ratio);
+    // Gives the n-th file of every directory the same name, so that all of
+    // them map to one output name
+    void setSameFileNames(bool same);
+
+    bool generate(const QString &rootPath, Summary *summary = nullptr);
+    QString errorString() const;
+
+    // Writes size pseudo-random bytes derived from seed
+    static bool writeFile(const QString &path, qint64 size, quint32 seed);
+
+private:
+    quint32 m_seed;
+    int m_depth;
+    int m_fanout;
+    int m_filesPerDirectory;
+    qint64 m_minFileSize;
+    qint64 m_maxFileSize;
+    double m_matchingRatio;
+    bool m_sameFileNames;
+    QString m_errorString;
+
+    bool generateDirectory(const QString &path, int level, quint64 *fileCounter, Summary *summary);
+};
+
+#endif // DATASETGENERATOR_H
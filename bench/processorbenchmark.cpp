@@ -0,0 +1,525 @@
+// Benchmarks for the processing engine: the XOR kernel, transform chains and
+// CRC-32C on in-memory buffers, frame compression,
+// whole runs over small, medium and large files, the directory scan on deep
+// and wide trees, and output name allocation under heavy conflicts. Inputs
+// come from DatasetGenerator with a fixed seed; results are written as JSON
+// so runs of different versions can be compared.
+
+#include "datasetgenerator.h"
+#include "fileprocessor.h"
+#include "xorkernel.h"
+#include "transformchain.h"
+#include "crc32c.h"
+#include "framecodec.h"
+#include "globmatcher.h"
+#include "directoryscanner.h"
+#include "processingcontrol.h"
+#include "outputnametable.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QAtomicInteger>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+
+#ifndef FILEMODIFIER_VERSION
+#  define FILEMODIFIER_VERSION "unknown"
+#endif
+
+namespace {
+
+const qint64 KiB = 1024;
+const qint64 MiB = 1024 * KiB;
+
+struct Context {
+    QString workPath;
+    quint32 seed;
+    int scale;
+    qint64 largeFileSize;
+    QJsonArray results;
+    QTextStream *log;
+    bool failed;
+};
+
+void addResult(Context &ctx, const QString &suite, const QString &name, double seconds,
+               qint64 bytes, qint64 items, const QJsonObject &parameters = QJsonObject())
+{
+    QJsonObject result;
+    result["suite"] = suite;
+    result["name"] = name;
+    result["seconds"] = seconds;
+    if (bytes > 0) {
+        result["bytes"] = bytes;
+        result["gbPerSecond"] = seconds > 0 ? bytes / seconds / 1e9 : 0.0;
+    }
+    if (items > 0) {
+        result["items"] = items;
+        result["itemsPerSecond"] = seconds > 0 ? items / seconds : 0.0;
+    }
+    if (!parameters.isEmpty()) {
+        result["parameters"] = parameters;
+    }
+    ctx.results.append(result);
+    
+    *ctx.log << QString("%1 %2 %3 s").arg(suite, -8).arg(name, -28).arg(seconds, 9, 'f', 4);
+    if (bytes > 0 && seconds > 0) {
+        *ctx.log << QString("  %1 GB/s").arg(bytes / seconds / 1e9, 7, 'f', 2);
+    }
+    if (items > 0 && seconds > 0) {
+        *ctx.log << QString("  %1 /s").arg(items / seconds, 12, 'f', 0);
+    }
+    *ctx.log << "\n";
+    ctx.log->flush();
+}
+
+bool generate(Context &ctx, DatasetGenerator &generator, const QString &path, DatasetGenerator::Summary *summary)
+{
+    generator.setSeed(ctx.seed);
+    if (!generator.generate(path, summary)) {
+        *ctx.log << generator.errorString() << "\n";
+        ctx.failed = true;
+        return false;
+    }
+    return true;
+}
+
+void runXorSuite(Context &ctx)
+{
+    const qint64 sizes[] = { 4 * KiB, 64 * KiB, 1 * MiB, 16 * MiB, 256 * MiB };
+    const XorKernel::Implementation active = XorKernel::activeImplementation();
+    const XorKernel::Implementation impls[] = { XorKernel::Scalar, XorKernel::Sse2,
+                                                XorKernel::Avx2, XorKernel::Avx512 };
+    
+    for (XorKernel::Implementation impl : impls) {
+        if (!XorKernel::isSupported(impl)) {
+            continue;
+        }
+        XorKernel::setImplementation(impl);
+        for (qint64 size : sizes) {
+            // About 4 GB per measurement, whatever the buffer size
+            const int iterations = int(qBound<qint64>(4, 4LL * 1000 * 1000 * 1000 / size, 1000000));
+            const double gbPerSecond = XorKernel::measureThroughput(size, iterations);
+            const qint64 bytes = size * iterations;
+            
+            QJsonObject parameters;
+            parameters["implementation"] = XorKernel::implementationName(impl);
+            parameters["bufferSize"] = size;
+            parameters["iterations"] = iterations;
+            addResult(ctx, "xor", QString("%1/%2").arg(XorKernel::implementationName(impl)).arg(size),
+                      gbPerSecond > 0 ? bytes / gbPerSecond / 1e9 : 0.0, bytes, 0, parameters);
+        }
+    }
+    XorKernel::setImplementation(active);
+}
+
+void runTransformSuite(Context &ctx)
+{
+    // Single stages against the plain kernel, then fused chains
+    const char *specs[] = {
+        "xor:0123456789ABCDEF",
+        "xor:00112233445566778899AABBCCDDEEFF",
+        "xor:00112233445566778899AABBCCDDEEFF00112233445566778899AABBCCDDEEFF",
+        "xor:0011223344556677889900",
+        "rolling:0123456789ABCDEF",
+        "sbox:0123456789ABCDEF",
+        "xor:00112233445566778899AABBCCDDEEFF,sbox:0123456789ABCDEF",
+        "rolling:0123456789ABCDEF,sbox:0123456789ABCDEF,xor:0123456789ABCDEF"
+    };
+    const qint64 size = 16 * MiB;
+    const int iterations = 64;
+    
+    QByteArray buffer(int(size), char(0x5A));
+    for (const char *spec : specs) {
+        TransformChain chain;
+        QString error;
+        if (!TransformChain::parse(spec, &chain, &error)) {
+            *ctx.log << spec << ": " << error << "\n";
+            ctx.failed = true;
+            continue;
+        }
+        chain.apply(buffer.data(), size, 0);
+    
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            chain.apply(buffer.data(), size, qint64(i) * size);
+        }
+        const double seconds = timer.nsecsElapsed() / 1e9;
+    
+        QJsonObject parameters;
+        parameters["spec"] = QString(spec);
+        parameters["stages"] = chain.stageCount();
+        parameters["bufferSize"] = size;
+        parameters["iterations"] = iterations;
+        addResult(ctx, "transform", QString(spec).left(28), seconds, size * iterations, 0, parameters);
+    }
+}
+
+void runChecksumSuite(Context &ctx)
+{
+    const qint64 sizes[] = { 4 * KiB, 64 * KiB, 1 * MiB, 16 * MiB };
+    
+    for (qint64 size : sizes) {
+        QByteArray buffer(int(size), char(0x5A));
+        const int iterations = int(qBound<qint64>(4, 4LL * 1000 * 1000 * 1000 / size, 1000000));
+        quint32 crc = Crc32c::update(0, buffer.constData(), size);
+        
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            crc = Crc32c::update(crc, buffer.constData(), size);
+        }
+        const double seconds = timer.nsecsElapsed() / 1e9;
+        
+        QJsonObject parameters;
+        parameters["implementation"] = QString(Crc32c::implementationName());
+        parameters["bufferSize"] = size;
+        parameters["iterations"] = iterations;
+        // Keeps the loop from being optimised away
+        parameters["crc"] = QString::number(crc, 16);
+        addResult(ctx, "checksum", QString("%1/%2").arg(Crc32c::implementationName()).arg(size),
+                  seconds, size * iterations, 0, parameters);
+    }
+}
+
+void runCompressSuite(Context &ctx)
+{
+    if (!FrameCodec::isAvailable()) {
+        *ctx.log << "compress: built without zlib, skipped\n";
+        return;
+    }
+    
+    // One frame of text-like data: the generated datasets are random and
+    // would not compress at all
+    QByteArray frame;
+    for (quint32 i = 0; frame.size() < MiB; ++i) {
+        frame += QByteArray::number((i * 2654435761u + ctx.seed) % 100000) + (i % 16 == 15 ? '\n' : ' ');
+    }
+    frame.truncate(int(MiB));
+    const int levels[] = { 1, 6, 9 };
+    
+    for (int level : levels) {
+        FrameCodec codec(level);
+        QByteArray member;
+        QByteArray restored(frame.size(), Qt::Uninitialized);
+        const int iterations = 64;
+        
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            codec.compress(frame.constData(), frame.size(), &member);
+        }
+        const double compressSeconds = timer.nsecsElapsed() / 1e9;
+        
+        timer.start();
+        bool ok = true;
+        for (int i = 0; i < iterations; ++i) {
+            ok = codec.decompress(member.constData(), member.size(), restored.data(), restored.size()) && ok;
+        }
+        const double decompressSeconds = timer.nsecsElapsed() / 1e9;
+        if (!ok || restored != frame) {
+            ctx.failed = true;
+        }
+        
+        QJsonObject parameters;
+        parameters["level"] = level;
+        parameters["frameSize"] = int(frame.size());
+        parameters["ratio"] = double(member.size()) / frame.size();
+        parameters["iterations"] = iterations;
+        addResult(ctx, "compress", QString("deflate/%1").arg(level), compressSeconds,
+                  qint64(frame.size()) * iterations, 0, parameters);
+        addResult(ctx, "compress", QString("inflate/%1").arg(level), decompressSeconds,
+                  qint64(frame.size()) * iterations, 0, parameters);
+    }
+}
+
+// smallFileLimit < 0 keeps the processor's default
+void runProcessCase(Context &ctx, const QString &name, DatasetGenerator &generator, bool split,
+                    qint64 smallFileLimit = -1, bool bundle = false)
+{
+    const QString inputDir = ctx.workPath + "/process-" + name;
+    const QString outputDir = inputDir + "-out";
+    
+    DatasetGenerator::Summary summary;
+    if (!generate(ctx, generator, inputDir, &summary)) {
+        return;
+    }
+    QDir().mkpath(outputDir);
+    
+    FileProcessor processor;
+    processor.setInputPath(inputDir);
+    processor.setInputMask("*.bin");
+    processor.setOutputPath(outputDir);
+    processor.setXorValue(QByteArray::fromHex("0123456789ABCDEF"));
+    processor.setSplitLargeFiles(split);
+    if (smallFileLimit >= 0) {
+        processor.setSmallFileLimit(smallFileLimit);
+    }
+    processor.setBundleOutput(bundle);
+    
+    int errors = 0;
+    QObject::connect(&processor, &FileProcessor::processingError, [&errors](const QString &) { ++errors; });
+    
+    // The first run brings the inputs into the page cache, like a rerun on a
+    // warm system; the second is measured
+    processor.startProcessing();
+    QElapsedTimer timer;
+    timer.start();
+    processor.startProcessing();
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    
+    if (errors > 0) {
+        *ctx.log << "process/" << name << ": " << errors << " errors\n";
+        ctx.failed = true;
+    }
+    
+    QJsonObject parameters;
+    parameters["files"] = summary.matchingFiles;
+    parameters["split"] = split;
+    parameters["bundle"] = bundle;
+    addResult(ctx, "process", name, seconds, summary.matchingBytes, summary.matchingFiles, parameters);
+    
+    QDir(inputDir).removeRecursively();
+    QDir(outputDir).removeRecursively();
+}
+
+void runProcessSuite(Context &ctx)
+{
+    DatasetGenerator generator;
+    
+    generator.setDepth(2);
+    generator.setFanout(10);
+    generator.setFilesPerDirectory(200 * ctx.scale);
+    generator.setFileSize(1 * KiB, 64 * KiB);
+    runProcessCase(ctx, "small", generator, false);
+    
+    // Drop-folder files of a few kilobytes: per-file overhead dominates
+    generator.setFilesPerDirectory(1000 * ctx.scale);
+    generator.setFileSize(1 * KiB, 4 * KiB);
+    runProcessCase(ctx, "tiny-per-file", generator, false, 0);
+    runProcessCase(ctx, "tiny", generator, false);
+    runProcessCase(ctx, "tiny-bundle", generator, false, -1, true);
+    
+    generator.setDepth(1);
+    generator.setFanout(0);
+    generator.setFilesPerDirectory(8);
+    generator.setFileSize(64 * MiB, 64 * MiB);
+    runProcessCase(ctx, "medium", generator, false);
+    
+    generator.setFilesPerDirectory(1);
+    generator.setFileSize(ctx.largeFileSize, ctx.largeFileSize);
+    runProcessCase(ctx, "large", generator, false);
+    runProcessCase(ctx, "large-split", generator, true);
+}
+
+void runScanCase(Context &ctx, const QString &name, DatasetGenerator &generator)
+{
+    const QString root = ctx.workPath + "/scan-" + name;
+    DatasetGenerator::Summary summary;
+    if (!generate(ctx, generator, root, &summary)) {
+        return;
+    }
+    
+    // Same scanner and matcher that FileProcessor::findFiles uses
+    DirectoryScanner scanner{GlobMatcher("*.bin")};
+    ProcessingControl control;
+    QAtomicInteger<int> found(0);
+    const DirectoryScanner::FileSink sink = [&found](const QStringList &files) {
+        found.fetchAndAddRelaxed(files.size());
+    };
+    
+    scanner.scan(root, sink, &control); // warm the dentry cache
+    found.storeRelaxed(0);
+    
+    QElapsedTimer timer;
+    timer.start();
+    scanner.scan(root, sink, &control);
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    
+    if (found.loadRelaxed() != summary.matchingFiles) {
+        *ctx.log << "scan/" << name << ": found " << found.loadRelaxed()
+                 << " of " << summary.matchingFiles << " files\n";
+        ctx.failed = true;
+    }
+    
+    QJsonObject parameters;
+    parameters["directories"] = summary.directories;
+    parameters["entries"] = summary.files + summary.directories - 1;
+    parameters["matching"] = summary.matchingFiles;
+    addResult(ctx, "scan", name, seconds, 0, summary.files + summary.directories - 1, parameters);
+    
+    QDir(root).removeRecursively();
+}
+
+void runScanSuite(Context &ctx)
+{
+    DatasetGenerator generator;
+    generator.setFileSize(0, 0);
+    generator.setMatchingRatio(0.5);
+    
+    // 2^12 directories along long paths
+    generator.setDepth(12);
+    generator.setFanout(2);
+    generator.setFilesPerDirectory(10 * ctx.scale);
+    runScanCase(ctx, "deep", generator);
+    
+    // A few huge directories
+    generator.setDepth(2);
+    generator.setFanout(8);
+    generator.setFilesPerDirectory(5000 * ctx.scale);
+    runScanCase(ctx, "wide", generator);
+}
+
+void runNamesSuite(Context &ctx)
+{
+    const int count = 20000 * ctx.scale;
+    const QString outputDir = ctx.workPath + "/names";
+    QDir().mkpath(outputDir);
+    
+    // Earlier runs left data.bin, data_1.bin ... data_N.bin behind
+    const int existing = 2000;
+    DatasetGenerator::writeFile(outputDir + "/data.bin", 0, 0);
+    for (int i = 1; i < existing; ++i) {
+        DatasetGenerator::writeFile(outputDir + '/' + OutputNameTable::numberedName("data.bin", i), 0, 0);
+    }
+    
+    // Every input maps to the same name: the worst case for "add counter"
+    OutputNameTable table;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i) {
+        table.reserve(outputDir, "data.bin");
+    }
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    
+    QJsonObject parameters;
+    parameters["existing"] = existing;
+    addResult(ctx, "names", "same-name", seconds, 0, count, parameters);
+    
+    // End to end: files with one name in many directories, output in counter mode
+    DatasetGenerator generator;
+    generator.setDepth(2);
+    generator.setFanout(count / 10);
+    generator.setFilesPerDirectory(1);
+    generator.setFileSize(0, 0);
+    generator.setSameFileNames(true);
+    
+    const QString inputDir = ctx.workPath + "/names-in";
+    DatasetGenerator::Summary summary;
+    if (generate(ctx, generator, inputDir, &summary)) {
+        FileProcessor processor;
+        processor.setInputPath(inputDir);
+        processor.setInputMask("*.bin");
+        processor.setOutputPath(outputDir);
+        processor.setFileConflictMode(1);
+        processor.setXorValue(QByteArray::fromHex("0123456789ABCDEF"));
+        
+        timer.restart();
+        processor.startProcessing();
+        const double runSeconds = timer.nsecsElapsed() / 1e9;
+        
+        QJsonObject runParameters;
+        runParameters["sameNameFiles"] = summary.matchingFiles;
+        addResult(ctx, "names", "counter-run", runSeconds, 0, summary.matchingFiles, runParameters);
+        QDir(inputDir).removeRecursively();
+    }
+    
+    QDir(outputDir).removeRecursively();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Processing engine benchmarks");
+    parser.addHelpOption();
+    QCommandLineOption suitesOption("suites", "Comma-separated list of xor, transform, checksum, compress, process, scan, names.",
+                                    "list", "xor,transform,checksum,compress,process,scan,names");
+    QCommandLineOption dirOption("dir", "Work directory (defaults to a temporary one).", "path");
+    QCommandLineOption outputOption("output", "Write the JSON report to file instead of stdout.", "file");
+    QCommandLineOption seedOption("seed", "Seed of the generated datasets.", "n", "42");
+    QCommandLineOption scaleOption("scale", "Multiplies the number of generated files.", "n", "1");
+    QCommandLineOption largeOption("large-size", "Size of the large file in MiB.", "mib", "2048");
+    QCommandLineOption labelOption("label", "Free-form label stored in the report, e.g. a commit.", "text");
+    parser.addOption(suitesOption);
+    parser.addOption(dirOption);
+    parser.addOption(outputOption);
+    parser.addOption(seedOption);
+    parser.addOption(scaleOption);
+    parser.addOption(largeOption);
+    parser.addOption(labelOption);
+    parser.process(app);
+    
+    QTemporaryDir tempDir(parser.isSet(dirOption) ? parser.value(dirOption) + "/procbench-XXXXXX"
+                                                  : QDir::tempPath() + "/procbench-XXXXXX");
+    if (!tempDir.isValid()) {
+        qCritical("Cannot create work directory");
+        return 1;
+    }
+    
+    // Progress goes to stderr so that stdout stays valid JSON
+    QTextStream log(stderr);
+    
+    Context ctx;
+    ctx.workPath = tempDir.path();
+    ctx.seed = parser.value(seedOption).toUInt();
+    ctx.scale = qMax(1, parser.value(scaleOption).toInt());
+    ctx.largeFileSize = qMax<qint64>(1, parser.value(largeOption).toLongLong()) * MiB;
+    ctx.log = &log;
+    ctx.failed = false;
+    
+    const QStringList suites = parser.value(suitesOption).split(',', Qt::SkipEmptyParts);
+    for (const QString &suite : suites) {
+        if (suite == "xor") {
+            runXorSuite(ctx);
+        } else if (suite == "transform") {
+            runTransformSuite(ctx);
+        } else if (suite == "checksum") {
+            runChecksumSuite(ctx);
+        } else if (suite == "compress") {
+            runCompressSuite(ctx);
+        } else if (suite == "process") {
+            runProcessSuite(ctx);
+        } else if (suite == "scan") {
+            runScanSuite(ctx);
+        } else if (suite == "names") {
+            runNamesSuite(ctx);
+        } else {
+            qCritical("Unknown suite: %s", qPrintable(suite));
+            return 2;
+        }
+    }
+    
+    QJsonObject report;
+    report["version"] = FILEMODIFIER_VERSION;
+    report["label"] = parser.value(labelOption);
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["xorKernel"] = XorKernel::implementationName(XorKernel::activeImplementation());
+    report["threads"] = QThread::idealThreadCount();
+    report["seed"] = qint64(ctx.seed);
+    report["scale"] = ctx.scale;
+    report["results"] = ctx.results;
+    
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            qCritical("Cannot write %s", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    
+    return ctx.failed ? 1 : 0;
+}
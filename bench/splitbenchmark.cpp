@@ -0,0 +1,148 @@
+// Measures how split mode (several threads per file) scales with the thread
+// count, and checks that every run produces the same bytes as the serial path.
+
+#include "fileprocessor.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+
+namespace {
+
+const qint64 MiB = 1024 * 1024;
+
+bool writeInput(const QString &path, qint64 size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QRandomGenerator generator(42);
+    QByteArray block(MiB, Qt::Uninitialized);
+    for (qint64 written = 0; written < size; written += block.size()) {
+        quint32 *words = reinterpret_cast<quint32 *>(block.data());
+        for (int i = 0; i < block.size() / int(sizeof(quint32)); ++i) {
+            words[i] = generator.generate();
+        }
+        const qint64 length = qMin<qint64>(block.size(), size - written);
+        if (file.write(block.constData(), length) != length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameContents(const QString &a, const QString &b)
+{
+    QFile fileA(a);
+    QFile fileB(b);
+    if (!fileA.open(QIODevice::ReadOnly) || !fileB.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (fileA.size() != fileB.size()) {
+        return false;
+    }
+    while (!fileA.atEnd()) {
+        if (fileA.read(4 * MiB) != fileB.read(4 * MiB)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double runOnce(FileProcessor &processor)
+{
+    QElapsedTimer timer;
+    timer.start();
+    processor.startProcessing();
+    return timer.nsecsElapsed() / 1e9;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Split mode scaling benchmark");
+    parser.addHelpOption();
+    QCommandLineOption sizeOption("size", "Input file size in MiB.", "mib", "1024");
+    QCommandLineOption chunkOption("chunk", "Split chunk size in MiB.", "mib", "64");
+    QCommandLineOption dirOption("dir", "Work directory (defaults to a temporary one).", "path");
+    parser.addOption(sizeOption);
+    parser.addOption(chunkOption);
+    parser.addOption(dirOption);
+    parser.process(app);
+
+    const qint64 size = parser.value(sizeOption).toLongLong() * MiB;
+    const qint64 chunkSize = parser.value(chunkOption).toLongLong() * MiB;
+
+    QTemporaryDir tempDir(parser.isSet(dirOption) ? parser.value(dirOption) + "/splitbench-XXXXXX"
+                                                  : QDir::tempPath() + "/splitbench-XXXXXX");
+    if (!tempDir.isValid()) {
+        qCritical("Cannot create work directory");
+        return 1;
+    }
+
+    const QString inputDir = tempDir.filePath("in");
+    const QString referenceDir = tempDir.filePath("reference");
+    const QString outputDir = tempDir.filePath("out");
+    QDir().mkpath(inputDir);
+    QDir().mkpath(referenceDir);
+    QDir().mkpath(outputDir);
+
+    if (!writeInput(inputDir + "/input.bin", size)) {
+        qCritical("Cannot write input file");
+        return 1;
+    }
+
+    FileProcessor processor;
+    processor.setInputPath(inputDir);
+    processor.setInputMask("*.bin");
+    processor.setXorValue(QByteArray::fromHex("0123456789ABCDEF"));
+    processor.setWorkerCount(1);
+    processor.setSplitChunkSize(chunkSize);
+
+    // Serial reference run; also warms the page cache for the timed runs
+    processor.setOutputPath(referenceDir);
+    processor.setSplitLargeFiles(false);
+    const double serialSeconds = runOnce(processor);
+
+    QTextStream out(stdout);
+    out << "file " << size / MiB << " MiB, chunk " << chunkSize / MiB << " MiB\n";
+    out << "threads  seconds   GB/s  speedup  identical\n";
+    out << QString("serial   %1  %2        -          -\n")
+           .arg(serialSeconds, 7, 'f', 3)
+           .arg(size / serialSeconds / 1e9, 5, 'f', 2);
+
+    processor.setOutputPath(outputDir);
+    processor.setSplitLargeFiles(true);
+    bool allIdentical = true;
+    for (int threads = 1; threads <= QThread::idealThreadCount(); threads *= 2) {
+        processor.setSplitThreadCount(threads);
+        const double seconds = runOnce(processor);
+        const bool identical = sameContents(referenceDir + "/input.bin", outputDir + "/input.bin");
+        allIdentical = allIdentical && identical;
+
+        out << QString("%1  %2  %3  %4  %5\n")
+               .arg(threads, 7)
+               .arg(seconds, 7, 'f', 3)
+               .arg(size / seconds / 1e9, 5, 'f', 2)
+               .arg(serialSeconds / seconds, 7, 'f', 2)
+               .arg(identical ? "yes" : "NO", 9);
+        out.flush();
+
+        if (threads < QThread::idealThreadCount() && threads * 2 > QThread::idealThreadCount()) {
+            threads = QThread::idealThreadCount() / 2;
+        }
+    }
+
+    return allIdentical ? 0 : 1;
+}
@@ -0,0 +1,378 @@
+// Headless front end for FileProcessor: one-shot runs for scripts, and a
+// daemon mode that keeps processing new files and reports progress as JSON
+// lines on stdout. Links Qt Core only.
+
+#include "fileprocessor.h"
+#include "directorywatcher.h"
+#include "globmatcher.h"
+#include "framecodec.h"
+#include "filebundle.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimer>
+#include <QDir>
+#include <cstdio>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool s_json = false;
+
+// All output is written from the main thread; processor signals are queued
+void report(const char *event, const QJsonObject &fields, const QString &text)
+{
+    if (s_json) {
+        QJsonObject object = fields;
+        object.insert("event", QString::fromLatin1(event));
+        object.insert("time", QDateTime::currentMSecsSinceEpoch());
+        const QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+        fwrite(line.constData(), 1, size_t(line.size()), stdout);
+
+        // Consumers read line by line as events happen
+        fflush(stdout);
+    } else {
+        const QByteArray line = text.toLocal8Bit() + '\n';
+        fwrite(line.constData(), 1, size_t(line.size()), qstrcmp(event, "error") == 0 ? stderr : stdout);
+    }
+}
+
+#ifdef Q_OS_UNIX
+int s_signalPipe[2] = { -1, -1 };
+
+void handleSignal(int)
+{
+    const char byte = 1;
+    const ssize_t written = write(s_signalPipe[1], &byte, 1);
+    Q_UNUSED(written)
+}
+#endif
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("filemodifier-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Преобразование файлов без графического интерфейса");
+    parser.addHelpOption();
+    QCommandLineOption maskOption(QStringList() << "m" << "mask", "Маска файлов, несколько через ';'.", "mask", "*.txt");
+    QCommandLineOption inputOption(QStringList() << "i" << "input", "Папка с файлами (по умолчанию текущая).", "path");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Папка для сохранения.", "path");
+    QCommandLineOption keyOption(QStringList() << "k" << "key", "XOR значение, ключ любой длины в hex.", "hex", "0123456789ABCDEF");
+    QCommandLineOption transformOption(QStringList() << "t" << "transform", "Цепочка преобразований, например \"xor:00FF,sbox:1234\"; заменяет --key.", "spec");
+    QCommandLineOption conflictOption(QStringList() << "c" << "conflict", "При конфликте имен: overwrite или counter.", "mode", "overwrite");
+    QCommandLineOption deleteOption(QStringList() << "d" << "delete", "Удалять входные файлы.");
+    QCommandLineOption watchOption(QStringList() << "w" << "watch", "Не завершаться: обрабатывать новые файлы; интервал опроса, если inotify недоступен.", "ms");
+    QCommandLineOption pollOption("poll", "В режиме --watch сканировать по таймеру вместо inotify.");
+    QCommandLineOption daemonOption("daemon", "Режим службы: --watch 5000 и --json, если не заданы.");
+    QCommandLineOption jsonOption("json", "События в stdout в виде JSON, по одному на строку.");
+    QCommandLineOption quietOption(QStringList() << "q" << "quiet", "Не сообщать о каждом обработанном файле.");
+    QCommandLineOption workersOption("workers", "Потоков обработки (0 - авто).", "count", "0");
+    QCommandLineOption splitOption("split", "Делить большие файлы между потоками.");
+    QCommandLineOption splitChunkOption("split-chunk", "Размер части в МБ.", "mib", "64");
+    QCommandLineOption scanIndexOption("scan-index", "Пропускать уже обработанные файлы.");
+    QCommandLineOption resumeOption("resume", "Продолжать прерванную обработку по журналу в папке сохранения.");
+    QCommandLineOption metricsFileOption("metrics-file", "Записывать метрики в файл: JSON для *.json, иначе формат Prometheus.", "path");
+    QCommandLineOption metricsIntervalOption("metrics-interval", "Интервал обновления метрик во время обработки.", "ms", "10000");
+    QCommandLineOption durabilityOption("durability", "Сохранение на диск: none, batch (группами) или file (каждый файл).", "mode", "none");
+    QCommandLineOption syncFilesOption("sync-files", "В режиме batch: файлов в группе.", "count", "256");
+    QCommandLineOption checksumOption("checksum", "Контрольные суммы CRC-32C: none, input, output или both.", "mode", "none");
+    QCommandLineOption manifestOption("manifest", "Файл манифеста с контрольными суммами (по умолчанию новый в папке сохранения).", "path");
+    QCommandLineOption verifyOption("verify", "Проверить файлы по манифесту вместо обработки.", "manifest");
+    QCommandLineOption compressOption("compress", "Сжимать результаты gzip с уровнем 1-9 (0 - без сжатия).", "level", "0");
+    QCommandLineOption restoreOption("restore", "Восстановить исходные файлы: распаковать и применить обратное преобразование.");
+    QCommandLineOption prefetchOption("prefetch", "Упреждающее чтение следующих файлов: не больше МБ в кэше (0 - выключено).", "mib", "128");
+    QCommandLineOption prefetchFilesOption("prefetch-files", "Упреждающее чтение: сколько следующих файлов.", "count",
+                                            QString::number(Prefetcher::DefaultLookahead));
+    QCommandLineOption dropCacheOption("drop-cache", "Удалять обработанные файлы из кэша страниц.");
+    QCommandLineOption smallFileLimitOption("small-file-limit", "Файлы до этого размера обрабатываются пакетами (0 - по одному).", "kib", "64");
+    QCommandLineOption bundleOption("bundle", "Собирать мелкие файлы в пакеты .fmbundle вместо отдельных файлов.");
+    QCommandLineOption extractOption("extract", "Извлечь файлы из пакета в папку -o вместо обработки; можно указать несколько раз.", "bundle");
+    QCommandLineOption orderOption("order", "Порядок обработки: fifo, smallest (сначала маленькие), largest или oldest (сначала старые).", "order", "fifo");
+    QCommandLineOption readLimitOption("read-limit", "Общая скорость чтения, МБ/с (0 - без ограничения).", "mibps", "0");
+    QCommandLineOption writeLimitOption("write-limit", "Общая скорость записи, МБ/с (0 - без ограничения).", "mibps", "0");
+    QCommandLineOption maxOpenFilesOption("max-open-files", "Не больше открытых файлов одновременно (0 - без ограничения).", "count", "0");
+    QCommandLineOption bufferSizeOption("buffer-size", "Размер буфера конвейера ввода-вывода.", "kib", "1024");
+    QCommandLineOption queueDepthOption("queue-depth", "Буферов в конвейере (1 - без конвейера).", "count", "4");
+    QCommandLineOption ioBackendOption("io-backend", "Ввод-вывод: auto, direct (без конвейера), threads или io_uring.", "mode", "auto");
+    QCommandLineOption syncIntervalOption("sync-interval", "В режиме batch: наибольшее время ожидания группы.", "ms", "1000");
+    parser.addOptions({ maskOption, inputOption, outputOption, keyOption, transformOption, conflictOption, deleteOption,
+                        watchOption, pollOption, daemonOption, jsonOption, quietOption, workersOption,
+                        splitOption, splitChunkOption, scanIndexOption, metricsFileOption, metricsIntervalOption,
+                        durabilityOption, syncFilesOption, syncIntervalOption, resumeOption, checksumOption,
+                        manifestOption, verifyOption, compressOption, restoreOption, prefetchOption,
+                        prefetchFilesOption, dropCacheOption, smallFileLimitOption, bundleOption, extractOption,
+                        orderOption, readLimitOption, writeLimitOption, maxOpenFilesOption, bufferSizeOption,
+                        queueDepthOption, ioBackendOption });
+    parser.process(app);
+
+    const QString inputPath = parser.isSet(inputOption) ? parser.value(inputOption) : QDir::currentPath();
+    const QString outputPath = parser.value(outputOption);
+    const QString transformSpec = parser.isSet(transformOption) ? parser.value(transformOption) : "xor:" + parser.value(keyOption);
+    const QString conflict = parser.value(conflictOption);
+    const QString durability = parser.value(durabilityOption);
+    const QString order = parser.value(orderOption);
+    const QString ioBackend = parser.value(ioBackendOption);
+    const QString verifyManifest = parser.value(verifyOption);
+    // --manifest alone asks for output checksums
+    const QString checksum = parser.isSet(checksumOption) || !parser.isSet(manifestOption)
+            ? parser.value(checksumOption) : QString("output");
+
+    const QStringList bundles = parser.values(extractOption);
+    if (!bundles.isEmpty()) {
+        if (outputPath.isEmpty() || !QDir().mkpath(outputPath)) {
+            fprintf(stderr, "%s\n", qPrintable(QString("Не удалось создать папку: %1").arg(outputPath)));
+            return 2;
+        }
+        int result = 0;
+        for (const QString &bundle : bundles) {
+            int extracted = 0;
+            QString error;
+            if (FileBundle::extract(bundle, outputPath, &extracted, &error)) {
+                printf("%s\n", qPrintable(QString("Извлечено файлов из %1: %2").arg(bundle).arg(extracted)));
+            } else {
+                fprintf(stderr, "%s\n", qPrintable(QString("Ошибка извлечения из %1: %2").arg(bundle).arg(error)));
+                result = 1;
+            }
+        }
+        return result;
+    }
+
+    if (verifyManifest.isEmpty() && (outputPath.isEmpty() || !QDir(outputPath).exists())) {
+        fprintf(stderr, "%s\n", qPrintable(QString("Папка для сохранения не существует: %1").arg(outputPath)));
+        return 2;
+    }
+    TransformChain transform;
+    QString transformError;
+    if (!TransformChain::parse(transformSpec, &transform, &transformError)) {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неверное преобразование: %1").arg(transformError)));
+        return 2;
+    }
+    if (conflict != "overwrite" && conflict != "counter") {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неизвестный режим конфликта: %1").arg(conflict)));
+        return 2;
+    }
+    if (durability != "none" && durability != "batch" && durability != "file") {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неизвестный режим сохранения: %1").arg(durability)));
+        return 2;
+    }
+    if (order != "fifo" && order != "smallest" && order != "largest" && order != "oldest") {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неизвестный порядок обработки: %1").arg(order)));
+        return 2;
+    }
+    if (ioBackend != "auto" && ioBackend != "direct" && ioBackend != "threads" && ioBackend != "io_uring") {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неизвестный режим ввода-вывода: %1").arg(ioBackend)));
+        return 2;
+    }
+    if (checksum != "none" && checksum != "input" && checksum != "output" && checksum != "both") {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неизвестный режим контрольных сумм: %1").arg(checksum)));
+        return 2;
+    }
+    bool compressOk = false;
+    const int compressionLevel = parser.value(compressOption).toInt(&compressOk);
+    if (!compressOk || compressionLevel < 0 || compressionLevel > 9) {
+        fprintf(stderr, "%s\n", qPrintable(QString("Неверный уровень сжатия: %1").arg(parser.value(compressOption))));
+        return 2;
+    }
+    if (compressionLevel > 0 && parser.isSet(restoreOption)) {
+        fprintf(stderr, "%s\n", qPrintable(QString("--compress и --restore нельзя использовать вместе")));
+        return 2;
+    }
+    if (compressionLevel > 0 && !FrameCodec::isAvailable()) {
+        fprintf(stderr, "%s\n", qPrintable(QString("Сжатие недоступно: программа собрана без zlib")));
+        return 2;
+    }
+
+    const bool daemon = parser.isSet(daemonOption);
+    // Verification is a single pass over the manifest
+    const bool continuous = verifyManifest.isEmpty() && (daemon || parser.isSet(watchOption));
+    const int interval = parser.isSet(watchOption) ? qMax(parser.value(watchOption).toInt(), 100) : 5000;
+    const bool quiet = parser.isSet(quietOption);
+    s_json = daemon || parser.isSet(jsonOption);
+
+    FileProcessor *processor = new FileProcessor();
+    processor->setInputMask(parser.value(maskOption));
+    processor->setInputPath(inputPath);
+    processor->setOutputPath(outputPath);
+    processor->setDeleteInput(parser.isSet(deleteOption));
+    processor->setFileConflictMode(conflict == "counter" ? 1 : 0);
+    processor->setTransform(transform);
+    processor->setWorkerCount(parser.value(workersOption).toInt());
+    processor->setSplitLargeFiles(parser.isSet(splitOption));
+    processor->setSplitChunkSize(parser.value(splitChunkOption).toLongLong() * 1024 * 1024);
+    processor->setSplitThreadCount(parser.value(workersOption).toInt());
+    if (parser.isSet(scanIndexOption)) {
+        processor->setScanIndexDirectory(QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+                                         + "/FileModifier");
+    }
+    processor->setResume(parser.isSet(resumeOption));
+    processor->setMetricsInterval(parser.value(metricsIntervalOption).toInt());
+    processor->setMetricsFile(parser.value(metricsFileOption));
+    processor->setDurability(durability == "none" ? OutputCommitter::None
+                             : durability == "file" ? OutputCommitter::File : OutputCommitter::Batch);
+    processor->setSyncBatch(parser.value(syncFilesOption).toInt(), parser.value(syncIntervalOption).toInt());
+    processor->setChecksums(checksum == "input" ? IntegrityManifest::Input
+                            : checksum == "output" ? IntegrityManifest::Output
+                            : checksum == "both" ? IntegrityManifest::Both : IntegrityManifest::None);
+    processor->setManifestFile(parser.value(manifestOption));
+    processor->setCompressionLevel(compressionLevel);
+    processor->setRestore(parser.isSet(restoreOption));
+    processor->setPrefetch(parser.value(prefetchFilesOption).toInt(), parser.value(prefetchOption).toLongLong() * 1024 * 1024);
+    processor->setDropCache(parser.isSet(dropCacheOption));
+    processor->setSmallFileLimit(parser.value(smallFileLimitOption).toLongLong() * 1024);
+    processor->setBundleOutput(parser.isSet(bundleOption));
+    processor->setSchedulingOrder(order == "smallest" ? FileQueue::SmallestFirst
+                                  : order == "largest" ? FileQueue::LargestFirst
+                                  : order == "oldest" ? FileQueue::OldestFirst : FileQueue::Fifo);
+    processor->setBandwidthLimit(parser.value(readLimitOption).toLongLong() * 1024 * 1024,
+                                 parser.value(writeLimitOption).toLongLong() * 1024 * 1024);
+    processor->setMaxOpenFiles(parser.value(maxOpenFilesOption).toInt());
+    processor->setBufferSize(parser.value(bufferSizeOption).toInt() * 1024);
+    // direct is a queue of one buffer: read, transform and write in turn
+    processor->setQueueDepth(ioBackend == "direct" ? 1 : parser.value(queueDepthOption).toInt());
+    processor->setIoBackend(ioBackend == "threads" ? IoPipeline::Threads
+                            : ioBackend == "io_uring" ? IoPipeline::IoUring : IoPipeline::Auto);
+
+    // Same arrangement as the GUI: the processor runs in its own thread and
+    // the event loop stays free for the watcher and for signals
+    QThread *processorThread = new QThread();
+    processor->moveToThread(processorThread);
+    processorThread->start();
+
+    // Handlers get &app as context so that they run queued on the main thread
+    int exitCode = 0;
+    QObject::connect(processor, &FileProcessor::processingError, &app, [&exitCode](const QString &error) {
+        exitCode = 1;
+        report("error", QJsonObject{ { "message", error } }, QString("Ошибка: %1").arg(error));
+    });
+    if (!quiet) {
+        QObject::connect(processor, &FileProcessor::filesProcessed, &app, [](const QStringList &filenames) {
+            if (s_json) {
+                report("files", QJsonObject{ { "names", QJsonArray::fromStringList(filenames) } }, QString());
+                return;
+            }
+            for (const QString &filename : filenames) {
+                report("file", QJsonObject(), QString("Обработан файл: %1").arg(filename));
+            }
+        });
+    }
+    if (s_json) {
+        // At most one event per report interval, whatever the number of files
+        QObject::connect(processor, &FileProcessor::progressUpdated, &app, [](const ProcessingProgress &progress) {
+            report("progress", QJsonObject{ { "files", progress.filesDone },
+                                            { "filesTotal", progress.filesTotal },
+                                            { "bytes", progress.bytesDone },
+                                            { "bytesTotal", progress.bytesTotal },
+                                            { "scanComplete", progress.scanComplete },
+                                            { "bytesPerSecond", progress.bytesPerSecond },
+                                            { "etaSeconds", progress.etaSeconds } }, QString());
+        });
+    } else {
+        QObject::connect(processor, &FileProcessor::progressChanged, &app, [](int progress) {
+            report("progress", QJsonObject(), QString("%1%").arg(progress));
+        });
+    }
+    if (s_json) {
+        QObject::connect(processor, &FileProcessor::metricsUpdated, &app, [](const ProcessingMetrics::Snapshot &metrics) {
+            report("metrics", ProcessingMetrics::toJson(metrics), QString());
+        });
+    }
+
+    // The final status carries the XOR throughput; per-file statuses are noise
+    QString lastStatus;
+    QObject::connect(processor, &FileProcessor::statusChanged, &app, [&lastStatus](const QString &status) {
+        lastStatus = status;
+    });
+    QObject::connect(processor, &FileProcessor::processingFinished, &app, [&lastStatus]() {
+        report("finished", QJsonObject{ { "status", lastStatus } }, lastStatus);
+    });
+
+    DirectoryWatcher watcher;
+    watcher.setFilter(GlobMatcher(parser.value(maskOption)));
+    watcher.setExcludedPath(QDir(outputPath) == QDir(inputPath) ? QString() : outputPath);
+    QTimer pollTimer;
+    bool stopping = false;
+
+    // Requests made while a run is busy are merged into the processor's queue
+    QObject::connect(&watcher, &DirectoryWatcher::filesAdded, [&](const QStringList &files) {
+        processor->queueRun(files);
+    });
+    QObject::connect(&watcher, &DirectoryWatcher::rescanRequired, [&]() {
+        report("rescan", QJsonObject(), "Очередь событий переполнена, выполняется полное сканирование");
+        processor->queueRun();
+    });
+    QObject::connect(&pollTimer, &QTimer::timeout, [&]() {
+        processor->queueRun();
+    });
+
+    QObject::connect(processor, &FileProcessor::idle, &app, [&]() {
+        if (!continuous || stopping) {
+            QCoreApplication::exit(exitCode);
+        }
+    });
+
+#ifdef Q_OS_UNIX
+    // SIGINT/SIGTERM stop the current file cleanly instead of killing the process
+    QSocketNotifier *signalNotifier = nullptr;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalPipe) == 0) {
+        signalNotifier = new QSocketNotifier(s_signalPipe[0], QSocketNotifier::Read, &app);
+        QObject::connect(signalNotifier, &QSocketNotifier::activated, [&]() {
+            char byte;
+            const ssize_t received = read(s_signalPipe[0], &byte, 1);
+            Q_UNUSED(received)
+            stopping = true;
+            watcher.stop();
+            pollTimer.stop();
+            processor->stopProcessing();
+            if (!processor->isBusy()) {
+                QCoreApplication::exit(exitCode);
+            }
+        });
+        signal(SIGINT, handleSignal);
+        signal(SIGTERM, handleSignal);
+    }
+#endif
+
+    if (continuous) {
+        if (!parser.isSet(pollOption) && watcher.start(inputPath)) {
+            report("watching", QJsonObject{ { "path", inputPath } },
+                   QString("Отслеживание новых файлов: %1").arg(inputPath));
+        } else {
+            if (!parser.isSet(pollOption)) {
+                report("watching", QJsonObject{ { "path", inputPath }, { "interval", interval } },
+                       QString("Отслеживание недоступно (%1), опрос каждые %2 мс").arg(watcher.errorString()).arg(interval));
+            }
+            pollTimer.start(interval);
+        }
+    }
+
+    // The first run is a full scan in every mode
+    if (verifyManifest.isEmpty()) {
+        processor->queueRun();
+    } else {
+        processor->queueVerify(verifyManifest);
+    }
+
+    const int result = app.exec();
+
+    processor->stopProcessing();
+    processorThread->quit();
+    processorThread->wait();
+    delete processor;
+    delete processorThread;
+    return result;
+}
@@ -0,0 +1,58 @@
+# Processing core shared by FileModifier.pro and cli/filemodifier-cli.pro;
+# needs Qt Core only
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/fileprocessor.cpp \
+    $$PWD/xorkernel.cpp \
+    $$PWD/transformchain.cpp \
+    $$PWD/iopipeline.cpp \
+    $$PWD/inplacemarker.cpp \
+    $$PWD/directorywatcher.cpp \
+    $$PWD/scanindex.cpp \
+    $$PWD/globmatcher.cpp \
+    $$PWD/directoryscanner.cpp \
+    $$PWD/filequeue.cpp \
+    $$PWD/outputnametable.cpp \
+    $$PWD/processingmetrics.cpp \
+    $$PWD/outputcommitter.cpp \
+    $$PWD/jobjournal.cpp \
+    $$PWD/crc32c.cpp \
+    $$PWD/integritymanifest.cpp \
+    $$PWD/framecodec.cpp \
+    $$PWD/processingcontrol.cpp \
+    $$PWD/prefetcher.cpp \
+    $$PWD/filebundle.cpp \
+    $$PWD/throttle.cpp \
+    $$PWD/jobprofile.cpp
+
+HEADERS += \
+    $$PWD/fileprocessor.h \
+    $$PWD/xorkernel.h \
+    $$PWD/transformchain.h \
+    $$PWD/iopipeline.h \
+    $$PWD/inplacemarker.h \
+    $$PWD/directorywatcher.h \
+    $$PWD/scanindex.h \
+    $$PWD/globmatcher.h \
+    $$PWD/directoryscanner.h \
+    $$PWD/filequeue.h \
+    $$PWD/outputnametable.h \
+    $$PWD/processingmetrics.h \
+    $$PWD/outputcommitter.h \
+    $$PWD/jobjournal.h \
+    $$PWD/crc32c.h \
+    $$PWD/integritymanifest.h \
+    $$PWD/framecodec.h \
+    $$PWD/processingcontrol.h \
+    $$PWD/prefetcher.h \
+    $$PWD/filebundle.h \
+    $$PWD/throttle.h \
+    $$PWD/jobprofile.h
+
+# Compressed outputs need zlib, which every Unix system has
+unix {
+    DEFINES += FILEMODIFIER_HAVE_ZLIB
+    LIBS += -lz
+}
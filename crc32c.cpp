@@ -0,0 +1,243 @@
+#include "crc32c.h"
+#include <QtEndian>
+#include <cstring>
+
+#if defined(Q_PROCESSOR_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#  define CRC32C_X86_DISPATCH
+#  include <immintrin.h>
+#elif defined(Q_PROCESSOR_ARM_64) && defined(__ARM_FEATURE_CRC32)
+#  define CRC32C_ARM
+#  include <arm_acle.h>
+#endif
+
+namespace {
+
+// Reflected form of 0x1EDC6F41
+const quint32 Polynomial = 0x82F63B78;
+
+// Bytes per lane of the interleaved hardware loop
+const qint64 LaneSize = 4096;
+
+// The functions below work on the raw register value; update() applies the
+// initial and final inversion
+typedef quint32 (*UpdateFunction)(quint32 state, const uchar *data, qint64 size);
+
+quint32 gf2Times(const quint32 *matrix, quint32 vector)
+{
+    quint32 sum = 0;
+    for (; vector; vector >>= 1, ++matrix) {
+        if (vector & 1) {
+            sum ^= *matrix;
+        }
+    }
+    return sum;
+}
+
+void gf2Square(quint32 *square, const quint32 *matrix)
+{
+    for (int n = 0; n < 32; ++n) {
+        square[n] = gf2Times(matrix, matrix[n]);
+    }
+}
+
+// Feeds length zero bytes through the register, in O(log length) steps
+quint32 shiftZeros(quint32 crc, qint64 length)
+{
+    if (length <= 0) {
+        return crc;
+    }
+
+    // Operators for one zero bit, then two and four by squaring
+    quint32 even[32];
+    quint32 odd[32];
+    odd[0] = Polynomial;
+    quint32 row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2Square(even, odd);
+    gf2Square(odd, even);
+
+    // Each square doubles the shift, starting at one byte
+    do {
+        gf2Square(even, odd);
+        if (length & 1) {
+            crc = gf2Times(even, crc);
+        }
+        length >>= 1;
+        if (length == 0) {
+            break;
+        }
+        gf2Square(odd, even);
+        if (length & 1) {
+            crc = gf2Times(odd, crc);
+        }
+        length >>= 1;
+    } while (length != 0);
+    return crc;
+}
+
+struct Tables {
+    quint32 slice[8][256];
+    quint32 lane[4][256];   // shiftZeros(value, LaneSize), byte by byte
+
+    Tables()
+    {
+        for (quint32 n = 0; n < 256; ++n) {
+            quint32 crc = n;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc & 1) ? (crc >> 1) ^ Polynomial : crc >> 1;
+            }
+            slice[0][n] = crc;
+        }
+        for (int n = 0; n < 256; ++n) {
+            for (int k = 1; k < 8; ++k) {
+                slice[k][n] = (slice[k - 1][n] >> 8) ^ slice[0][slice[k - 1][n] & 0xFF];
+            }
+        }
+        // The shift is linear, so it can be split into one table per byte
+        for (int k = 0; k < 4; ++k) {
+            for (quint32 n = 0; n < 256; ++n) {
+                lane[k][n] = shiftZeros(n << (8 * k), LaneSize);
+            }
+        }
+    }
+};
+
+const Tables &tables()
+{
+    static const Tables instance;
+    return instance;
+}
+
+quint32 updateTable(quint32 state, const uchar *data, qint64 size)
+{
+    const Tables &t = tables();
+    for (; size >= 8; data += 8, size -= 8) {
+        const quint32 low = qFromLittleEndian<quint32>(data) ^ state;
+        const quint32 high = qFromLittleEndian<quint32>(data + 4);
+        state = t.slice[7][low & 0xFF] ^ t.slice[6][(low >> 8) & 0xFF]
+                ^ t.slice[5][(low >> 16) & 0xFF] ^ t.slice[4][low >> 24]
+                ^ t.slice[3][high & 0xFF] ^ t.slice[2][(high >> 8) & 0xFF]
+                ^ t.slice[1][(high >> 16) & 0xFF] ^ t.slice[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        state = (state >> 8) ^ t.slice[0][(state ^ *data) & 0xFF];
+    }
+    return state;
+}
+
+#ifdef CRC32C_X86_DISPATCH
+
+inline quint32 shiftLane(const Tables &t, quint32 crc)
+{
+    return t.lane[0][crc & 0xFF] ^ t.lane[1][(crc >> 8) & 0xFF]
+            ^ t.lane[2][(crc >> 16) & 0xFF] ^ t.lane[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+quint32 updateSse42(quint32 state, const uchar *data, qint64 size)
+{
+    // crc32 has a latency of three cycles but issues every cycle, so three
+    // independent lanes keep the unit busy; they are joined by shifting
+    // the earlier lanes over the bytes of the later ones
+    const Tables &t = tables();
+    for (; size >= 3 * LaneSize; data += 3 * LaneSize, size -= 3 * LaneSize) {
+        quint64 a = state;
+        quint64 b = 0;
+        quint64 c = 0;
+        for (qint64 i = 0; i < LaneSize; i += 8) {
+            quint64 words[3];
+            std::memcpy(&words[0], data + i, 8);
+            std::memcpy(&words[1], data + LaneSize + i, 8);
+            std::memcpy(&words[2], data + 2 * LaneSize + i, 8);
+            a = _mm_crc32_u64(a, words[0]);
+            b = _mm_crc32_u64(b, words[1]);
+            c = _mm_crc32_u64(c, words[2]);
+        }
+        state = shiftLane(t, shiftLane(t, quint32(a)) ^ quint32(b)) ^ quint32(c);
+    }
+
+    quint64 crc = state;
+    for (; size >= 8; data += 8, size -= 8) {
+        quint64 word;
+        std::memcpy(&word, data, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+    state = quint32(crc);
+    for (; size > 0; ++data, --size) {
+        state = _mm_crc32_u8(state, *data);
+    }
+    return state;
+}
+
+#endif // CRC32C_X86_DISPATCH
+
+#ifdef CRC32C_ARM
+
+quint32 updateArm(quint32 state, const uchar *data, qint64 size)
+{
+    for (; size >= 8; data += 8, size -= 8) {
+        quint64 word;
+        std::memcpy(&word, data, 8);
+        state = __crc32cd(state, word);
+    }
+    for (; size > 0; ++data, --size) {
+        state = __crc32cb(state, *data);
+    }
+    return state;
+}
+
+#endif // CRC32C_ARM
+
+UpdateFunction detectImplementation()
+{
+#if defined(CRC32C_X86_DISPATCH)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return updateSse42;
+    }
+#elif defined(CRC32C_ARM)
+    return updateArm;
+#endif
+    return updateTable;
+}
+
+UpdateFunction implementation()
+{
+    static const UpdateFunction function = detectImplementation();
+    return function;
+}
+
+} // namespace
+
+quint32 Crc32c::update(quint32 crc, const char *data, qint64 size)
+{
+    if (size <= 0) {
+        return crc;
+    }
+    return ~implementation()(~crc, reinterpret_cast<const uchar *>(data), size);
+}
+
+quint32 Crc32c::combine(quint32 first, quint32 second, qint64 secondLength)
+{
+    // The inversions of the two checksums cancel out
+    return shiftZeros(first, secondLength) ^ second;
+}
+
+bool Crc32c::isHardwareAccelerated()
+{
+    return implementation() != updateTable;
+}
+
+const char *Crc32c::implementationName()
+{
+#if defined(CRC32C_X86_DISPATCH)
+    if (implementation() == updateSse42) {
+        return "SSE4.2";
+    }
+#elif defined(CRC32C_ARM)
+    return "ARMv8 CRC";
+#endif
+    return "table";
+}
@@ -0,0 +1,25 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <QtGlobal>
+
+// CRC-32C (Castagnoli), the checksum of iSCSI, ext4 and Btrfs. Computed with
+// the SSE4.2 crc32 instruction on three interleaved lanes where the CPU has
+// it (the ARMv8 CRC extension when built for it), with a slicing-by-8 table
+// otherwise. All implementations produce the same values.
+namespace Crc32c
+{
+    // Continues crc over data; the checksum of a whole buffer is
+    // update(0, data, size), and consecutive calls chain like one call
+    quint32 update(quint32 crc, const char *data, qint64 size);
+
+    // Checksum of the concatenation A + B from the checksums of A and B,
+    // where secondLength is the size of B. Lets ranges that were summed
+    // separately (split mode, resumed files) be put together.
+    quint32 combine(quint32 first, quint32 second, qint64 secondLength);
+
+    bool isHardwareAccelerated();
+    const char *implementationName();
+}
+
+#endif // CRC32C_H
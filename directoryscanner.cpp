@@ -0,0 +1,221 @@
+#include "directoryscanner.h"
+#include "processingmetrics.h"
+#include "processingcontrol.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// One getdents64 call returns a few hundred entries
+const int DirentBufferSize = 32 * 1024;
+
+qint64 mtimeOf(const struct stat &st)
+{
+    return qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+#endif
+
+} // namespace
+
+DirectoryScanner::DirectoryScanner(const GlobMatcher &matcher)
+    : m_matcher(matcher)
+    , m_threadCount(0)
+    , m_metrics(nullptr)
+    , m_busy(0)
+{
+}
+
+void DirectoryScanner::setThreadCount(int count)
+{
+    m_threadCount = qMax(count, 0);
+}
+
+void DirectoryScanner::setSkipHook(const SkipHook &hook)
+{
+    m_skipHook = hook;
+}
+
+void DirectoryScanner::setListingHook(const ListingHook &hook)
+{
+    m_listingHook = hook;
+}
+
+void DirectoryScanner::setMetrics(ProcessingMetrics *metrics)
+{
+    m_metrics = metrics;
+}
+
+bool DirectoryScanner::scan(const QString &rootPath, const FileSink &sink, ProcessingControl *control)
+{
+    m_directories.clear();
+    m_directories.append(QDir::cleanPath(QDir(rootPath).absolutePath()));
+    m_busy = 0;
+
+    const int threads = m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount();
+
+    // The calling thread is one of the workers
+    QList<QThread *> helpers;
+    for (int i = 1; i < threads; ++i) {
+        QThread *thread = QThread::create([this, &sink, control]() { work(sink, control); });
+        thread->start();
+        helpers.append(thread);
+    }
+    work(sink, control);
+
+    for (QThread *thread : helpers) {
+        thread->wait();
+        delete thread;
+    }
+    return !control->isStopRequested();
+}
+
+void DirectoryScanner::work(const FileSink &sink, ProcessingControl *control)
+{
+    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        // Another thread may still produce subdirectories
+        while (m_directories.isEmpty() && m_busy > 0 && !control->isStopRequested()) {
+            m_changed.wait(&m_mutex);
+        }
+        if (m_directories.isEmpty() || control->isStopRequested()) {
+            m_changed.wakeAll();
+            return;
+        }
+
+        // Depth first keeps the list of waiting directories short
+        const QString directory = m_directories.takeLast();
+        ++m_busy;
+        locker.unlock();
+
+        // A pause holds the scan between directories
+        control->checkpoint();
+
+        QStringList subdirectories;
+        QStringList files;
+        QElapsedTimer timer;
+        timer.start();
+        visit(directory, &subdirectories, &files);
+        if (m_metrics) {
+            m_metrics->record(ProcessingMetrics::Scan, timer.nsecsElapsed());
+        }
+        if (!files.isEmpty()) {
+            sink(files);
+        }
+
+        locker.relock();
+        --m_busy;
+        for (const QString &name : subdirectories) {
+            m_directories.append(directory + '/' + name);
+        }
+        m_changed.wakeAll();
+    }
+}
+
+void DirectoryScanner::visit(const QString &directory, QStringList *subdirectories, QStringList *files)
+{
+    const bool hooked = m_skipHook || m_listingHook;
+    qint64 mtime = 0;
+
+#ifdef Q_OS_LINUX
+    const int fd = open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return; // unreadable directories are skipped, as QDirIterator does
+    }
+
+    struct stat st;
+    if (hooked && fstat(fd, &st) == 0) {
+        mtime = mtimeOf(st);
+    }
+    if (m_skipHook && m_skipHook(directory, mtime, subdirectories)) {
+        close(fd);
+        return;
+    }
+
+    alignas(8) char buffer[DirentBufferSize];
+    for (;;) {
+        const long length = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (long pos = 0; pos < length; ) {
+            const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64 *>(buffer + pos);
+            pos += entry->d_reclen;
+
+            // Covers ".", ".." and hidden entries
+            const char *name = entry->d_name;
+            if (name[0] == '.') {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            const int nameLength = int(strlen(name));
+
+            // Some filesystems leave the type to be looked up
+            if (type == DT_UNKNOWN) {
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG
+                                                   : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                subdirectories->append(QFile::decodeName(QByteArray(name, nameLength)));
+            } else if ((type == DT_REG || type == DT_LNK) && m_matcher.matches(name, nameLength)) {
+                // Symlinks count as files only when they point to one
+                if (type == DT_LNK && (fstatat(fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) {
+                    continue;
+                }
+                files->append(directory + '/' + QFile::decodeName(QByteArray(name, nameLength)));
+            }
+        }
+    }
+    close(fd);
+#else
+    if (hooked) {
+        mtime = QFileInfo(directory).lastModified().toMSecsSinceEpoch() * 1000000;
+    }
+    if (m_skipHook && m_skipHook(directory, mtime, subdirectories)) {
+        return;
+    }
+
+    const QFileInfoList entries = QDir(directory).entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+    for (const QFileInfo &entry : entries) {
+        if (entry.isDir()) {
+            if (!entry.isSymLink()) {
+                subdirectories->append(entry.fileName());
+            }
+        } else if (m_matcher.matches(entry.fileName())) {
+            files->append(directory + '/' + entry.fileName());
+        }
+    }
+#endif
+
+    if (m_listingHook) {
+        m_listingHook(directory, mtime, *subdirectories, files);
+    }
+}
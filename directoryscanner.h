@@ -0,0 +1,69 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+#include "globmatcher.h"
+
+class ProcessingMetrics;
+class ProcessingControl;
+
+// Recursive search for files whose name matches a mask. On Linux directories
+// are read with getdents64 and entries are classified by their d_type, so no
+// file is stat'ed unless the filesystem does not report a type or the entry
+// is a matching symlink. Directories are distributed over several threads,
+// and matches are handed out per directory while the scan is still running.
+// Like QDir::Files, hidden entries are skipped and symlinked directories are
+// not followed.
+class DirectoryScanner
+{
+public:
+    // Receives the matching files of one directory; called on scanner threads
+    typedef std::function<void(const QStringList &files)> FileSink;
+
+    // Optional, called on scanner threads before a directory is listed
+    // (mtime in nanoseconds). Returning true skips the listing; the
+    // subdirectories to descend into must then be supplied by the hook.
+    typedef std::function<bool(const QString &directory, qint64 mtime, QStringList *subdirectories)> SkipHook;
+
+    // Optional, called on scanner threads after a directory was listed and
+    // before its files are passed on; may remove entries from files
+    typedef std::function<void(const QString &directory, qint64 mtime, const QStringList &subdirectories,
+                               QStringList *files)> ListingHook;
+
+    explicit DirectoryScanner(const GlobMatcher &matcher);
+
+    // 0 selects QThread::idealThreadCount()
+    void setThreadCount(int count);
+    void setSkipHook(const SkipHook &hook);
+    void setListingHook(const ListingHook &hook);
+    // Every directory listing is recorded as a Scan sample when set
+    void setMetrics(ProcessingMetrics *metrics);
+
+    // Walks the tree below rootPath, holding between directories while
+    // control is paused. Returns false if stopped before the whole tree was
+    // visited.
+    bool scan(const QString &rootPath, const FileSink &sink, ProcessingControl *control);
+
+private:
+    GlobMatcher m_matcher;
+    int m_threadCount;
+    SkipHook m_skipHook;
+    ListingHook m_listingHook;
+    ProcessingMetrics *m_metrics;
+
+    // Directories waiting to be listed, guarded by m_mutex
+    QMutex m_mutex;
+    QWaitCondition m_changed;
+    QStringList m_directories;
+    int m_busy;
+
+    void work(const FileSink &sink, ProcessingControl *control);
+    void visit(const QString &directory, QStringList *subdirectories, QStringList *files);
+};
+
+#endif // DIRECTORYSCANNER_H
@@ -0,0 +1,229 @@
+#include "directorywatcher.h"
+#include "inplacemarker.h"
+#include "outputcommitter.h"
+#include "jobjournal.h"
+#include "integritymanifest.h"
+#include "filebundle.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QByteArray>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+const uint32_t DirectoryEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MOVED_FROM | IN_ONLYDIR;
+#endif
+
+// Enough for a burst of a few hundred events per read
+const int EventBufferSize = 64 * 1024;
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    : QObject(parent)
+    , m_fd(-1)
+    , m_notifier(nullptr)
+    , m_filter("*")
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    stop();
+}
+
+bool DirectoryWatcher::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DirectoryWatcher::setFilter(const GlobMatcher &filter)
+{
+    m_filter = filter;
+}
+
+void DirectoryWatcher::setExcludedPath(const QString &path)
+{
+    m_excludedPath = path.isEmpty() ? QString() : QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+bool DirectoryWatcher::start(const QString &rootPath)
+{
+    stop();
+
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        m_errorString = qt_error_string(errno);
+        return false;
+    }
+
+    // Files already in the tree are the caller's initial scan, not events
+    if (!addWatches(QDir::cleanPath(QFileInfo(rootPath).absoluteFilePath()), nullptr)) {
+        stop();
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &DirectoryWatcher::readEvents);
+    return true;
+#else
+    Q_UNUSED(rootPath)
+    m_errorString = "inotify недоступен на этой платформе";
+    return false;
+#endif
+}
+
+void DirectoryWatcher::stop()
+{
+    delete m_notifier;
+    m_notifier = nullptr;
+    m_watches.clear();
+
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+bool DirectoryWatcher::isActive() const
+{
+    return m_fd >= 0;
+}
+
+bool DirectoryWatcher::addWatches(const QString &path, QStringList *existingFiles)
+{
+#ifdef Q_OS_LINUX
+    QStringList directories;
+    directories.append(path);
+
+    // Watch first, then list: a file created in between shows up in the
+    // listing, as an event, or both, but is never missed
+    while (!directories.isEmpty()) {
+        const QString directory = directories.takeLast();
+        if (isExcluded(directory)) {
+            continue;
+        }
+
+        const int wd = inotify_add_watch(m_fd, QFile::encodeName(directory).constData(), DirectoryEvents);
+        if (wd < 0) {
+            // ENOSPC means fs.inotify.max_user_watches is exhausted
+            m_errorString = QString("%1: %2").arg(directory).arg(qt_error_string(errno));
+            return false;
+        }
+        m_watches.insert(wd, directory);
+
+        QDirIterator it(directory, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+        while (it.hasNext()) {
+            const QString entry = it.next();
+            if (it.fileInfo().isDir()) {
+                directories.append(entry);
+            } else if (existingFiles && matches(it.fileName())) {
+                existingFiles->append(entry);
+            }
+        }
+    }
+    return true;
+#else
+    Q_UNUSED(path)
+    Q_UNUSED(existingFiles)
+    return false;
+#endif
+}
+
+void DirectoryWatcher::removeWatches(const QString &path)
+{
+#ifdef Q_OS_LINUX
+    const QString prefix = path + '/';
+    for (auto it = m_watches.begin(); it != m_watches.end(); ) {
+        if (it.value() == path || it.value().startsWith(prefix)) {
+            inotify_rm_watch(m_fd, it.key());
+            it = m_watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#else
+    Q_UNUSED(path)
+#endif
+}
+
+bool DirectoryWatcher::isExcluded(const QString &path) const
+{
+    return !m_excludedPath.isEmpty()
+            && (path == m_excludedPath || path.startsWith(m_excludedPath + '/'));
+}
+
+bool DirectoryWatcher::matches(const QString &fileName) const
+{
+    return !InPlaceMarker::isMarkerFile(fileName) && !OutputCommitter::isTemporaryFile(fileName)
+            && !JobJournal::isJournalFile(fileName) && !IntegrityManifest::isManifestFile(fileName)
+            && !FileBundle::isBundleFile(fileName) && m_filter.matches(fileName);
+}
+
+void DirectoryWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    QStringList files;
+    bool overflow = false;
+    alignas(struct inotify_event) char buffer[EventBufferSize];
+
+    for (;;) {
+        const ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (ssize_t pos = 0; pos < length; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + pos);
+            pos += ssize_t(sizeof(struct inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                m_watches.remove(event->wd);
+                continue;
+            }
+
+            const QString directory = m_watches.value(event->wd);
+            if (directory.isEmpty() || event->len == 0) {
+                continue;
+            }
+            const QString name = QFile::decodeName(event->name);
+            const QString path = directory + '/' + name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & IN_MOVED_FROM) {
+                    removeWatches(path);
+                } else if (!addWatches(path, &files)) {
+                    overflow = true;
+                }
+            } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && matches(name)) {
+                files.append(path);
+            }
+        }
+    }
+
+    if (overflow) {
+        emit rescanRequired();
+    } else if (!files.isEmpty()) {
+        emit filesAdded(files);
+    }
+#endif
+}
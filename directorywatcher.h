@@ -0,0 +1,60 @@
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include "globmatcher.h"
+
+class QSocketNotifier;
+
+// Reports files that are finished being written to, or moved into, a
+// directory tree. Built on inotify: every directory of the tree gets a watch,
+// directories created later are picked up as they appear, and events are
+// delivered through the event loop, so an idle tree costs no CPU at all.
+// Not available on other platforms; start() then fails and callers fall back
+// to polling.
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject *parent = nullptr);
+    ~DirectoryWatcher();
+
+    static bool isSupported();
+
+    // Only files whose name matches the filter are reported
+    void setFilter(const GlobMatcher &filter);
+    // Subtree that is not watched, e.g. an output folder inside the input tree
+    void setExcludedPath(const QString &path);
+
+    bool start(const QString &rootPath);
+    void stop();
+    bool isActive() const;
+    QString errorString() const { return m_errorString; }
+
+signals:
+    void filesAdded(const QStringList &files);
+    // Events were dropped by the kernel; only a full scan finds everything
+    void rescanRequired();
+
+private slots:
+    void readEvents();
+
+private:
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    QHash<int, QString> m_watches;
+    GlobMatcher m_filter;
+    QString m_excludedPath;
+    QString m_errorString;
+
+    bool addWatches(const QString &path, QStringList *existingFiles);
+    void removeWatches(const QString &path);
+    bool isExcluded(const QString &path) const;
+    bool matches(const QString &fileName) const;
+};
+
+#endif // DIRECTORYWATCHER_H
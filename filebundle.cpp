@@ -0,0 +1,239 @@
+#include "filebundle.h"
+#include "crc32c.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char BundleSuffix[] = ".fmbundle";
+const char Magic[] = "FMBUNDL1";
+const char EndMagic[] = "FMBNDEND";
+const int MagicSize = 8;
+const int EntryHeaderSize = 22;
+const int TrailerSize = 24;
+
+// Data is collected up to this size before it is written
+const int WriteSize = 4 * 1024 * 1024;
+
+QAtomicInt s_bundleCounter;
+
+// Names come from the file; nothing may land outside the target folder
+bool isSafeName(const QString &name)
+{
+    if (name.isEmpty() || name.startsWith('/') || name.contains('\\') || name.contains(':')) {
+        return false;
+    }
+    const QStringList parts = name.split('/');
+    for (const QString &part : parts) {
+        if (part.isEmpty() || part == "." || part == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+FileBundle::FileBundle(const QString &fileName)
+    : m_file(fileName)
+    , m_written(0)
+    , m_checksum(0)
+    , m_failed(false)
+{
+}
+
+FileBundle::~FileBundle()
+{
+    m_file.close();
+}
+
+QString FileBundle::newPath(const QString &outputPath)
+{
+    return QDir(outputPath).absoluteFilePath(QString("filemodifier-%1-%2-%3%4")
+                                             .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"))
+                                             .arg(QCoreApplication::applicationPid())
+                                             .arg(s_bundleCounter.fetchAndAddRelaxed(1))
+                                             .arg(BundleSuffix));
+}
+
+bool FileBundle::isBundleFile(const QString &fileName)
+{
+    return fileName.endsWith(BundleSuffix);
+}
+
+bool FileBundle::open()
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        m_errorString = m_file.errorString();
+        m_failed = true;
+        return false;
+    }
+    m_pending.reserve(WriteSize);
+    return write(QByteArray(Magic, MagicSize), false);
+}
+
+bool FileBundle::write(const QByteArray &data, bool flush)
+{
+    // After a failed write the file has a hole; nothing later can fix it
+    if (m_failed) {
+        return false;
+    }
+    m_pending.append(data);
+    if (m_pending.size() < WriteSize && !flush) {
+        return true;
+    }
+    m_checksum = Crc32c::update(m_checksum, m_pending.constData(), m_pending.size());
+    if (m_file.write(m_pending) != m_pending.size()) {
+        m_errorString = m_file.errorString();
+        m_failed = true;
+        return false;
+    }
+    m_written += m_pending.size();
+    m_pending.clear();
+    return true;
+}
+
+bool FileBundle::add(const QString &name, const char *data, qint64 size)
+{
+    Member member;
+    member.name = name;
+    member.offset = m_written + m_pending.size();
+    member.size = size;
+    member.crc = Crc32c::update(0, data, size);
+    m_members.append(member);
+    return write(QByteArray::fromRawData(data, int(size)), false);
+}
+
+bool FileBundle::finish()
+{
+    const qint64 indexOffset = m_written + m_pending.size();
+    QByteArray index;
+    for (const Member &member : m_members) {
+        const QByteArray name = member.name.toUtf8();
+        uchar header[EntryHeaderSize];
+        qToLittleEndian<quint64>(quint64(member.offset), header);
+        qToLittleEndian<quint64>(quint64(member.size), header + 8);
+        qToLittleEndian<quint32>(member.crc, header + 16);
+        qToLittleEndian<quint16>(quint16(name.size()), header + 20);
+        index.append(reinterpret_cast<const char *>(header), EntryHeaderSize);
+        index.append(name);
+    }
+
+    uchar trailer[TrailerSize];
+    qToLittleEndian<quint64>(quint64(indexOffset), trailer);
+    qToLittleEndian<quint32>(quint32(m_members.size()), trailer + 8);
+    qToLittleEndian<quint32>(Crc32c::update(0, index.constData(), index.size()), trailer + 12);
+    std::memcpy(trailer + 16, EndMagic, MagicSize);
+    index.append(reinterpret_cast<const char *>(trailer), TrailerSize);
+
+    if (!write(index, true)) {
+        return false;
+    }
+    m_file.close();
+    return true;
+}
+
+bool FileBundle::load(const QString &fileName, QList<Member> *members, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    const qint64 fileSize = file.size();
+    char magic[MagicSize];
+    uchar trailer[TrailerSize];
+    if (fileSize < MagicSize + TrailerSize || file.read(magic, MagicSize) != MagicSize
+            || std::memcmp(magic, Magic, MagicSize) != 0 || !file.seek(fileSize - TrailerSize)
+            || file.read(reinterpret_cast<char *>(trailer), TrailerSize) != TrailerSize
+            || std::memcmp(trailer + 16, EndMagic, MagicSize) != 0) {
+        *error = "не является пакетом FileModifier";
+        return false;
+    }
+
+    const qint64 indexOffset = qint64(qFromLittleEndian<quint64>(trailer));
+    const quint32 count = qFromLittleEndian<quint32>(trailer + 8);
+    if (indexOffset < MagicSize || indexOffset > fileSize - TrailerSize || !file.seek(indexOffset)) {
+        *error = "оглавление повреждено";
+        return false;
+    }
+    const QByteArray index = file.read(fileSize - TrailerSize - indexOffset);
+    if (index.size() != fileSize - TrailerSize - indexOffset
+            || Crc32c::update(0, index.constData(), index.size()) != qFromLittleEndian<quint32>(trailer + 12)) {
+        *error = "оглавление повреждено";
+        return false;
+    }
+
+    const uchar *data = reinterpret_cast<const uchar *>(index.constData());
+    int pos = 0;
+    for (quint32 i = 0; i < count; ++i) {
+        if (index.size() - pos < EntryHeaderSize) {
+            *error = "оглавление повреждено";
+            return false;
+        }
+        Member member;
+        member.offset = qint64(qFromLittleEndian<quint64>(data + pos));
+        member.size = qint64(qFromLittleEndian<quint64>(data + pos + 8));
+        member.crc = qFromLittleEndian<quint32>(data + pos + 16);
+        const int nameLength = qFromLittleEndian<quint16>(data + pos + 20);
+        pos += EntryHeaderSize;
+        if (index.size() - pos < nameLength || member.offset < MagicSize || member.size < 0
+                || member.size > indexOffset - member.offset) {
+            *error = "оглавление повреждено";
+            return false;
+        }
+        member.name = QString::fromUtf8(index.constData() + pos, nameLength);
+        pos += nameLength;
+        members->append(member);
+    }
+    return true;
+}
+
+bool FileBundle::extract(const QString &fileName, const QString &directory, int *extracted, QString *error)
+{
+    QList<Member> members;
+    if (!load(fileName, &members, error)) {
+        return false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    const QDir target(directory);
+    *extracted = 0;
+    for (const Member &member : members) {
+        if (!isSafeName(member.name)) {
+            *error = QString("недопустимое имя %1").arg(member.name);
+            return false;
+        }
+        if (!file.seek(member.offset)) {
+            *error = file.errorString();
+            return false;
+        }
+        const QByteArray data = file.read(member.size);
+        if (data.size() != member.size || Crc32c::update(0, data.constData(), data.size()) != member.crc) {
+            *error = QString("%1: контрольная сумма не совпадает").arg(member.name);
+            return false;
+        }
+
+        const QString path = target.absoluteFilePath(member.name);
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QSaveFile output(path);
+        if (!output.open(QIODevice::WriteOnly) || output.write(data) != data.size() || !output.commit()) {
+            *error = QString("%1: %2").arg(path).arg(output.errorString());
+            return false;
+        }
+        ++*extracted;
+    }
+    return true;
+}
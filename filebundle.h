@@ -0,0 +1,67 @@
+#ifndef FILEBUNDLE_H
+#define FILEBUNDLE_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <QByteArray>
+
+// Container for many small outputs, so that a batch of files costs one
+// create, a few large sequential writes and one rename instead of the same
+// per file. The members' data is stored back to back, followed by an index:
+//
+//   "FMBUNDL1"
+//   data of every member
+//   per member: offset (8), size (8), crc32c (4), name length (2), name
+//   index offset (8), member count (4), crc32c of the index (4), "FMBNDEND"
+//
+// Numbers are little-endian, names are UTF-8 paths relative to the input
+// folder with '/' separators.
+class FileBundle
+{
+public:
+    struct Member {
+        QString name;
+        qint64 offset = 0;
+        qint64 size = 0;
+        quint32 crc = 0;
+    };
+
+    // Members are appended to a new file, which is complete after finish()
+    explicit FileBundle(const QString &fileName);
+    ~FileBundle();
+
+    bool open();
+    bool add(const QString &name, const char *data, qint64 size);
+    bool finish();
+
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_errorString; }
+    int count() const { return m_members.size(); }
+    // Of the whole file as written, for the manifest
+    qint64 size() const { return m_written; }
+    quint32 checksum() const { return m_checksum; }
+
+    // A new name in outputPath: "filemodifier-<date>-<time>-<pid>-<n>.fmbundle"
+    static QString newPath(const QString &outputPath);
+    static bool isBundleFile(const QString &fileName);
+
+    static bool load(const QString &fileName, QList<Member> *members, QString *error);
+    // Writes every member below directory after checking its checksum;
+    // existing files are replaced
+    static bool extract(const QString &fileName, const QString &directory, int *extracted, QString *error);
+
+private:
+    QFile m_file;
+    QByteArray m_pending;
+    QList<Member> m_members;
+    qint64 m_written;
+    quint32 m_checksum;
+    QString m_errorString;
+    bool m_failed;
+
+    bool write(const QByteArray &data, bool flush);
+};
+
+#endif // FILEBUNDLE_H
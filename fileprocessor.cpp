@@ -1,213 +1,2436 @@
-#include "fileprocessor.h"
-#include <QDir>
-#include <QFile>
-#include <QFileInfo>
-#include <QDirIterator>
-#include <QRegExp>
-#include <QDebug>
-#include <QMutexLocker>
-
-FileProcessor::FileProcessor(QObject *parent)
-    : QObject(parent)
-    , m_deleteInput(false)
-    , m_fileConflictMode(0)
-    , m_stopRequested(false)
-{
-}
-
-FileProcessor::~FileProcessor()
-{
-    stopProcessing();
-}
-
-void FileProcessor::setInputMask(const QString &mask)
-{
-    m_inputMask = mask;
-}
-
-void FileProcessor::setOutputPath(const QString &path)
-{
-    m_outputPath = path;
-}
-
-void FileProcessor::setDeleteInput(bool deleteInput)
-{
-    m_deleteInput = deleteInput;
-}
-
-void FileProcessor::setFileConflictMode(int mode)
-{
-    m_fileConflictMode = mode;
-}
-
-void FileProcessor::setXorValue(const QByteArray &value)
-{
-    m_xorValue = value;
-}
-
-void FileProcessor::setInputPath(const QString &path)
-{
-    m_inputPath = path;
-}
-
-void FileProcessor::startProcessing()
-{
-    m_stopRequested = false;
-    
-    emit statusChanged("Поиск файлов...");
-    
-    QStringList files = findFiles();
-    if (files.isEmpty()) {
-        emit statusChanged("Файлы не найдены");
-        emit processingFinished();
-        return;
-    }
-    
-    emit statusChanged(QString("Найдено файлов: %1").arg(files.size()));
-    
-    int processedCount = 0;
-    for (const QString &inputFile : files) {
-        if (m_stopRequested) {
-            emit statusChanged("Обработка остановлена");
-            break;
-        }
-        
-        QFileInfo fileInfo(inputFile);
-        QString outputFile = generateOutputFileName(inputFile);
-        
-        emit statusChanged(QString("Обработка: %1").arg(fileInfo.fileName()));
-        
-        if (processFile(inputFile, outputFile)) {
-            emit fileProcessed(fileInfo.fileName());
-            
-            if (m_deleteInput) {
-                QFile::remove(inputFile);
-            }
-        }
-        
-        processedCount++;
-        int progress = (processedCount * 100) / files.size();
-        emit progressChanged(progress);
-    }
-    
-    emit statusChanged("Обработка завершена");
-    emit processingFinished();
-}
-
-void FileProcessor::stopProcessing()
-{
-    QMutexLocker locker(&m_mutex);
-    m_stopRequested = true;
-    m_condition.wakeAll();
-}
-
-QStringList FileProcessor::findFiles()
-{
-    QStringList files;
-    QDir dir(m_inputPath.isEmpty() ? QDir::currentPath() : m_inputPath);
-    
-    if (!dir.exists()) {
-        emit processingError("Указанная папка не существует");
-        return files;
-    }
-    
-    // Convert mask to regex pattern
-    QString pattern = m_inputMask;
-    pattern.replace(".", "\\.");
-    pattern.replace("*", ".*");
-    pattern.replace("?", ".");
-    
-    QRegExp regex(pattern, Qt::CaseInsensitive);
-    
-    QDirIterator it(dir.absolutePath(), QDir::Files, QDirIterator::Subdirectories);
-    while (it.hasNext()) {
-        QString filePath = it.next();
-        QFileInfo fileInfo(filePath);
-        
-        if (regex.exactMatch(fileInfo.fileName())) {
-            files.append(filePath);
-        }
-    }
-    
-    return files;
-}
-
-QString FileProcessor::generateOutputFileName(const QString &inputFile)
-{
-    QFileInfo inputFileInfo(inputFile);
-    QString baseName = inputFileInfo.baseName();
-    QString extension = inputFileInfo.suffix();
-    QString outputFile = QString("%1/%2.%3").arg(m_outputPath).arg(baseName).arg(extension);
-    
-    if (m_fileConflictMode == 1) { // Add counter
-        int counter = 1;
-        QString originalOutputFile = outputFile;
-        while (QFile::exists(outputFile)) {
-            outputFile = QString("%1/%2_%3.%4").arg(m_outputPath).arg(baseName).arg(counter).arg(extension);
-            counter++;
-        }
-    }
-    
-    return outputFile;
-}
-
-bool FileProcessor::processFile(const QString &inputFile, const QString &outputFile)
-{
-    QFile input(inputFile);
-    if (!input.open(QIODevice::ReadOnly)) {
-        emit processingError(QString("Не удалось открыть файл: %1").arg(inputFile));
-        return false;
-    }
-    
-    QFile output(outputFile);
-    if (!output.open(QIODevice::WriteOnly)) {
-        emit processingError(QString("Не удалось создать файл: %1").arg(outputFile));
-        input.close();
-        return false;
-    }
-    
-    const int bufferSize = 8192; // 8KB buffer
-    QByteArray buffer;
-    
-    while (!input.atEnd() && !m_stopRequested) {
-        buffer = input.read(bufferSize);
-        if (buffer.isEmpty()) {
-            break;
-        }
-        
-        QByteArray processedData = xorData(buffer);
-        if (output.write(processedData) == -1) {
-            emit processingError(QString("Ошибка записи в файл: %1").arg(outputFile));
-            input.close();
-            output.close();
-            return false;
-        }
-    }
-    
-    input.close();
-    output.close();
-    
-    return !m_stopRequested;
-}
-
-QByteArray FileProcessor::xorData(const QByteArray &data)
-{
-    QByteArray result = data;
-    
-    for (int i = 0; i < result.size(); ++i) {
-        result[i] = result[i] ^ m_xorValue[i % m_xorValue.size()];
-    }
-    
-    return result;
-}
-
-bool FileProcessor::isValidXorValue(const QString &value)
-{
-    if (value.length() != 16) return false;
-    return QRegExp("^[0-9A-Fa-f]{16}$").exactMatch(value);
-}
-
-QByteArray FileProcessor::parseXorValue(const QString &value)
-{
-    return QByteArray::fromHex(value.toUtf8());
-} 
\ No newline at end of file
+#include "fileprocessor.h"
+#include "xorkernel.h"
+#include "inplacemarker.h"
+#include "scanindex.h"
+#include "directoryscanner.h"
+#include "globmatcher.h"
+#include "filequeue.h"
+#include "jobjournal.h"
+#include "crc32c.h"
+#include "framecodec.h"
+#include "filebundle.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QStorageInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QSemaphore>
+#include <functional>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+// Files at or above this size are processed through memory mappings
+const qint64 DefaultMmapThreshold = 64 * 1024 * 1024;
+
+// Mapping window; keeps address space use bounded for very large files
+const qint64 MapWindowSize = 64 * 1024 * 1024;
+
+// Granularity at which a mapped window is transformed and the stop flag polled
+const qint64 MapStepSize = 1024 * 1024;
+
+// Default range size handed to one thread in split mode
+const qint64 DefaultSplitChunkSize = 64 * 1024 * 1024;
+
+// Smallest range handed to one thread in split mode
+const qint64 MinSplitChunkSize = 1024 * 1024;
+
+// Streaming I/O defaults: chunk size and number of chunks in flight
+const int DefaultBufferSize = 1024 * 1024;
+const int DefaultQueueDepth = 4;
+
+// Interval between metricsUpdated signals during a run
+const int DefaultMetricsInterval = 1000;
+
+// At most ten progress reports per second
+const int DefaultReportInterval = 100;
+
+// How much of a sequentially written output may be redone after a crash
+const qint64 CheckpointInterval = 256 * 1024 * 1024;
+
+// How much of the upcoming files may sit in the page cache ahead of the
+// workers
+const qint64 DefaultPrefetchBudget = 128 * 1024 * 1024;
+
+// Files up to this size take the small-file path, and how many of them a
+// worker takes from the queue at once
+const qint64 DefaultSmallFileLimit = 64 * 1024;
+const int SmallFileBatch = 256;
+
+// Files a worker holds open: the input and the output, and on the small-file
+// path also both directories while a file falls back to the regular path
+const int FilesPerWorker = 2;
+const int FilesPerSmallFileWorker = 4;
+
+// How long a worker waits for the scan to queue files before it gives its
+// thread to the next turn
+const int TurnWait = 50;
+
+// Data per compressed frame, as 64-bit for offset arithmetic
+const qint64 FrameSize = FrameCodec::FrameSize;
+
+// Reserves the blocks of a mapped output up front, so that a full disk is
+// reported here instead of as SIGBUS while writing through the mapping.
+bool preallocate(QFile &file, qint64 size)
+{
+    if (!file.resize(size)) {
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    const int rc = posix_fallocate(file.handle(), 0, size);
+    if (rc == 0) {
+        return true;
+    }
+    if (rc != EOPNOTSUPP && rc != EINVAL) {
+        return false;
+    }
+#endif
+    return QStorageInfo(QFileInfo(file.fileName()).absolutePath()).bytesAvailable() >= size;
+}
+
+bool onSameFileSystem(const QString &first, const QString &second)
+{
+    const QStorageInfo a(first);
+    const QStorageInfo b(second);
+    return a.isValid() && b.isValid() && a.device() == b.device() && a.rootPath() == b.rootPath();
+}
+
+// Paths are built with '/' throughout; cheaper than a QFileInfo per file
+QString fileNameOf(const QString &path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+qint64 fileSize(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    return stat(QFile::encodeName(path).constData(), &st) == 0 ? qint64(st.st_size) : 0;
+#else
+    return QFileInfo(path).size();
+#endif
+}
+
+void adviseSequential(uchar *address, qint64 length)
+{
+#ifdef Q_OS_UNIX
+    posix_madvise(address, size_t(length), POSIX_MADV_SEQUENTIAL);
+#else
+    Q_UNUSED(address)
+    Q_UNUSED(length)
+#endif
+}
+
+} // namespace
+
+FileProcessor::FileProcessor(QObject *parent)
+    : QObject(parent)
+    , m_schedulingOrder(FileQueue::Fifo)
+    , m_scanIndex(nullptr)
+    , m_resume(false)
+    , m_journal(nullptr)
+    , m_deleteInput(false)
+    , m_fileConflictMode(0)
+    , m_mmapThreshold(DefaultMmapThreshold)
+    , m_workerCount(0)
+    , m_workerPool(new QThreadPool(this))
+    , m_sharedPool(nullptr)
+    , m_splitLargeFiles(false)
+    , m_splitChunkSize(DefaultSplitChunkSize)
+    , m_splitThreadCount(0)
+    , m_bufferSize(DefaultBufferSize)
+    , m_queueDepth(DefaultQueueDepth)
+    , m_ioBackend(IoPipeline::Auto)
+    , m_inPlace(true)
+    , m_transformBytes(0)
+    , m_transformNsecs(0)
+    , m_settingsChanged(0)
+    , m_busy(false)
+    , m_reportInterval(DefaultReportInterval)
+    , m_queue(nullptr)
+    , m_filesDone(0)
+    , m_bytesDone(0)
+    , m_bytesTotal(0)
+    , m_nextReportAt(0)
+    , m_lastProgress(0)
+    , m_lastReportBytes(0)
+    , m_lastReportTime(0)
+    , m_bytesPerSecond(0)
+    , m_metricsInterval(DefaultMetricsInterval)
+    , m_metricsFileFailed(false)
+    , m_nextMetricsAt(0)
+    , m_checksums(IntegrityManifest::None)
+    , m_manifest(nullptr)
+    , m_compressionLevel(0)
+    , m_restore(false)
+    , m_smallFileLimit(DefaultSmallFileLimit)
+    , m_bundleOutput(false)
+    , m_maxOpenFiles(0)
+    , m_sharedOpenFiles(nullptr)
+    , m_spareFiles(nullptr)
+{
+    qRegisterMetaType<ProcessingMetrics::Snapshot>();
+    qRegisterMetaType<ProcessingProgress>();
+    m_clock.start();
+    m_committer.setMetrics(&m_metrics);
+    m_control.setMetrics(&m_metrics);
+    m_prefetcher.setLookahead(Prefetcher::DefaultLookahead, DefaultPrefetchBudget);
+    m_prefetcher.setMetrics(&m_metrics);
+    m_readThrottle.setMetrics(&m_metrics);
+    m_readThrottle.setControl(&m_control);
+    m_writeThrottle.setMetrics(&m_metrics);
+    m_writeThrottle.setControl(&m_control);
+}
+
+FileProcessor::~FileProcessor()
+{
+    stopProcessing();
+    clearPipelines();
+}
+
+void FileProcessor::setInputMask(const QString &mask)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.inputMask = mask;
+    m_settingsChanged.storeRelease(1);
+}
+
+void FileProcessor::setOutputPath(const QString &path)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.outputPath = path;
+    m_settings.outputChanged = true;
+    m_settingsChanged.storeRelease(1);
+}
+
+void FileProcessor::setDeleteInput(bool deleteInput)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.deleteInput = deleteInput;
+    m_settingsChanged.storeRelease(1);
+}
+
+void FileProcessor::setFileConflictMode(int mode)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.fileConflictMode = mode;
+    m_settings.outputChanged = true;
+    m_settingsChanged.storeRelease(1);
+}
+
+void FileProcessor::setXorValue(const QByteArray &value)
+{
+    setTransform(TransformChain::xorKey(value));
+}
+
+void FileProcessor::setTransform(const TransformChain &transform)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.transform = transform;
+    m_settingsChanged.storeRelease(1);
+}
+
+void FileProcessor::applySettings(bool runStart)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    if (!runStart && !m_settingsChanged.loadRelaxed()) {
+        return;
+    }
+    m_settingsChanged.storeRelaxed(0);
+    
+    // The scan of a run is set up once, at its start
+    if (runStart) {
+        m_inputMask = m_settings.inputMask;
+        m_inputPath = m_settings.inputPath;
+        m_schedulingOrder = m_settings.schedulingOrder;
+    }
+    if (m_settings.outputChanged) {
+        m_outputNames.clear();
+        m_settings.outputChanged = false;
+    }
+    m_outputPath = m_settings.outputPath;
+    m_fileConflictMode = m_settings.fileConflictMode;
+    m_deleteInput = m_settings.deleteInput;
+    m_transform = m_settings.transform;
+    m_activeTransform = m_restore ? m_transform.inverse() : m_transform;
+}
+
+void FileProcessor::setMmapThreshold(qint64 bytes)
+{
+    // 0 or a negative value disables the memory-mapped path
+    m_mmapThreshold = bytes;
+}
+
+void FileProcessor::setWorkerCount(int count)
+{
+    // 0 means one worker per hardware thread
+    m_workerCount = count;
+}
+
+void FileProcessor::setWorkerPool(QThreadPool *pool)
+{
+    m_sharedPool = pool;
+}
+
+void FileProcessor::setSplitLargeFiles(bool split)
+{
+    m_splitLargeFiles = split;
+}
+
+void FileProcessor::setSplitChunkSize(qint64 bytes)
+{
+    m_splitChunkSize = qMax(bytes, MinSplitChunkSize);
+}
+
+void FileProcessor::setSplitThreadCount(int count)
+{
+    // 0 means one thread per hardware thread
+    m_splitThreadCount = count;
+}
+
+int FileProcessor::splitThreadCount() const
+{
+    return m_splitThreadCount > 0 ? m_splitThreadCount : QThread::idealThreadCount();
+}
+
+void FileProcessor::setBufferSize(int bytes)
+{
+    m_bufferSize = qMax(bytes, 4096);
+    clearPipelines();
+}
+
+void FileProcessor::setQueueDepth(int depth)
+{
+    m_queueDepth = qMax(depth, 1);
+    clearPipelines();
+}
+
+void FileProcessor::setIoBackend(IoPipeline::Backend backend)
+{
+    m_ioBackend = backend;
+    clearPipelines();
+}
+
+void FileProcessor::setInPlace(bool inPlace)
+{
+    m_inPlace = inPlace;
+}
+
+IoPipeline *FileProcessor::acquirePipeline()
+{
+    // Pipelines keep their buffers (and helper threads) between files
+    QMutexLocker locker(&m_pipelineMutex);
+    if (!m_idlePipelines.isEmpty()) {
+        return m_idlePipelines.takeLast();
+    }
+    IoPipeline *pipeline = new IoPipeline(m_bufferSize, m_queueDepth, m_ioBackend);
+    pipeline->setMetrics(&m_metrics);
+    pipeline->setThrottles(&m_readThrottle, &m_writeThrottle);
+    return pipeline;
+}
+
+void FileProcessor::releasePipeline(IoPipeline *pipeline)
+{
+    QMutexLocker locker(&m_pipelineMutex);
+    if (pipeline->bufferSize() == m_bufferSize && pipeline->queueDepth() == m_queueDepth
+            && pipeline->backend() == m_ioBackend) {
+        m_idlePipelines.append(pipeline);
+    } else {
+        delete pipeline;
+    }
+}
+
+void FileProcessor::clearPipelines()
+{
+    QMutexLocker locker(&m_pipelineMutex);
+    qDeleteAll(m_idlePipelines);
+    m_idlePipelines.clear();
+}
+
+void FileProcessor::setInputPath(const QString &path)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.inputPath = path;
+    m_settingsChanged.storeRelease(1);
+}
+
+void FileProcessor::setFileList(const QStringList &files)
+{
+    m_fileList = files;
+}
+
+void FileProcessor::setScanIndexDirectory(const QString &directory)
+{
+    m_scanIndexDirectory = directory;
+}
+
+void FileProcessor::setResume(bool resume)
+{
+    m_resume = resume;
+}
+
+void FileProcessor::setMetricsInterval(int msec)
+{
+    m_metricsInterval = qMax(msec, 0);
+}
+
+void FileProcessor::setMetricsFile(const QString &path)
+{
+    m_metricsFile = path;
+    m_metricsFileFailed = false;
+}
+
+void FileProcessor::setReportInterval(int msec)
+{
+    m_reportInterval = qMax(msec, 10);
+}
+
+void FileProcessor::setDurability(OutputCommitter::Durability durability)
+{
+    m_committer.setDurability(durability);
+}
+
+void FileProcessor::setSyncBatch(int files, int msec)
+{
+    m_committer.setBatchLimits(files, msec);
+}
+
+void FileProcessor::setChecksums(IntegrityManifest::Coverage coverage)
+{
+    m_checksums = coverage;
+}
+
+void FileProcessor::setManifestFile(const QString &path)
+{
+    m_manifestFile = path;
+}
+
+void FileProcessor::setVerifyManifest(const QString &path)
+{
+    m_verifyManifest = path;
+}
+
+void FileProcessor::setCompressionLevel(int level)
+{
+    m_compressionLevel = qBound(0, level, 9);
+    m_outputNames.clear();
+}
+
+void FileProcessor::setPrefetch(int files, qint64 budget)
+{
+    m_prefetcher.setLookahead(files, budget);
+}
+
+void FileProcessor::setDropCache(bool drop)
+{
+    m_prefetcher.setDropCache(drop);
+}
+
+void FileProcessor::setSmallFileLimit(qint64 bytes)
+{
+    m_smallFileLimit = qMax<qint64>(0, bytes);
+}
+
+void FileProcessor::setBundleOutput(bool bundle)
+{
+    m_bundleOutput = bundle;
+}
+
+void FileProcessor::setSchedulingOrder(FileQueue::Order order)
+{
+    QMutexLocker locker(&m_settingsMutex);
+    m_settings.schedulingOrder = order;
+}
+
+void FileProcessor::setBandwidthLimit(qint64 readBytesPerSecond, qint64 writeBytesPerSecond)
+{
+    m_readThrottle.setRate(readBytesPerSecond);
+    m_writeThrottle.setRate(writeBytesPerSecond);
+}
+
+void FileProcessor::setMaxOpenFiles(int count)
+{
+    m_maxOpenFiles = qMax(0, count);
+}
+
+void FileProcessor::setSharedLimits(Throttle *readThrottle, Throttle *writeThrottle, QSemaphore *openFiles)
+{
+    m_readThrottle.shareBucket(readThrottle);
+    m_writeThrottle.shareBucket(writeThrottle);
+    m_sharedOpenFiles = openFiles;
+}
+
+void FileProcessor::setRestore(bool restore)
+{
+    m_restore = restore;
+    m_outputNames.clear();
+}
+
+ProcessingMetrics::Snapshot FileProcessor::metrics() const
+{
+    return m_metrics.snapshot();
+}
+
+void FileProcessor::resetMetrics()
+{
+    m_metrics.reset();
+}
+
+void FileProcessor::queueRun(const QStringList &files)
+{
+    QMutexLocker locker(&m_jobMutex);
+    if (files.isEmpty()) {
+        // A full scan also finds every file queued so far
+        bool scanQueued = false;
+        for (int i = m_jobs.size() - 1; i >= 0; --i) {
+            if (m_jobs.at(i).scan) {
+                scanQueued = true;
+            } else if (m_jobs.at(i).verifyManifest.isEmpty()) {
+                m_jobs.removeAt(i);
+            }
+        }
+        if (!scanQueued) {
+            Job job;
+            job.scan = true;
+            m_jobs.append(job);
+        }
+    } else if (!m_jobs.isEmpty() && m_jobs.last().verifyManifest.isEmpty()) {
+        if (!m_jobs.last().scan) {
+            for (const QString &file : files) {
+                m_jobs.last().files.insert(file);
+            }
+        }
+    } else {
+        Job job;
+        for (const QString &file : files) {
+            job.files.insert(file);
+        }
+        m_jobs.append(job);
+    }
+    
+    if (!m_busy) {
+        m_busy = true;
+        QMetaObject::invokeMethod(this, &FileProcessor::processQueue, Qt::QueuedConnection);
+    }
+}
+
+void FileProcessor::queueVerify(const QString &manifestFile)
+{
+    QMutexLocker locker(&m_jobMutex);
+    Job job;
+    job.verifyManifest = manifestFile;
+    m_jobs.append(job);
+    if (!m_busy) {
+        m_busy = true;
+        QMetaObject::invokeMethod(this, &FileProcessor::processQueue, Qt::QueuedConnection);
+    }
+}
+
+bool FileProcessor::isBusy() const
+{
+    QMutexLocker locker(&m_jobMutex);
+    return m_busy;
+}
+
+void FileProcessor::pauseProcessing()
+{
+    m_control.pause();
+}
+
+void FileProcessor::resumeProcessing()
+{
+    m_control.resume();
+}
+
+bool FileProcessor::isPaused() const
+{
+    return m_control.isPaused();
+}
+
+void FileProcessor::processQueue()
+{
+    // Runs on the processor's thread; requests queued meanwhile are picked
+    // up here instead of restarting the thread
+    for (;;) {
+        Job job;
+        {
+            QMutexLocker locker(&m_jobMutex);
+            if (m_jobs.isEmpty()) {
+                m_busy = false;
+                break;
+            }
+            job = m_jobs.takeFirst();
+            // A stop applies to the run it interrupted, never to later ones
+            m_control.clearStop();
+        }
+        m_fileList = job.scan ? QStringList() : job.files.values();
+        m_verifyManifest = job.verifyManifest;
+        run();
+    }
+    emit idle();
+}
+
+void FileProcessor::startProcessing()
+{
+    m_control.clearStop();
+    run();
+}
+
+void FileProcessor::run()
+{
+    applySettings(true);
+    m_transformBytes.storeRelaxed(0);
+    m_transformNsecs.storeRelaxed(0);
+    m_metrics.runStarted();
+    m_nextMetricsAt.storeRelaxed(m_clock.elapsed() + m_metricsInterval);
+    
+    m_filesDone.storeRelaxed(0);
+    m_bytesDone.storeRelaxed(0);
+    m_bytesTotal.storeRelaxed(0);
+    m_nextReportAt.storeRelaxed(m_clock.elapsed() + m_reportInterval);
+    m_finishedFiles.clear();
+    m_currentFile.clear();
+    m_prefetcher.reset();
+    m_readThrottle.reset();
+    m_writeThrottle.reset();
+    m_lastProgress = -1;
+    m_lastReportBytes = 0;
+    m_lastReportTime = m_clock.elapsed();
+    m_bytesPerSecond = 0;
+    
+    if (!m_verifyManifest.isEmpty()) {
+        verifyManifest(m_verifyManifest);
+        m_verifyManifest.clear();
+        m_metrics.runFinished();
+        publishMetrics(true);
+        emit processingFinished();
+        return;
+    }
+    
+    if (m_resume) {
+        m_journal = new JobJournal(m_outputPath);
+        if (!m_journal->open()) {
+            emit processingError(QString("Не удалось открыть журнал задания %1: %2")
+                                 .arg(m_journal->fileName()).arg(m_journal->errorString()));
+            delete m_journal;
+            m_journal = nullptr;
+        }
+    }
+    
+    // Left behind by a crashed run; checked once per output path. Partial
+    // outputs the journal can continue are kept.
+    if (m_committer.durability() != OutputCommitter::None && m_cleanedOutputPath != m_outputPath) {
+        OutputCommitter::removeStaleTemporaryFiles(m_outputPath, m_journal ? m_journal->partialFiles()
+                                                                           : QSet<QString>());
+        m_cleanedOutputPath = m_outputPath;
+    }
+    
+    if (m_checksums != IntegrityManifest::None) {
+        m_manifest = new IntegrityManifest(m_manifestFile.isEmpty() ? IntegrityManifest::defaultPath(m_outputPath)
+                                                                    : m_manifestFile);
+    }
+    
+    if (!m_scanIndexDirectory.isEmpty()) {
+        m_scanIndex = new ScanIndex(m_scanIndexDirectory,
+                                    m_inputPath.isEmpty() ? QDir::currentPath() : m_inputPath, m_inputMask);
+        m_scanIndex->load();
+    }
+    
+    FileQueue queue(m_schedulingOrder);
+    m_queue = &queue;
+    processFiles(queue);
+    
+    // Whatever is left since the last report, including the final 100%
+    reportProgress(true);
+    m_queue = nullptr;
+    
+    if (queue.pushedCount() == 0) {
+        emit statusChanged("Файлы не найдены");
+        finishScanIndex();
+        finishJournal();
+        finishManifest();
+        m_metrics.runFinished();
+        publishMetrics(true);
+        emit processingFinished();
+        return;
+    }
+    
+    if (m_control.isStopRequested()) {
+        emit statusChanged("Обработка остановлена");
+    }
+    
+    const qint64 transformNsecs = m_transformNsecs.loadRelaxed();
+    const double transformSpeed = transformNsecs > 0 ? double(m_transformBytes.loadRelaxed()) / double(transformNsecs) : 0;
+    if (transformNsecs > 0 && m_activeTransform.isKernelXor()) {
+        emit statusChanged(QString("Обработка завершена (XOR %1: %2 ГБ/с)")
+                           .arg(XorKernel::implementationName(XorKernel::activeImplementation()))
+                           .arg(transformSpeed, 0, 'f', 2));
+    } else if (transformNsecs > 0) {
+        // Other stages do not run through the SIMD kernel
+        emit statusChanged(QString("Обработка завершена (цепочка преобразований: %1 ГБ/с)")
+                           .arg(transformSpeed, 0, 'f', 2));
+    } else {
+        emit statusChanged("Обработка завершена");
+    }
+    finishScanIndex();
+    finishJournal();
+    finishManifest();
+    m_metrics.runFinished();
+    publishMetrics(true);
+    emit processingFinished();
+}
+
+void FileProcessor::finishScanIndex()
+{
+    if (!m_scanIndex) {
+        return;
+    }
+    
+    if (!m_scanIndex->save()) {
+        emit processingError(QString("Не удалось сохранить индекс сканирования: %1").arg(m_scanIndex->fileName()));
+    }
+    delete m_scanIndex;
+    m_scanIndex = nullptr;
+}
+
+void FileProcessor::finishJournal()
+{
+    if (!m_journal) {
+        return;
+    }
+    
+    // Kept only for a stopped run, which the next run continues
+    if (!m_control.isStopRequested()) {
+        m_journal->remove();
+    }
+    delete m_journal;
+    m_journal = nullptr;
+}
+
+void FileProcessor::finishManifest()
+{
+    if (!m_manifest) {
+        return;
+    }
+    
+    if (!m_manifest->close()) {
+        emit processingError(QString("Не удалось записать манифест %1: %2")
+                             .arg(m_manifest->fileName()).arg(m_manifest->errorString()));
+    }
+    delete m_manifest;
+    m_manifest = nullptr;
+}
+
+void FileProcessor::verifyManifest(const QString &manifestFile)
+{
+    emit statusChanged("Проверка по манифесту...");
+    QList<IntegrityManifest::Entry> entries;
+    QString error;
+    if (!IntegrityManifest::load(manifestFile, &entries, &error)) {
+        emit processingError(QString("Не удалось прочитать манифест %1: %2").arg(manifestFile).arg(error));
+        return;
+    }
+    
+    qint64 bytes = 0;
+    for (const IntegrityManifest::Entry &entry : entries) {
+        bytes += entry.size;
+    }
+    m_bytesTotal.storeRelaxed(bytes);
+    
+    // Each output is read once, sequentially; the files are spread over the
+    // workers like the files of a run
+    QAtomicInt next(0);
+    QAtomicInt mismatches(0);
+    auto worker = [&]() {
+        QByteArray buffer(m_bufferSize, Qt::Uninitialized);
+        for (int i = next.fetchAndAddRelaxed(1); i < entries.size() && m_control.checkpoint();
+             i = next.fetchAndAddRelaxed(1)) {
+            const IntegrityManifest::Entry &entry = entries.at(i);
+            {
+                QMutexLocker locker(&m_reportMutex);
+                m_currentFile = QFileInfo(entry.output).fileName();
+            }
+            
+            QElapsedTimer timer;
+            timer.start();
+            QString problem;
+            const bool matches = verifyFile(entry, buffer, &problem);
+            if (!matches) {
+                mismatches.fetchAndAddRelaxed(1);
+                emit processingError(QString("Проверка не пройдена: %1 (%2)").arg(entry.output).arg(problem));
+            }
+            m_metrics.recordFile(timer.nsecsElapsed(), entry.size, matches);
+            m_filesDone.fetchAndAddRelaxed(1);
+            reportProgress(false);
+            publishMetrics(false);
+        }
+    };
+    
+    const int workers = m_workerCount > 0 ? m_workerCount : QThread::idealThreadCount();
+    m_workerPool->setMaxThreadCount(workers);
+    for (int i = 0; i < workers; ++i) {
+        m_workerPool->start(worker);
+    }
+    while (!m_workerPool->waitForDone(m_reportInterval)) {
+        reportProgress(false);
+        publishMetrics(false);
+    }
+    reportProgress(true);
+    
+    if (m_control.isStopRequested()) {
+        emit statusChanged("Проверка остановлена");
+    } else if (mismatches.loadRelaxed() > 0) {
+        emit statusChanged(QString("Проверка завершена: не совпадают %1 из %2 файлов")
+                           .arg(mismatches.loadRelaxed()).arg(entries.size()));
+    } else {
+        emit statusChanged(QString("Проверка завершена: все %1 файлов совпадают (CRC-32C %2)")
+                           .arg(entries.size()).arg(Crc32c::implementationName()));
+    }
+}
+
+bool FileProcessor::verifyFile(const IntegrityManifest::Entry &entry, QByteArray &buffer, QString *problem)
+{
+    QFile file(entry.output);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        *problem = file.errorString();
+        m_bytesTotal.fetchAndSubRelaxed(entry.size);
+        return false;
+    }
+    if (file.size() != entry.size) {
+        *problem = QString("размер %1 байт, в манифесте %2").arg(file.size()).arg(entry.size);
+        m_bytesTotal.fetchAndSubRelaxed(entry.size);
+        return false;
+    }
+    // Without an output checksum only the size can be checked
+    if (!(entry.coverage & IntegrityManifest::Output)) {
+        m_bytesDone.fetchAndAddRelaxed(entry.size);
+        return true;
+    }
+    
+#ifdef Q_OS_LINUX
+    posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    quint32 digest = 0;
+    qint64 offset = 0;
+    while (offset < entry.size && m_control.checkpoint()) {
+        const qint64 length = qMin<qint64>(buffer.size(), entry.size - offset);
+        m_readThrottle.acquire(length);
+        QElapsedTimer timer;
+        timer.start();
+        if (file.read(buffer.data(), length) != length) {
+            *problem = QString("ошибка чтения: %1").arg(file.errorString());
+            m_bytesTotal.fetchAndSubRelaxed(entry.size - offset);
+            return false;
+        }
+        m_metrics.record(ProcessingMetrics::Read, timer.nsecsElapsed(), length);
+        
+        timer.start();
+        digest = Crc32c::update(digest, buffer.constData(), length);
+        m_metrics.record(ProcessingMetrics::Checksum, timer.nsecsElapsed(), length);
+        m_bytesDone.fetchAndAddRelaxed(length);
+        offset += length;
+    }
+    
+    // A stopped check says nothing about the file
+    if (!m_control.isStopRequested() && digest != entry.digests.output) {
+        *problem = QString("CRC-32C %1, в манифесте %2")
+                .arg(digest, 8, 16, QChar('0')).arg(entry.digests.output, 8, 16, QChar('0'));
+        return false;
+    }
+    return true;
+}
+
+void FileProcessor::processFiles(FileQueue &queue)
+{
+    QThreadPool *pool = m_sharedPool ? m_sharedPool : m_workerPool;
+    int workers = m_workerCount > 0 ? m_workerCount
+                                    : m_sharedPool ? m_sharedPool->maxThreadCount() : QThread::idealThreadCount();
+    
+    // Compressed and restored files always take the regular path
+    const bool smallFiles = m_smallFileLimit > 0 && m_compressionLevel == 0 && !m_restore;
+    
+    // Under an open-file limit a worker takes its share for each turn, and
+    // what no worker holds goes to split threads. Processors sharing the
+    // pool draw from one count.
+    QSemaphore ownFiles;
+    int filesPerTurn = 0;
+    if (m_maxOpenFiles > 0) {
+        const int filesPerWorker = smallFiles ? FilesPerSmallFileWorker : FilesPerWorker;
+        workers = qBound(1, m_maxOpenFiles / filesPerWorker, workers);
+        filesPerTurn = qMin(filesPerWorker, m_maxOpenFiles);
+        if (m_sharedOpenFiles) {
+            m_spareFiles = m_sharedOpenFiles;
+        } else {
+            ownFiles.release(m_maxOpenFiles);
+            m_spareFiles = &ownFiles;
+        }
+    }
+    
+    // Workers pull the next queued files, so a slow file never holds up the
+    // files behind it, and processing starts while the scan is still running.
+    // On the small-file path a worker takes a batch at once and keeps one
+    // buffer for all of them. A worker's turn is one file or one batch; it
+    // then queues up again behind the turns of other processors sharing the
+    // pool, so that they take turns instead of one run holding every thread
+    // until it is done. While paused, turns are parked instead of waiting in
+    // a thread the other processors could use.
+    QMutex turnMutex;
+    QWaitCondition turnsDone;
+    int turns = workers;
+    QList<int> parked;
+    QVector<QByteArray> buffers(workers);
+    std::function<void(int)> turn;
+    turn = [&](int worker) {
+        if (m_control.isPaused()) {
+            QMutexLocker locker(&turnMutex);
+            parked.append(worker);
+            return;
+        }
+        
+        QStringList files;
+        if (m_control.checkpoint() && queue.pop(&files, smallFiles ? SmallFileBatch : 1, workers, TurnWait)) {
+            if (filesPerTurn > 0) {
+                m_spareFiles->acquire(filesPerTurn);
+            }
+            // Files behind these load while they are processed
+            m_prefetcher.advance(queue);
+            if (m_settingsChanged.loadAcquire()) {
+                // Waits until the files other workers hold are finished
+                QWriteLocker locker(&m_fileLock);
+                applySettings(false);
+            }
+            {
+                QReadLocker locker(&m_fileLock);
+                if (smallFiles) {
+                    QByteArray &buffer = buffers[worker];
+                    if (buffer.isEmpty()) {
+                        buffer.resize(int(m_smallFileLimit));
+                    }
+                    processSmallFiles(files, &buffer);
+                } else {
+                    processInputFile(files.first());
+                }
+            }
+            if (filesPerTurn > 0) {
+                m_spareFiles->release(filesPerTurn);
+            }
+            for (const QString &file : files) {
+                m_prefetcher.release(file);
+            }
+            reportProgress(false);
+            publishMetrics(false);
+        }
+        
+        if (!m_control.isStopRequested() && !queue.isDone()) {
+            pool->start([&turn, worker]() { turn(worker); });
+            return;
+        }
+        QMutexLocker locker(&turnMutex);
+        if (--turns == 0) {
+            turnsDone.wakeAll();
+        }
+    };
+    
+    if (!m_sharedPool) {
+        m_workerPool->setMaxThreadCount(workers);
+    }
+    for (int i = 0; i < workers; ++i) {
+        pool->start([&turn, i]() { turn(i); });
+    }
+    
+    if (m_fileList.isEmpty()) {
+        emit statusChanged("Поиск файлов...");
+        findFiles(queue);
+    } else {
+        // Listed files may have been taken by an earlier run in the meantime
+        QStringList files;
+        qint64 bytes = 0;
+        for (const QString &file : m_fileList) {
+            const QFileInfo fileInfo(file);
+            if (fileInfo.exists()) {
+                files.append(file);
+                bytes += fileInfo.size();
+            }
+        }
+        m_bytesTotal.fetchAndAddRelaxed(bytes);
+        m_fileList.clear();
+        queue.push(files);
+    }
+    queue.close();
+    
+    const int total = queue.pushedCount();
+    if (total > 0) {
+        emit statusChanged(QString("Найдено файлов: %1").arg(total));
+        reportProgress(true);
+    }
+    
+    // A single large file can keep every worker busy for a long time
+    QMutexLocker locker(&turnMutex);
+    while (turns > 0) {
+        // A stop also ends the pause, and the parked turns wind up
+        if (!parked.isEmpty() && !m_control.isPaused()) {
+            for (int worker : parked) {
+                pool->start([&turn, worker]() { turn(worker); });
+            }
+            parked.clear();
+        }
+        if (!turnsDone.wait(&turnMutex, m_reportInterval)) {
+            locker.unlock();
+            commitIfDue();
+            reportProgress(false);
+            publishMetrics(false);
+            locker.relock();
+        }
+    }
+    locker.unlock();
+    
+    // Also after a stop: these files are complete
+    m_committer.commitAll();
+    m_spareFiles = nullptr;
+}
+
+void FileProcessor::processInputFile(const QString &inputFile)
+{
+    QElapsedTimer fileTimer;
+    fileTimer.start();
+    QFileInfo fileInfo(inputFile);
+    // Before the input is moved or deleted
+    const qint64 inputSize = fileInfo.size();
+    
+    // What an interrupted run left for this file
+    JobJournal::FileState job;
+    ScanIndex::FileKey key;
+    const bool journaled = m_journal && ScanIndex::fileKey(inputFile, &key);
+    if (journaled) {
+        if (m_journal->isDone(inputFile, key)) {
+            // Finished before the restart; only counts towards the progress
+            m_bytesDone.fetchAndAddRelaxed(inputSize);
+            m_filesDone.fetchAndAddRelaxed(1);
+            return;
+        }
+        job = m_journal->resumable(inputFile, key);
+    }
+    
+    // Compressed and restored outputs differ in size from their inputs
+    const bool sameSize = m_compressionLevel == 0 && !m_restore;
+    const bool inPlace = m_deleteInput && m_inPlace && sameSize && onSameFileSystem(fileInfo.absolutePath(), m_outputPath);
+    if (!inPlace && InPlaceMarker::isPending(inputFile)) {
+        // Copying would mix transformed and original bytes; only an
+        // in-place run knows where the transformed part ends
+        emit processingError(QString("Файл %1 частично преобразован на месте прерванной обработкой; "
+                                     "обработайте его снова с удалением входных файлов").arg(inputFile));
+        finishFile(inputFile, QString(), inputSize, fileTimer.nsecsElapsed(), false, true);
+        return;
+    }
+    const bool direct = !inPlace && job.id < 0 && m_committer.durability() == OutputCommitter::None;
+    QString outputFile = acquireOutputFileName(inputFile, job, direct);
+    
+    {
+        QMutexLocker locker(&m_reportMutex);
+        m_currentFile = fileInfo.fileName();
+    }
+    
+    // When the input is deleted anyway it can be transformed where it lies
+    // and renamed, which needs neither a second copy nor the extra writes.
+    // Otherwise the data goes to a temporary file unless durability is off.
+    OutputCommitter::Entry entry;
+    entry.target = outputFile;
+    entry.keepExisting = m_fileConflictMode == 1;
+    IntegrityManifest::Digests digests;
+    IntegrityManifest::Digests *fileDigests = m_manifest ? &digests : nullptr;
+    bool processed = false;
+    if (inPlace) {
+        processed = processFileInPlace(inputFile, fileDigests);
+        entry.source = inputFile;
+        entry.removeAfter = InPlaceMarker::markerPath(inputFile);
+        if (QFileInfo(outputFile).absoluteFilePath() == QFileInfo(inputFile).absoluteFilePath()) {
+            entry.source = outputFile;
+        }
+    } else {
+        entry.source = job.id >= 0 ? job.partial : direct ? outputFile : OutputCommitter::temporaryPath(outputFile);
+        job.target = outputFile;
+        job.partial = entry.source;
+        processed = processFile(inputFile, entry.source, journaled ? &job : nullptr, fileDigests);
+        if (m_deleteInput) {
+            entry.removeAfter = inputFile;
+        }
+    }
+    
+    if (!processed) {
+        // A stopped run leaves what the journal recorded to the next one
+        const bool keepPartial = job.id >= 0 && m_control.isStopRequested();
+        if (entry.source != outputFile && entry.source != inputFile && !keepPartial) {
+            QFile::remove(entry.source);
+        }
+        // Only a direct output is ours to remove
+        finishFile(inputFile, outputFile, inputSize, fileTimer.nsecsElapsed(), false,
+                   keepPartial || entry.source != outputFile);
+    } else {
+        submitOutput(entry, inputFile, inputSize, fileTimer, journaled, key, digests);
+    }
+    
+    // Read through once; a deleted input takes its pages with it
+    if (!m_deleteInput) {
+        m_prefetcher.drop(inputFile);
+    }
+    releaseOutputFileName(outputFile);
+}
+
+void FileProcessor::submitOutput(OutputCommitter::Entry entry, const QString &inputFile, qint64 inputSize,
+                                 const QElapsedTimer &fileTimer, bool journaled, const ScanIndex::FileKey &key,
+                                 const IntegrityManifest::Digests &digests)
+{
+    // In batch mode this completes once the batch is durable, possibly on
+    // another worker
+    const QString outputFile = entry.target;
+    const bool markDone = journaled && !m_deleteInput;
+    // A failed rename leaves the name to whoever holds it
+    const bool keepOutput = entry.source != entry.target;
+    entry.done = [this, inputFile, outputFile, inputSize, fileTimer, markDone, keepOutput, key,
+                  digests](bool committed, const QString &error) {
+        if (!error.isEmpty()) {
+            emit processingError(error);
+        }
+        if (committed && markDone) {
+            m_journal->markDone(inputFile, key);
+        }
+        if (committed) {
+            m_prefetcher.drop(outputFile);
+        }
+        // Only outputs that made it to their final name are listed
+        if (committed && m_manifest) {
+            IntegrityManifest::Entry record;
+            record.output = QFileInfo(outputFile).absoluteFilePath();
+            record.input = QFileInfo(inputFile).absoluteFilePath();
+            record.size = QFileInfo(outputFile).size();
+            record.coverage = m_checksums;
+            record.digests = digests;
+            record.nsecs = fileTimer.nsecsElapsed();
+            m_manifest->add(record);
+        }
+        finishFile(inputFile, outputFile, inputSize, fileTimer.nsecsElapsed(), committed, keepOutput);
+    };
+    m_committer.add(entry);
+}
+
+void FileProcessor::processSmallFiles(const QStringList &files, QByteArray *buffer)
+{
+#ifdef Q_OS_UNIX
+    // Files of one directory arrive together, so the directory is opened
+    // once and its files relative to it; the output directory likewise
+    QString inputDirectory;
+    int inputDirFd = -1;
+    bool inPlace = false;
+    const QByteArray outputDirectory = QFile::encodeName(QDir(m_outputPath).absolutePath());
+    int outputDirFd = -1;
+    
+    FileBundle *bundle = nullptr;
+    QString bundlePath;
+    QList<BundledFile> bundled;
+    const QString root = QDir::cleanPath(QDir(m_inputPath.isEmpty() ? QDir::currentPath() : m_inputPath).absolutePath()) + '/';
+    
+    for (const QString &inputFile : files) {
+        if (!m_control.checkpoint()) {
+            break;
+        }
+        
+        QElapsedTimer fileTimer;
+        fileTimer.start();
+        const int slash = inputFile.lastIndexOf('/');
+        if (inputDirFd < 0 || slash != inputDirectory.size() || !inputFile.startsWith(inputDirectory)) {
+            if (inputDirFd >= 0) {
+                ::close(inputDirFd);
+            }
+            inputDirectory = inputFile.left(slash);
+            inputDirFd = ::open(QFile::encodeName(inputDirectory).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            // Inputs that would be transformed where they lie keep doing so,
+            // and partly transformed ones are left to the regular path
+            inPlace = !m_bundleOutput && m_deleteInput && m_inPlace && onSameFileSystem(inputDirectory, m_outputPath);
+        }
+        if (inPlace || QFile::exists(InPlaceMarker::markerPath(inputFile))) {
+            processInputFile(inputFile);
+            continue;
+        }
+        
+        struct stat st;
+        const int fd = inputDirFd >= 0
+                ? ::openat(inputDirFd, QFile::encodeName(inputFile.mid(slash + 1)).constData(), O_RDONLY | O_CLOEXEC)
+                : -1;
+        if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > buffer->size()) {
+            // Larger than it looked, or not there: the regular path decides
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            processInputFile(inputFile);
+            continue;
+        }
+        m_metrics.record(ProcessingMetrics::Open, fileTimer.nsecsElapsed());
+        
+        const qint64 inputSize = qint64(st.st_size);
+        ScanIndex::FileKey key;
+        key.device = quint64(st.st_dev);
+        key.inode = quint64(st.st_ino);
+        key.size = inputSize;
+#ifdef Q_OS_MACOS
+        key.mtime = qint64(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        key.mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        if (m_journal && m_journal->isDone(inputFile, key)) {
+            ::close(fd);
+            m_bytesDone.fetchAndAddRelaxed(inputSize);
+            m_filesDone.fetchAndAddRelaxed(1);
+            continue;
+        }
+        
+        m_readThrottle.acquire(inputSize);
+        QElapsedTimer timer;
+        timer.start();
+        char *data = buffer->data();
+        qint64 size = 0;
+        while (size < inputSize) {
+            const ssize_t n = ::read(fd, data + size, size_t(inputSize - size));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            size += n;
+        }
+        ::close(fd);
+        m_metrics.record(ProcessingMetrics::Read, timer.nsecsElapsed(), size);
+        if (size != inputSize) {
+            emit processingError(QString("Ошибка чтения файла: %1").arg(inputFile));
+            finishFile(inputFile, QString(), inputSize, fileTimer.nsecsElapsed(), false, true);
+            continue;
+        }
+        
+        IntegrityManifest::Digests digests;
+        IntegrityManifest::Digests *fileDigests = m_manifest ? &digests : nullptr;
+        updateDigests(fileDigests, IntegrityManifest::Input, data, size);
+        m_transformNsecs.fetchAndAddRelaxed(transformData(data, data, size, 0));
+        m_transformBytes.fetchAndAddRelaxed(size);
+        updateDigests(fileDigests, IntegrityManifest::Output, data, size);
+        
+        if (m_bundleOutput) {
+            if (!bundle) {
+                bundlePath = FileBundle::newPath(m_outputPath);
+                bundle = new FileBundle(m_committer.durability() == OutputCommitter::None
+                                        ? bundlePath : OutputCommitter::temporaryPath(bundlePath));
+                if (!bundle->open()) {
+                    emit processingError(QString("Не удалось создать файл: %1 (%2)").arg(bundle->fileName())
+                                         .arg(bundle->errorString()));
+                    delete bundle;
+                    bundle = nullptr;
+                    finishFile(inputFile, QString(), inputSize, fileTimer.nsecsElapsed(), false, true);
+                    continue;
+                }
+            }
+            m_writeThrottle.acquire(size);
+            timer.start();
+            const QString name = inputFile.startsWith(root) ? inputFile.mid(root.size()) : inputFile.mid(slash + 1);
+            if (!bundle->add(name, data, size)) {
+                // Reported with the bundle
+                finishFile(inputFile, QString(), inputSize, fileTimer.nsecsElapsed(), false, true);
+                continue;
+            }
+            m_metrics.record(ProcessingMetrics::Write, timer.nsecsElapsed(), size);
+            bundled.append(BundledFile{ inputFile, inputSize, key, fileTimer });
+            continue;
+        }
+        
+        const bool direct = m_committer.durability() == OutputCommitter::None;
+        const QString outputFile = acquireOutputFileName(inputFile, JobJournal::FileState(), direct);
+        OutputCommitter::Entry entry;
+        entry.target = outputFile;
+        entry.source = direct ? outputFile : OutputCommitter::temporaryPath(outputFile);
+        entry.keepExisting = m_fileConflictMode == 1;
+        if (m_deleteInput) {
+            entry.removeAfter = inputFile;
+        }
+        
+        timer.start();
+        if (outputDirFd < 0) {
+            outputDirFd = ::open(outputDirectory.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        const QByteArray outputName = QFile::encodeName(entry.source.mid(entry.source.lastIndexOf('/') + 1));
+        const int out = outputDirFd >= 0
+                ? ::openat(outputDirFd, outputName.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)
+                : -1;
+        qint64 written = 0;
+        if (out >= 0) {
+            m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+            m_writeThrottle.acquire(size);
+            timer.start();
+            while (written < size) {
+                const ssize_t n = ::write(out, data + written, size_t(size - written));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                written += n;
+            }
+            if (::close(out) != 0) {
+                written = -1;
+            }
+            m_metrics.record(ProcessingMetrics::Write, timer.nsecsElapsed(), size);
+        }
+        
+        if (written != size) {
+            emit processingError(QString("Ошибка записи в файл: %1").arg(outputFile));
+            if (entry.source != outputFile) {
+                QFile::remove(entry.source);
+            }
+            finishFile(inputFile, outputFile, inputSize, fileTimer.nsecsElapsed(), false, !direct);
+        } else {
+            submitOutput(entry, inputFile, inputSize, fileTimer, m_journal != nullptr, key, digests);
+        }
+        if (!m_deleteInput) {
+            m_prefetcher.drop(inputFile);
+        }
+        releaseOutputFileName(outputFile);
+    }
+    
+    if (inputDirFd >= 0) {
+        ::close(inputDirFd);
+    }
+    if (outputDirFd >= 0) {
+        ::close(outputDirFd);
+    }
+    {
+        QMutexLocker locker(&m_reportMutex);
+        m_currentFile = fileNameOf(files.last());
+    }
+    if (bundle) {
+        submitBundle(bundle, bundlePath, bundled);
+    }
+#else
+    Q_UNUSED(buffer)
+    for (const QString &inputFile : files) {
+        if (!m_control.checkpoint()) {
+            break;
+        }
+        processInputFile(inputFile);
+    }
+#endif
+}
+
+void FileProcessor::submitBundle(FileBundle *bundle, const QString &target, const QList<BundledFile> &files)
+{
+    const QString source = bundle->fileName();
+    const bool finished = bundle->finish();
+    const QString error = bundle->errorString();
+    const qint64 size = bundle->size();
+    const quint32 checksum = bundle->checksum();
+    delete bundle;
+    
+    // A bundle that could not be written completely holds no finished member
+    if (!finished) {
+        emit processingError(QString("Ошибка записи в файл: %1 (%2)").arg(target).arg(error));
+        QFile::remove(source);
+        for (const BundledFile &file : files) {
+            finishFile(file.input, target, file.size, file.timer.nsecsElapsed(), false, true);
+        }
+        return;
+    }
+    
+    OutputCommitter::Entry entry;
+    entry.source = source;
+    entry.target = target;
+    for (const BundledFile &file : files) {
+        if (m_deleteInput) {
+            entry.removeAfter.append(file.input);
+        } else {
+            m_prefetcher.drop(file.input);
+        }
+    }
+    // The manifest lists the bundle; its members carry their own checksums
+    const bool markDone = m_journal && !m_deleteInput;
+    entry.done = [this, target, files, size, checksum, markDone](bool committed, const QString &error) {
+        if (!error.isEmpty()) {
+            emit processingError(error);
+        }
+        if (committed) {
+            m_prefetcher.drop(target);
+        }
+        if (committed && m_manifest && (m_checksums & IntegrityManifest::Output)) {
+            IntegrityManifest::Entry record;
+            record.output = target;
+            record.size = size;
+            record.coverage = IntegrityManifest::Output;
+            record.digests.output = checksum;
+            record.nsecs = files.isEmpty() ? 0 : files.first().timer.nsecsElapsed();
+            m_manifest->add(record);
+        }
+        for (const BundledFile &file : files) {
+            if (committed && markDone) {
+                m_journal->markDone(file.input, file.key);
+            }
+            finishFile(file.input, target, file.size, file.timer.nsecsElapsed(), committed, true);
+        }
+    };
+    m_committer.add(entry);
+}
+
+void FileProcessor::finishFile(const QString &inputFile, const QString &outputFile, qint64 inputSize,
+                               qint64 nsecs, bool processed, bool keepOutput)
+{
+    m_metrics.recordFile(nsecs, inputSize, processed);
+    
+    if (processed) {
+        QMutexLocker locker(&m_reportMutex);
+        m_finishedFiles.append(fileNameOf(inputFile));
+    } else {
+        // Keeps the byte progress able to reach 100%
+        m_bytesTotal.fetchAndSubRelaxed(inputSize);
+    }
+    m_filesDone.fetchAndAddRelaxed(1);
+    
+    if (processed) {
+        if (m_scanIndex) {
+            m_scanIndex->markProcessed(inputFile);
+            m_scanIndex->markProcessed(outputFile);
+        }
+    } else if (m_fileConflictMode == 1 && !keepOutput) {
+        // The name was written directly and holds nothing or a partial
+        // result; give it back
+        QFile::remove(outputFile);
+        m_outputNames.release(outputFile);
+    }
+}
+
+void FileProcessor::reportProgress(bool force)
+{
+    // Called after every file and from the scan; all but one caller per
+    // interval return after an atomic compare
+    const qint64 now = m_clock.elapsed();
+    if (!force) {
+        const qint64 due = m_nextReportAt.loadRelaxed();
+        if (now < due || !m_nextReportAt.testAndSetRelaxed(due, now + m_reportInterval)) {
+            return;
+        }
+    }
+    
+    ProcessingProgress progress;
+    QStringList finished;
+    int percent = -1;
+    {
+        QMutexLocker locker(&m_reportMutex);
+        finished.swap(m_finishedFiles);
+        progress.currentFile = m_currentFile;
+        progress.filesDone = m_filesDone.loadRelaxed();
+        progress.filesTotal = m_queue ? m_queue->pushedCount() : progress.filesDone;
+        progress.scanComplete = !m_queue || m_queue->isClosed();
+        progress.bytesDone = m_bytesDone.loadRelaxed();
+        // Files can grow between the scan and their processing
+        progress.bytesTotal = qMax(m_bytesTotal.loadRelaxed(), progress.bytesDone);
+        
+        // Smoothed, so that a burst of small cached files does not swing the estimate
+        const qint64 elapsed = now - m_lastReportTime;
+        if (elapsed >= DefaultReportInterval) {
+            const double rate = (progress.bytesDone - m_lastReportBytes) * 1000.0 / elapsed;
+            m_bytesPerSecond = m_bytesPerSecond > 0 ? 0.7 * m_bytesPerSecond + 0.3 * rate : rate;
+            m_lastReportBytes = progress.bytesDone;
+            m_lastReportTime = now;
+        }
+        progress.bytesPerSecond = m_bytesPerSecond;
+        if (progress.scanComplete && m_bytesPerSecond > 0) {
+            progress.etaSeconds = qint64((progress.bytesTotal - progress.bytesDone) / m_bytesPerSecond);
+        }
+        
+        // The total is only known once the scan is done; empty files are
+        // weighted by count
+        if (progress.scanComplete && progress.filesTotal > 0) {
+            const int value = progress.bytesTotal > 0
+                    ? int(progress.bytesDone * 100 / progress.bytesTotal)
+                    : progress.filesDone * 100 / progress.filesTotal;
+            if (value > m_lastProgress) {
+                m_lastProgress = value;
+                percent = value;
+            }
+        }
+    }
+    
+    if (!finished.isEmpty()) {
+        emit filesProcessed(finished);
+    }
+    emit progressUpdated(progress);
+    if (percent >= 0) {
+        emit progressChanged(percent);
+    }
+}
+
+void FileProcessor::publishMetrics(bool force)
+{
+    if (!force) {
+        // One caller per interval wins; the others return at once
+        const qint64 due = m_nextMetricsAt.loadRelaxed();
+        const qint64 now = m_clock.elapsed();
+        if (m_metricsInterval <= 0 || now < due
+                || !m_nextMetricsAt.testAndSetRelaxed(due, now + m_metricsInterval)) {
+            return;
+        }
+    }
+    
+    const ProcessingMetrics::Snapshot snapshot = m_metrics.snapshot();
+    emit metricsUpdated(snapshot);
+    
+    if (m_metricsFile.isEmpty()) {
+        return;
+    }
+    
+    QMutexLocker locker(&m_metricsMutex);
+    // Written atomically, so a collector never reads a half-written file
+    QSaveFile file(m_metricsFile);
+    const QByteArray data = m_metricsFile.endsWith(".json", Qt::CaseInsensitive)
+            ? QJsonDocument(ProcessingMetrics::toJson(snapshot)).toJson(QJsonDocument::Compact) + '\n'
+            : ProcessingMetrics::toPrometheus(snapshot);
+    const bool written = file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+    
+    // Reported once, not on every interval
+    if (!written && !m_metricsFileFailed) {
+        emit processingError(QString("Не удалось записать файл метрик: %1").arg(m_metricsFile));
+    }
+    m_metricsFileFailed = !written;
+}
+
+void FileProcessor::stopProcessing()
+{
+    QMutexLocker locker(&m_jobMutex);
+    m_jobs.clear();
+    m_control.requestStop();
+}
+
+void FileProcessor::commitIfDue()
+{
+    // Commit callbacks read the output settings
+    QReadLocker locker(&m_fileLock);
+    m_committer.commitIfDue();
+}
+
+void FileProcessor::findFiles(FileQueue &queue)
+{
+    QDir dir(m_inputPath.isEmpty() ? QDir::currentPath() : m_inputPath);
+    
+    if (!dir.exists()) {
+        emit processingError("Указанная папка не существует");
+        return;
+    }
+    
+    DirectoryScanner scanner((GlobMatcher(m_inputMask)));
+    scanner.setMetrics(&m_metrics);
+    ScanIndex *index = m_scanIndex;
+    if (index) {
+        scanner.setSkipHook([index](const QString &directory, qint64 mtime, QStringList *subdirectories) {
+            return index->isUnchanged(directory, mtime, subdirectories);
+        });
+    }
+    scanner.setListingHook([this, index](const QString &directory, qint64 mtime, const QStringList &subdirectories,
+                                         QStringList *files) {
+        for (int i = files->size() - 1; i >= 0; --i) {
+            // The run's own bookkeeping, e.g. when the output folder is the input folder
+            if (InPlaceMarker::isMarkerFile(files->at(i)) || OutputCommitter::isTemporaryFile(files->at(i))
+                    || JobJournal::isJournalFile(files->at(i)) || IntegrityManifest::isManifestFile(files->at(i))
+                    || FileBundle::isBundleFile(files->at(i))) {
+                files->removeAt(i);
+            }
+        }
+        if (index) {
+            index->updateDirectory(directory, mtime, subdirectories, files);
+        }
+        
+        // Sizes for the byte-weighted progress; scanner threads stat in
+        // parallel while the workers are already busy
+        qint64 bytes = 0;
+        for (const QString &file : *files) {
+            bytes += fileSize(file);
+        }
+        m_bytesTotal.fetchAndAddRelaxed(bytes);
+    });
+    
+    const bool complete = scanner.scan(dir.absolutePath(), [this, &queue](const QStringList &files) {
+        queue.push(files);
+        commitIfDue();
+        reportProgress(false);
+    }, &m_control);
+    
+    if (complete && index) {
+        index->setScanComplete();
+    }
+}
+
+QString FileProcessor::outputFileName(const QString &inputFile) const
+{
+    // The whole file name is kept, so "a.tar.gz" stays "a.tar.gz"; only
+    // compression adds its suffix and restoring removes it again
+    QString fileName = fileNameOf(inputFile);
+    const QString suffix = FrameCodec::suffix();
+    if (m_restore) {
+        if (fileName.endsWith(suffix) && fileName.size() > suffix.size()) {
+            fileName.chop(suffix.size());
+        }
+    } else if (m_compressionLevel > 0) {
+        fileName += suffix;
+    }
+    return fileName;
+}
+
+QString FileProcessor::generateOutputFileName(const QString &inputFile)
+{
+    return QString("%1/%2").arg(m_outputPath).arg(outputFileName(inputFile));
+}
+
+QString FileProcessor::acquireOutputFileName(const QString &inputFile, const JobJournal::FileState &resumed,
+                                             bool direct)
+{
+    if (m_fileConflictMode == 1) { // Add counter
+        // The name an interrupted run reserved: its file holds the partial
+        // data, or nobody has taken it since
+        if (!resumed.target.isEmpty() && (resumed.partial == resumed.target || !QFile::exists(resumed.target))) {
+            m_outputNames.markTaken(resumed.target);
+            return resumed.target;
+        }
+        
+        // Another program may have taken the name since the directory was
+        // listed. An empty file created here would look like a finished
+        // output after a crash, so unless the data goes straight to the name
+        // it is only checked, and the rename at commit claims it.
+        const QString fileName = outputFileName(inputFile);
+        for (;;) {
+            const QString outputFile = m_outputNames.reserve(m_outputPath, fileName);
+            QFile output(outputFile);
+            if (direct ? output.open(QIODevice::WriteOnly | QIODevice::NewOnly) || !output.exists()
+                       : !output.exists()) {
+                return outputFile;
+            }
+            m_outputNames.markTaken(outputFile);
+        }
+    }
+    
+    // Overwrite mode: files that map to the same name are written one at a time
+    QMutexLocker locker(&m_outputMutex);
+    QString outputFile = generateOutputFileName(inputFile);
+    while (m_activeOutputs.contains(outputFile)) {
+        m_outputReleased.wait(&m_outputMutex);
+    }
+    m_activeOutputs.insert(outputFile);
+    return outputFile;
+}
+
+void FileProcessor::releaseOutputFileName(const QString &outputFile)
+{
+    QMutexLocker locker(&m_outputMutex);
+    m_activeOutputs.remove(outputFile);
+    m_outputReleased.wakeAll();
+}
+
+bool FileProcessor::processFile(const QString &inputFile, const QString &outputFile, JobJournal::FileState *job,
+                                IntegrityManifest::Digests *digests)
+{
+    // Chunks are large, so QFile's own buffering would only add a copy
+    QElapsedTimer timer;
+    timer.start();
+    QFile input(inputFile);
+    if (!input.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        emit processingError(QString("Не удалось открыть файл: %1").arg(inputFile));
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    
+    // Frame-compressed inputs are recognised by their first header; other
+    // files only have the transform undone. Neither compressing nor
+    // decompressing keeps journal checkpoints: an interrupted file starts over.
+    if (m_restore) {
+        char header[FrameCodec::HeaderSize];
+        qint64 memberSize = 0;
+        qint64 dataSize = 0;
+        if (input.read(header, sizeof(header)) == qint64(sizeof(header))
+                && FrameCodec::parseHeader(header, sizeof(header), &memberSize, &dataSize)) {
+            return processFileDecompress(input, outputFile, digests);
+        }
+        if (!input.seek(0)) {
+            emit processingError(QString("Ошибка чтения файла: %1").arg(inputFile));
+            return false;
+        }
+    } else if (m_compressionLevel > 0) {
+        return processFileCompressed(input, outputFile, digests);
+    }
+    
+    if (m_splitLargeFiles && input.size() > m_splitChunkSize) {
+        const int threads = splitThreadCount();
+        if (threads > 1) {
+            return processFileSplit(input, outputFile, threads, job, digests);
+        }
+    }
+    
+    if (m_mmapThreshold > 0 && input.size() >= m_mmapThreshold) {
+        return processFileMapped(input, outputFile, job, digests);
+    }
+    
+    // Continues after the part an interrupted run left on disk. Unbuffered,
+    // so that a checkpoint's fdatasync covers everything written.
+    const qint64 resumeFrom = job ? job->completedPrefix() : 0;
+    timer.start();
+    QFile output(outputFile);
+    const QIODevice::OpenMode mode = resumeFrom > 0 ? QIODevice::ReadWrite : QIODevice::WriteOnly | QIODevice::Truncate;
+    if (!output.open(mode | QIODevice::Unbuffered)) {
+        emit processingError(QString("Не удалось создать файл: %1").arg(outputFile));
+        input.close();
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    if (resumeFrom > 0) {
+        if (!input.seek(resumeFrom) || !output.seek(resumeFrom)
+                || (digests && !checksumRange(inputFile, 0, resumeFrom, false, digests))) {
+            emit processingError(QString("Не удалось продолжить обработку файла: %1").arg(inputFile));
+            return false;
+        }
+        m_bytesDone.fetchAndAddRelaxed(resumeFrom);
+    }
+    
+    IoPipeline *pipeline = acquirePipeline();
+    
+    // Only data the pipeline reports as written without gaps is journaled
+    qint64 written = resumeFrom;
+    qint64 checkpointed = resumeFrom;
+    qint64 transformNsecs = 0;
+    qint64 transformed = 0;
+    auto transform = [&](char *data, qint64 size, qint64 offset) {
+        updateDigests(digests, IntegrityManifest::Input, data, size);
+        transformNsecs += transformData(data, data, size, resumeFrom + offset);
+        updateDigests(digests, IntegrityManifest::Output, data, size);
+        transformed += size;
+        written = resumeFrom + pipeline->writtenOffset();
+        if (job && written - checkpointed >= CheckpointInterval && checkpoint(job, output.handle(), 0, written)) {
+            checkpointed = written;
+        }
+    };
+    
+    const bool completed = pipeline->run(input, output, transform, &m_control);
+    const QString pipelineError = pipeline->errorString();
+    written = resumeFrom + pipeline->writtenOffset();
+    releasePipeline(pipeline);
+    
+    if (job && m_control.isStopRequested() && written > checkpointed) {
+        checkpoint(job, output.handle(), 0, written);
+    }
+    
+    input.close();
+    output.close();
+    
+    m_transformNsecs.fetchAndAddRelaxed(transformNsecs);
+    m_transformBytes.fetchAndAddRelaxed(transformed);
+    
+    if (!completed && !m_control.isStopRequested()) {
+        emit processingError(QString("Ошибка записи в файл: %1 (%2)").arg(outputFile).arg(pipelineError));
+        return false;
+    }
+    
+    return !m_control.isStopRequested();
+}
+
+bool FileProcessor::processFileInPlace(const QString &inputFile, IntegrityManifest::Digests *digests)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QFile file(inputFile);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        emit processingError(QString("Не удалось открыть файл: %1").arg(inputFile));
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    
+    // Picks up where an interrupted run stopped; bytes before offset are
+    // already transformed and must not be XORed a second time
+    InPlaceMarker marker(inputFile);
+    qint64 offset = 0;
+    if (!marker.open(file, m_activeTransform, &offset)) {
+        emit processingError(QString("Не удалось продолжить обработку файла %1: %2")
+                             .arg(inputFile).arg(marker.errorString()));
+        return false;
+    }
+    
+    const qint64 size = file.size();
+    const qint64 resumedAt = offset;
+    m_bytesDone.fetchAndAddRelaxed(resumedAt);
+    if (digests && resumedAt > 0 && !checksumRange(inputFile, 0, resumedAt, true, digests)) {
+        emit processingError(QString("Ошибка чтения файла: %1").arg(inputFile));
+        return false;
+    }
+    QByteArray buffer(m_bufferSize, Qt::Uninitialized);
+    qint64 transformNsecs = 0;
+    
+    while (offset < size && m_control.checkpoint()) {
+        const qint64 length = qMin<qint64>(m_bufferSize, size - offset);
+        m_readThrottle.acquire(length);
+        timer.start();
+        if (!file.seek(offset) || file.read(buffer.data(), length) != length) {
+            emit processingError(QString("Ошибка чтения файла: %1").arg(inputFile));
+            return false;
+        }
+        m_metrics.record(ProcessingMetrics::Read, timer.nsecsElapsed(), length);
+        
+        const quint64 originalHash = InPlaceMarker::hash(buffer.constData(), length);
+        updateDigests(digests, IntegrityManifest::Input, buffer.constData(), length);
+        transformNsecs += transformData(buffer.constData(), buffer.data(), length, offset);
+        updateDigests(digests, IntegrityManifest::Output, buffer.constData(), length);
+        const quint64 transformedHash = InPlaceMarker::hash(buffer.constData(), length);
+        
+        // The previous chunk is on disk before the marker moves past it
+        if (offset > resumedAt) {
+            timer.start();
+            if (!InPlaceMarker::syncData(file)) {
+                emit processingError(QString("Ошибка записи в файл: %1 (%2)").arg(inputFile).arg(file.errorString()));
+                return false;
+            }
+            m_metrics.record(ProcessingMetrics::Fsync, timer.nsecsElapsed());
+        }
+        
+        // The marker update is counted as part of the write
+        m_writeThrottle.acquire(length);
+        timer.start();
+        if (!marker.beginChunk(offset, length, originalHash, transformedHash)
+                || !file.seek(offset) || file.write(buffer.constData(), length) != length) {
+            emit processingError(QString("Ошибка записи в файл: %1 (%2)").arg(inputFile).arg(file.errorString()));
+            return false;
+        }
+        m_metrics.record(ProcessingMetrics::Write, timer.nsecsElapsed(), length);
+        offset += length;
+    }
+    
+    m_transformNsecs.fetchAndAddRelaxed(transformNsecs);
+    m_transformBytes.fetchAndAddRelaxed(offset - resumedAt);
+    
+    // The marker stays behind so that the next run continues from offset
+    if (m_control.isStopRequested()) {
+        return false;
+    }
+    
+    // Renaming to outputFile and removing the marker are left to the
+    // committer; until then a crashed run finds the file complete
+    timer.start();
+    const bool synced = InPlaceMarker::syncData(file);
+    m_metrics.record(ProcessingMetrics::Fsync, timer.nsecsElapsed());
+    file.close();
+    if (!synced || !marker.finish()) {
+        emit processingError(QString("Ошибка записи в файл: %1").arg(InPlaceMarker::markerPath(inputFile)));
+        return false;
+    }
+    return true;
+}
+
+bool FileProcessor::processFileMapped(QFile &input, const QString &outputFile, JobJournal::FileState *job,
+                                      IntegrityManifest::Digests *digests)
+{
+    const qint64 size = input.size();
+    // Mappings start at window boundaries
+    const qint64 resumeFrom = job ? job->completedPrefix() / MapWindowSize * MapWindowSize : 0;
+    
+#ifdef Q_OS_LINUX
+    posix_fadvise(input.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    // The output has to be readable as well to be mapped for writing
+    QElapsedTimer timer;
+    timer.start();
+    QFile output(outputFile);
+    if (!output.open(resumeFrom > 0 ? QIODevice::ReadWrite : QIODevice::ReadWrite | QIODevice::Truncate)) {
+        emit processingError(QString("Не удалось создать файл: %1").arg(outputFile));
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    
+    if (!preallocate(output, size)) {
+        emit processingError(QString("Недостаточно места для файла: %1").arg(outputFile));
+        return false;
+    }
+    m_bytesDone.fetchAndAddRelaxed(resumeFrom);
+    if (digests && resumeFrom > 0 && !checksumRange(input.fileName(), 0, resumeFrom, false, digests)) {
+        emit processingError(QString("Не удалось продолжить обработку файла: %1").arg(input.fileName()));
+        return false;
+    }
+    
+    qint64 transformNsecs = 0;
+    qint64 transformed = 0;
+    qint64 written = resumeFrom;
+    qint64 checkpointed = resumeFrom;
+    for (qint64 offset = resumeFrom; offset < size && !m_control.isStopRequested(); offset += MapWindowSize) {
+        const qint64 length = qMin(MapWindowSize, size - offset);
+        
+        uchar *src = input.map(offset, length);
+        uchar *dst = output.map(offset, length);
+        if (!src || !dst) {
+            if (src) {
+                input.unmap(src);
+            }
+            if (dst) {
+                output.unmap(dst);
+            }
+            emit processingError(QString("Не удалось отобразить файл в память: %1").arg(input.fileName()));
+            return false;
+        }
+        
+        adviseSequential(src, length);
+        adviseSequential(dst, length);
+        
+        qint64 done = 0;
+        for (; done < length && m_control.checkpoint(); done += MapStepSize) {
+            const qint64 step = qMin(MapStepSize, length - done);
+            // Page faults and writeback do the I/O here, so the step is
+            // charged before it is touched
+            m_readThrottle.acquire(step);
+            m_writeThrottle.acquire(step);
+            updateDigests(digests, IntegrityManifest::Input, reinterpret_cast<const char *>(src + done), step);
+            transformNsecs += transformData(reinterpret_cast<const char *>(src + done),
+                                      reinterpret_cast<char *>(dst + done), step, offset + done);
+            updateDigests(digests, IntegrityManifest::Output, reinterpret_cast<const char *>(dst + done), step);
+            transformed += step;
+        }
+        
+        input.unmap(src);
+        output.unmap(dst);
+        
+        // Unmapped pages stay in the page cache, where fdatasync finds them
+        if (done >= length) {
+            written = offset + length;
+        }
+        if (job && (written - checkpointed >= CheckpointInterval || (m_control.isStopRequested() && written > checkpointed))
+                && checkpoint(job, output.handle(), 0, written)) {
+            checkpointed = written;
+        }
+    }
+    
+    m_transformNsecs.fetchAndAddRelaxed(transformNsecs);
+    m_transformBytes.fetchAndAddRelaxed(transformed);
+    
+    return !m_control.isStopRequested();
+}
+
+bool FileProcessor::processFileSplit(QFile &input, const QString &outputFile, int threads,
+                                     JobJournal::FileState *job, IntegrityManifest::Digests *digests)
+{
+    const qint64 size = input.size();
+    const QString inputFile = input.fileName();
+    input.close();
+    
+    QElapsedTimer timer;
+    timer.start();
+    // Ranges an interrupted run completed are kept and skipped
+    const bool resuming = job && !job->completed.isEmpty();
+    QFile output(outputFile);
+    if (!output.open(resuming ? QIODevice::ReadWrite : QIODevice::WriteOnly | QIODevice::Truncate)) {
+        emit processingError(QString("Не удалось создать файл: %1").arg(outputFile));
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    if (!preallocate(output, size)) {
+        emit processingError(QString("Недостаточно места для файла: %1").arg(outputFile));
+        return false;
+    }
+    output.close();
+    
+    const qint64 chunkCount = (size + m_splitChunkSize - 1) / m_splitChunkSize;
+    threads = int(qMin<qint64>(threads, chunkCount));
+    
+    // One thread uses the files this worker just closed; the others need
+    // room under the open-file limit
+    int spareFiles = 0;
+    if (m_spareFiles) {
+        while (1 + spareFiles / FilesPerWorker < threads && m_spareFiles->tryAcquire(FilesPerWorker)) {
+            spareFiles += FilesPerWorker;
+        }
+        threads = 1 + spareFiles / FilesPerWorker;
+    }
+    
+    // Every stage of the chain depends only on a byte's value and its offset
+    // in the file, so ranges are independent.
+    // Each thread keeps its own handles, which makes seek + read/write
+    // positional I/O without sharing a file position between threads.
+    QAtomicInteger<qint64> nextChunk(0);
+    QAtomicInteger<qint64> transformNsecs(0);
+    QAtomicInteger<qint64> skipped(0);
+    QAtomicInt failed(0);
+    
+    // Every range is summed on its own and the sums are combined in file
+    // order afterwards
+    QVector<IntegrityManifest::Digests> rangeDigests(digests ? int(chunkCount) : 0);
+    IntegrityManifest::Digests *rangeDigest = rangeDigests.data();
+    
+    auto rangeWorker = [&]() {
+        QFile in(inputFile);
+        QFile out(outputFile);
+        if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::ReadWrite)) {
+            failed.storeRelaxed(1);
+            return;
+        }
+        
+        QByteArray buffer(m_bufferSize, Qt::Uninitialized);
+        qint64 localNsecs = 0;
+        
+        while (m_control.checkpoint() && !failed.loadRelaxed()) {
+            const qint64 chunk = nextChunk.fetchAndAddRelaxed(1);
+            if (chunk >= chunkCount) {
+                break;
+            }
+            
+            const qint64 begin = chunk * m_splitChunkSize;
+            const qint64 end = qMin(begin + m_splitChunkSize, size);
+            IntegrityManifest::Digests *chunkDigests = digests ? &rangeDigest[chunk] : nullptr;
+            if (resuming && m_journal->isCompleted(job, begin, end)) {
+                if (chunkDigests && !checksumRange(inputFile, begin, end, false, chunkDigests)) {
+                    failed.storeRelaxed(1);
+                    break;
+                }
+                m_bytesDone.fetchAndAddRelaxed(end - begin);
+                skipped.fetchAndAddRelaxed(end - begin);
+                continue;
+            }
+            if (!in.seek(begin) || !out.seek(begin)) {
+                failed.storeRelaxed(1);
+                break;
+            }
+            
+            qint64 offset = begin;
+            while (offset < end && m_control.checkpoint()) {
+                const qint64 length = qMin<qint64>(m_bufferSize, end - offset);
+                m_readThrottle.acquire(length);
+                QElapsedTimer ioTimer;
+                ioTimer.start();
+                if (in.read(buffer.data(), length) != length) {
+                    failed.storeRelaxed(1);
+                    break;
+                }
+                m_metrics.record(ProcessingMetrics::Read, ioTimer.nsecsElapsed(), length);
+                updateDigests(chunkDigests, IntegrityManifest::Input, buffer.constData(), length);
+                localNsecs += transformData(buffer.constData(), buffer.data(), length, offset);
+                updateDigests(chunkDigests, IntegrityManifest::Output, buffer.constData(), length);
+                m_writeThrottle.acquire(length);
+                ioTimer.start();
+                if (out.write(buffer.constData(), length) != length) {
+                    failed.storeRelaxed(1);
+                    break;
+                }
+                m_metrics.record(ProcessingMetrics::Write, ioTimer.nsecsElapsed(), length);
+                offset += length;
+            }
+            
+            if (job && offset == end && out.flush()) {
+                checkpoint(job, out.handle(), begin, end);
+            }
+        }
+        
+        transformNsecs.fetchAndAddRelaxed(localNsecs);
+    };
+    
+    // A private pool per file, so that files split concurrently by several
+    // workers do not wait on each other's ranges
+    QThreadPool rangePool;
+    rangePool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        rangePool.start(rangeWorker);
+    }
+    rangePool.waitForDone();
+    if (spareFiles > 0) {
+        m_spareFiles->release(spareFiles);
+    }
+    
+    if (failed.loadRelaxed()) {
+        emit processingError(QString("Ошибка записи в файл: %1").arg(outputFile));
+        return false;
+    }
+    
+    m_transformNsecs.fetchAndAddRelaxed(transformNsecs.loadRelaxed());
+    m_transformBytes.fetchAndAddRelaxed(size - skipped.loadRelaxed());
+    
+    if (digests && !m_control.isStopRequested()) {
+        for (qint64 chunk = 0; chunk < chunkCount; ++chunk) {
+            const qint64 length = qMin(m_splitChunkSize, size - chunk * m_splitChunkSize);
+            digests->input = Crc32c::combine(digests->input, rangeDigest[chunk].input, length);
+            digests->output = Crc32c::combine(digests->output, rangeDigest[chunk].output, length);
+        }
+    }
+    
+    return !m_control.isStopRequested();
+}
+
+bool FileProcessor::processFileCompressed(QFile &input, const QString &outputFile,
+                                          IntegrityManifest::Digests *digests)
+{
+    const qint64 size = input.size();
+    const QString inputFile = input.fileName();
+    input.close();
+    
+    QElapsedTimer timer;
+    timer.start();
+    QFile output(outputFile);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        emit processingError(QString("Не удалось создать файл: %1").arg(outputFile));
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    
+    // An empty input still gets one (empty) frame, which keeps the output
+    // a valid gzip file
+    const qint64 frameCount = qMax<qint64>(1, (size + FrameSize - 1) / FrameSize);
+    const int threads = int(qMin<qint64>(splitThreadCount(), frameCount));
+    
+    // Frames are compressed on all threads but written in file order: a
+    // thread that finished a frame waits until the frames before it are out.
+    // Every thread that claimed a frame either writes it or wakes the others,
+    // so a stop or a failure never leaves a thread waiting.
+    QAtomicInteger<qint64> nextFrame(0);
+    QAtomicInteger<qint64> transformNsecs(0);
+    QAtomicInt failed(0);
+    qint64 nextToWrite = 0;
+    QMutex writeMutex;
+    QWaitCondition writeTurn;
+    QVector<qint64> memberSizes(static_cast<int>(frameCount));
+    QVector<IntegrityManifest::Digests> frameDigests(digests ? int(frameCount) : 0);
+    IntegrityManifest::Digests *frameDigest = frameDigests.data();
+    
+    auto fail = [&]() {
+        QMutexLocker locker(&writeMutex);
+        failed.storeRelaxed(1);
+        writeTurn.wakeAll();
+    };
+    
+    auto frameWorker = [&]() {
+        QFile in(inputFile);
+        if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            fail();
+            return;
+        }
+    
+        FrameCodec codec(m_compressionLevel);
+        QByteArray buffer(int(FrameSize), Qt::Uninitialized);
+        QByteArray member;
+        qint64 localNsecs = 0;
+    
+        while (m_control.checkpoint() && !failed.loadRelaxed()) {
+            const qint64 frame = nextFrame.fetchAndAddRelaxed(1);
+            if (frame >= frameCount) {
+                break;
+            }
+    
+            const qint64 begin = frame * FrameSize;
+            const qint64 length = qMin(FrameSize, size - begin);
+            IntegrityManifest::Digests *digest = digests ? &frameDigest[frame] : nullptr;
+            m_readThrottle.acquire(length);
+            QElapsedTimer ioTimer;
+            ioTimer.start();
+            if (!in.seek(begin) || in.read(buffer.data(), length) != length) {
+                fail();
+                break;
+            }
+            m_metrics.record(ProcessingMetrics::Read, ioTimer.nsecsElapsed(), length);
+    
+            updateDigests(digest, IntegrityManifest::Input, buffer.constData(), length);
+            localNsecs += transformData(buffer.constData(), buffer.data(), length, begin);
+            ioTimer.start();
+            if (!codec.compress(buffer.constData(), length, &member)) {
+                fail();
+                break;
+            }
+            m_metrics.record(ProcessingMetrics::Compress, ioTimer.nsecsElapsed(), length);
+            updateDigests(digest, IntegrityManifest::Output, member.constData(), member.size());
+            // Outside the turn, so that waiting does not hold up other frames
+            m_writeThrottle.acquire(member.size());
+    
+            QMutexLocker locker(&writeMutex);
+            while (nextToWrite != frame && !failed.loadRelaxed() && !m_control.isStopRequested()) {
+                writeTurn.wait(&writeMutex);
+            }
+            if (failed.loadRelaxed() || m_control.isStopRequested()) {
+                writeTurn.wakeAll();
+                break;
+            }
+            ioTimer.start();
+            if (output.write(member.constData(), member.size()) != member.size()) {
+                failed.storeRelaxed(1);
+                writeTurn.wakeAll();
+                break;
+            }
+            m_metrics.record(ProcessingMetrics::Write, ioTimer.nsecsElapsed(), member.size());
+            memberSizes[int(frame)] = member.size();
+            ++nextToWrite;
+            writeTurn.wakeAll();
+        }
+    
+        transformNsecs.fetchAndAddRelaxed(localNsecs);
+    };
+    
+    QThreadPool framePool;
+    framePool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        framePool.start(frameWorker);
+    }
+    framePool.waitForDone();
+    output.close();
+    
+    if (failed.loadRelaxed()) {
+        emit processingError(QString("Ошибка сжатия файла: %1 (%2)").arg(outputFile).arg(output.errorString()));
+        return false;
+    }
+    
+    m_transformNsecs.fetchAndAddRelaxed(transformNsecs.loadRelaxed());
+    m_transformBytes.fetchAndAddRelaxed(size);
+    
+    if (digests && !m_control.isStopRequested()) {
+        for (qint64 frame = 0; frame < frameCount; ++frame) {
+            const qint64 length = qMin(FrameSize, size - frame * FrameSize);
+            digests->input = Crc32c::combine(digests->input, frameDigest[frame].input, length);
+            digests->output = Crc32c::combine(digests->output, frameDigest[frame].output,
+                                              memberSizes.at(int(frame)));
+        }
+    }
+    
+    return !m_control.isStopRequested();
+}
+
+bool FileProcessor::processFileDecompress(QFile &input, const QString &outputFile,
+                                          IntegrityManifest::Digests *digests)
+{
+    const qint64 size = input.size();
+    const QString inputFile = input.fileName();
+    if (!FrameCodec::isAvailable()) {
+        emit processingError(QString("Не удалось распаковать файл %1: программа собрана без zlib").arg(inputFile));
+        return false;
+    }
+    
+    // The member headers alone give where every frame is and where its data
+    // goes, so the frames can be unpacked in any order
+    struct Frame {
+        qint64 offset;
+        qint64 memberSize;
+        qint64 dataSize;
+        qint64 outputOffset;
+    };
+    QVector<Frame> frames;
+    qint64 outputSize = 0;
+    for (qint64 offset = 0; offset < size; ) {
+        char header[FrameCodec::HeaderSize];
+        Frame frame;
+        if (!input.seek(offset) || input.read(header, sizeof(header)) != qint64(sizeof(header))
+                || !FrameCodec::parseHeader(header, sizeof(header), &frame.memberSize, &frame.dataSize)
+                || frame.memberSize > size - offset) {
+            emit processingError(QString("Файл повреждён или сжат не этой программой: %1").arg(inputFile));
+            return false;
+        }
+        frame.offset = offset;
+        frame.outputOffset = outputSize;
+        frames.append(frame);
+        offset += frame.memberSize;
+        outputSize += frame.dataSize;
+    }
+    input.close();
+    
+    QElapsedTimer timer;
+    timer.start();
+    QFile output(outputFile);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        emit processingError(QString("Не удалось создать файл: %1").arg(outputFile));
+        return false;
+    }
+    m_metrics.record(ProcessingMetrics::Open, timer.nsecsElapsed());
+    if (!preallocate(output, outputSize)) {
+        emit processingError(QString("Недостаточно места для файла: %1").arg(outputFile));
+        return false;
+    }
+    output.close();
+    
+    const int frameCount = frames.size();
+    const int threads = qMin(splitThreadCount(), qMax(frameCount, 1));
+    QAtomicInt nextFrame(0);
+    QAtomicInteger<qint64> transformNsecs(0);
+    QAtomicInt failed(0);
+    QAtomicInt corrupt(0);
+    QVector<IntegrityManifest::Digests> frameDigests(digests ? frameCount : 0);
+    IntegrityManifest::Digests *frameDigest = frameDigests.data();
+    
+    auto frameWorker = [&]() {
+        QFile in(inputFile);
+        QFile out(outputFile);
+        if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)
+                || !out.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+            failed.storeRelaxed(1);
+            return;
+        }
+    
+        FrameCodec codec;
+        QByteArray member;
+        QByteArray data;
+        qint64 localNsecs = 0;
+    
+        while (m_control.checkpoint() && !failed.loadRelaxed()) {
+            const int index = nextFrame.fetchAndAddRelaxed(1);
+            if (index >= frameCount) {
+                break;
+            }
+    
+            const Frame &frame = frames.at(index);
+            IntegrityManifest::Digests *digest = digests ? &frameDigest[index] : nullptr;
+            member.resize(int(frame.memberSize));
+            data.resize(int(frame.dataSize));
+            m_readThrottle.acquire(frame.memberSize);
+            QElapsedTimer ioTimer;
+            ioTimer.start();
+            if (!in.seek(frame.offset) || in.read(member.data(), frame.memberSize) != frame.memberSize) {
+                failed.storeRelaxed(1);
+                break;
+            }
+            m_metrics.record(ProcessingMetrics::Read, ioTimer.nsecsElapsed(), frame.memberSize);
+            updateDigests(digest, IntegrityManifest::Input, member.constData(), frame.memberSize);
+    
+            ioTimer.start();
+            if (!codec.decompress(member.constData(), frame.memberSize, data.data(), frame.dataSize)) {
+                corrupt.storeRelaxed(1);
+                failed.storeRelaxed(1);
+                break;
+            }
+            m_metrics.record(ProcessingMetrics::Compress, ioTimer.nsecsElapsed(), frame.dataSize);
+    
+            localNsecs += transformData(data.constData(), data.data(), frame.dataSize, frame.outputOffset);
+            updateDigests(digest, IntegrityManifest::Output, data.constData(), frame.dataSize);
+            // transformData counted the unpacked bytes; progress is in input bytes
+            m_bytesDone.fetchAndAddRelaxed(frame.memberSize - frame.dataSize);
+    
+            m_writeThrottle.acquire(frame.dataSize);
+            ioTimer.start();
+            if (!out.seek(frame.outputOffset) || out.write(data.constData(), frame.dataSize) != frame.dataSize) {
+                failed.storeRelaxed(1);
+                break;
+            }
+            m_metrics.record(ProcessingMetrics::Write, ioTimer.nsecsElapsed(), frame.dataSize);
+        }
+    
+        transformNsecs.fetchAndAddRelaxed(localNsecs);
+    };
+    
+    QThreadPool framePool;
+    framePool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        framePool.start(frameWorker);
+    }
+    framePool.waitForDone();
+    
+    if (failed.loadRelaxed()) {
+        emit processingError(corrupt.loadRelaxed()
+                             ? QString("Файл повреждён: %1").arg(inputFile)
+                             : QString("Ошибка записи в файл: %1").arg(outputFile));
+        return false;
+    }
+    
+    m_transformNsecs.fetchAndAddRelaxed(transformNsecs.loadRelaxed());
+    m_transformBytes.fetchAndAddRelaxed(outputSize);
+    
+    if (digests && !m_control.isStopRequested()) {
+        for (int index = 0; index < frameCount; ++index) {
+            digests->input = Crc32c::combine(digests->input, frameDigest[index].input, frames.at(index).memberSize);
+            digests->output = Crc32c::combine(digests->output, frameDigest[index].output, frames.at(index).dataSize);
+        }
+    }
+    
+    return !m_control.isStopRequested();
+}
+
+bool FileProcessor::checkpoint(JobJournal::FileState *job, int fd, qint64 begin, qint64 end)
+{
+    // The journal must never claim data that a crash can still take away
+    QElapsedTimer timer;
+    timer.start();
+#if defined(Q_OS_LINUX)
+    const bool synced = ::fdatasync(fd) == 0;
+#elif defined(Q_OS_UNIX)
+    const bool synced = ::fsync(fd) == 0;
+#else
+    Q_UNUSED(fd)
+    const bool synced = true;
+#endif
+    m_metrics.record(ProcessingMetrics::Fsync, timer.nsecsElapsed());
+    
+    if (synced) {
+        m_journal->addRange(job, begin, end);
+    }
+    return synced;
+}
+
+qint64 FileProcessor::transformData(const char *src, char *dst, qint64 size, qint64 offset)
+{
+    QElapsedTimer timer;
+    timer.start();
+    
+    m_activeTransform.apply(src, dst, size, offset);
+    
+    const qint64 nsecs = timer.nsecsElapsed();
+    m_metrics.record(ProcessingMetrics::Transform, nsecs, size);
+    m_bytesDone.fetchAndAddRelaxed(size);
+    return nsecs;
+}
+
+void FileProcessor::updateDigests(IntegrityManifest::Digests *digests, IntegrityManifest::Coverage side,
+                                  const char *data, qint64 size)
+{
+    if (!digests || !(m_checksums & side)) {
+        return;
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    quint32 &digest = side == IntegrityManifest::Input ? digests->input : digests->output;
+    digest = Crc32c::update(digest, data, size);
+    m_metrics.record(ProcessingMetrics::Checksum, timer.nsecsElapsed(), size);
+}
+
+bool FileProcessor::checksumRange(const QString &path, qint64 begin, qint64 end, bool transformed,
+                                  IntegrityManifest::Digests *digests)
+{
+    // Only for the part an interrupted run wrote, which never went through
+    // this run's buffers. It is read once; the other side is derived by
+    // running the chain, or its inverse for data transformed in place.
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered) || !file.seek(begin)) {
+        return false;
+    }
+    
+    const IntegrityManifest::Coverage readSide = transformed ? IntegrityManifest::Output : IntegrityManifest::Input;
+    const IntegrityManifest::Coverage derivedSide = transformed ? IntegrityManifest::Input : IntegrityManifest::Output;
+    const TransformChain chain = transformed ? m_activeTransform.inverse() : m_activeTransform;
+    QByteArray buffer(m_bufferSize, Qt::Uninitialized);
+    QByteArray derived(m_bufferSize, Qt::Uninitialized);
+    for (qint64 offset = begin; offset < end; ) {
+        const qint64 length = qMin<qint64>(m_bufferSize, end - offset);
+        m_readThrottle.acquire(length);
+        QElapsedTimer timer;
+        timer.start();
+        if (file.read(buffer.data(), length) != length) {
+            return false;
+        }
+        m_metrics.record(ProcessingMetrics::Read, timer.nsecsElapsed(), length);
+        
+        updateDigests(digests, readSide, buffer.constData(), length);
+        if (m_checksums & derivedSide) {
+            chain.apply(buffer.constData(), derived.data(), length, offset);
+            updateDigests(digests, derivedSide, derived.constData(), length);
+        }
+        offset += length;
+    }
+    return true;
+}
@@ -1,56 +1,369 @@
-#ifndef FILEPROCESSOR_H
-#define FILEPROCESSOR_H
-
-#include <QObject>
-#include <QString>
-#include <QStringList>
-#include <QFileInfo>
-#include <QMutex>
-#include <QWaitCondition>
-
-class FileProcessor : public QObject
-{
-    Q_OBJECT
-
-public:
-    explicit FileProcessor(QObject *parent = nullptr);
-    ~FileProcessor();
-
-    void setInputMask(const QString &mask);
-    void setOutputPath(const QString &path);
-    void setDeleteInput(bool deleteInput);
-    void setFileConflictMode(int mode);
-    void setXorValue(const QByteArray &value);
-    void setInputPath(const QString &path);
-
-public slots:
-    void startProcessing();
-    void stopProcessing();
-
-signals:
-    void progressChanged(int progress);
-    void processingFinished();
-    void processingError(const QString &error);
-    void fileProcessed(const QString &filename);
-    void statusChanged(const QString &status);
-
-private:
-    QString m_inputMask;
-    QString m_outputPath;
-    QString m_inputPath;
-    bool m_deleteInput;
-    int m_fileConflictMode;
-    QByteArray m_xorValue;
-    bool m_stopRequested;
-    QMutex m_mutex;
-    QWaitCondition m_condition;
-    
-    QStringList findFiles();
-    QString generateOutputFileName(const QString &inputFile);
-    bool processFile(const QString &inputFile, const QString &outputFile);
-    QByteArray xorData(const QByteArray &data);
-    bool isValidXorValue(const QString &value);
-    QByteArray parseXorValue(const QString &value);
-};
-
-#endif // FILEPROCESSOR_H 
\ No newline at end of file
+#ifndef FILEPROCESSOR_H
+#define FILEPROCESSOR_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QFileInfo>
+#include <QFile>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QList>
+#include "iopipeline.h"
+#include "outputnametable.h"
+#include "processingmetrics.h"
+#include "processingcontrol.h"
+#include "outputcommitter.h"
+#include "jobjournal.h"
+#include "transformchain.h"
+#include "integritymanifest.h"
+#include "prefetcher.h"
+#include "filequeue.h"
+#include "throttle.h"
+
+class QThreadPool;
+class QSemaphore;
+class ScanIndex;
+class FileBundle;
+
+// State of a run as reported by progressUpdated
+struct ProcessingProgress
+{
+    int filesDone = 0;
+    int filesTotal = 0;         // found so far, final once scanComplete
+    qint64 bytesDone = 0;
+    qint64 bytesTotal = 0;
+    bool scanComplete = false;
+    double bytesPerSecond = 0;
+    qint64 etaSeconds = -1;     // -1 while unknown
+    QString currentFile;
+};
+
+Q_DECLARE_METATYPE(ProcessingProgress)
+
+class FileProcessor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileProcessor(QObject *parent = nullptr);
+    ~FileProcessor();
+
+    // The mask, the paths, the conflict mode, deleting inputs and the
+    // transform may be changed from any thread, also during a run: a run
+    // takes them over when it starts, and the output settings and the
+    // transform also between two files. The other setters are for an idle
+    // processor.
+    void setInputMask(const QString &mask);
+    void setOutputPath(const QString &path);
+    void setDeleteInput(bool deleteInput);
+    void setFileConflictMode(int mode);
+    // Same as setTransform with a single xor stage
+    void setXorValue(const QByteArray &value);
+    void setTransform(const TransformChain &transform);
+    void setMmapThreshold(qint64 bytes);
+    void setWorkerCount(int count);
+    // Runs the workers on pool instead of the processor's own, so that
+    // several processors share one set of threads; they take turns file by
+    // file (batch by batch on the small-file path). The worker count then
+    // defaults to the pool's thread count. A paused processor gives the
+    // threads back between files; only files already started wait in theirs.
+    // Null returns to the own pool.
+    void setWorkerPool(QThreadPool *pool);
+    void setSplitLargeFiles(bool split);
+    void setSplitChunkSize(qint64 bytes);
+    void setSplitThreadCount(int count);
+    void setBufferSize(int bytes);
+    void setQueueDepth(int depth);
+    void setIoBackend(IoPipeline::Backend backend);
+    void setInPlace(bool inPlace);
+    void setInputPath(const QString &path);
+    // Processed by the next run instead of scanning the input path; the list
+    // is consumed by that run
+    void setFileList(const QStringList &files);
+    // Keeps a scan index in directory so that runs skip files that were
+    // already processed; empty disables it
+    void setScanIndexDirectory(const QString &directory);
+    // Keeps a job journal in the output directory, so that the run after a
+    // stop or a crash skips finished files and continues large files from
+    // their last checkpoint
+    void setResume(bool resume);
+    // How often metricsUpdated is emitted during a run; 0 only emits it at
+    // the end of a run
+    void setMetricsInterval(int msec);
+    // Rewritten with every metricsUpdated: JSON for a ".json" path, the
+    // Prometheus text format otherwise; empty disables it
+    void setMetricsFile(const QString &path);
+    // Minimum time between progress reports; processed files are passed
+    // on in batches, so the number of signals does not grow with the number
+    // of files
+    void setReportInterval(int msec);
+    // None writes straight to the output name as before; Batch and File
+    // write to a temporary file and rename it once the data is on disk
+    void setDurability(OutputCommitter::Durability durability);
+    // Batch mode: a group commit every files files or msec milliseconds,
+    // whichever comes first
+    void setSyncBatch(int files, int msec);
+    // CRC-32C of the inputs and/or outputs, taken from the buffers as the
+    // data passes through and written to a manifest; None disables it
+    void setChecksums(IntegrityManifest::Coverage coverage);
+    // Manifest to append to; empty writes a new one per run to the output
+    // path
+    void setManifestFile(const QString &path);
+    // The next run checks the outputs listed in the manifest instead of
+    // processing files; consumed by that run
+    void setVerifyManifest(const QString &path);
+    // Compresses outputs as independent gzip frames (level 1-9, see
+    // FrameCodec), adding ".gz" to their names; 0 disables it
+    void setCompressionLevel(int level);
+    // Undoes a previous run: frame-compressed inputs are decompressed, and
+    // the inverse of the transform is applied. ".gz" is removed from the
+    // output names. Takes precedence over compression.
+    void setRestore(bool restore);
+    // Read-ahead of the next files in the queue while the current ones are
+    // processed, limited to files files and budget bytes; see Prefetcher
+    void setPrefetch(int files, qint64 budget);
+    // Drops processed inputs and committed outputs from the page cache
+    void setDropCache(bool drop);
+    // Files up to this size are read and written with one system call
+    // each, in batches per worker; 0 sends every file down the regular path
+    void setSmallFileLimit(qint64 bytes);
+    // Small files of a batch go into one FileBundle instead of separate
+    // outputs; larger files are written as usual
+    void setBundleOutput(bool bundle);
+    // Which queued file a worker takes next. Taken over when a run starts,
+    // so that every queued run can have its own.
+    void setSchedulingOrder(FileQueue::Order order);
+    // Bytes per second read from and written to the files, over all
+    // workers; 0 removes the limit. May be changed during a run.
+    void setBandwidthLimit(qint64 readBytesPerSecond, qint64 writeBytesPerSecond);
+    // Input and output files held open at once; fewer workers and split
+    // threads are started to stay below it. 0 removes the limit.
+    void setMaxOpenFiles(int count);
+    // Limits shared by all processors on one worker pool, so that the
+    // bandwidth and open-file limits hold for all of them together: the
+    // throttles' rates replace setBandwidthLimit(), and openFiles must
+    // hold as many permits as the count given to setMaxOpenFiles(). Null
+    // returns to this processor's own limits.
+    void setSharedLimits(Throttle *readThrottle, Throttle *writeThrottle, QSemaphore *openFiles);
+    
+    // Accumulated over all runs until resetMetrics(); safe to call while
+    // a run is in progress
+    ProcessingMetrics::Snapshot metrics() const;
+    void resetMetrics();
+
+    // Queue runs for the thread the processor lives in, which stays up
+    // between runs. An empty list asks for a full scan of the input path.
+    // Requests that arrive during a run are merged into one next run: files
+    // join the queued list, and a queued scan covers them all. Thread-safe.
+    void queueRun(const QStringList &files = QStringList());
+    void queueVerify(const QString &manifestFile);
+    // A run or a queued request is pending
+    bool isBusy() const;
+
+    // Workers pause at their next chunk, also within a large file, and the
+    // scan between directories. Thread-safe; the latency is the Control
+    // stage of the metrics.
+    void pauseProcessing();
+    void resumeProcessing();
+    bool isPaused() const;
+
+public slots:
+    // One run on the calling thread with the settings and file list given
+    // so far; for callers that manage the thread themselves
+    void startProcessing();
+    // Ends the current run at the next chunk and drops the queued requests.
+    // Thread-safe.
+    void stopProcessing();
+
+signals:
+    // Percentage of the bytes to process; emitted once the scan is complete
+    void progressChanged(int progress);
+    void progressUpdated(const ProcessingProgress &progress);
+    void processingFinished();
+    void processingError(const QString &error);
+    // File names processed since the previous report
+    void filesProcessed(const QStringList &filenames);
+    void statusChanged(const QString &status);
+    void metricsUpdated(const ProcessingMetrics::Snapshot &metrics);
+    // The queue ran empty after the last queued run
+    void idle();
+
+private:
+    // Settings that may change during a run, see setInputMask()
+    struct LiveSettings {
+        QString inputMask;
+        QString inputPath;
+        QString outputPath;
+        TransformChain transform;
+        int fileConflictMode = 0;
+        FileQueue::Order schedulingOrder = FileQueue::Fifo;
+        bool deleteInput = false;
+        bool outputChanged = false;
+    };
+
+    // A run waiting in the queue
+    struct Job {
+        bool scan = false;
+        QSet<QString> files;
+        QString verifyManifest;
+    };
+
+    QString m_inputMask;
+    QString m_outputPath;
+    QString m_inputPath;
+    FileQueue::Order m_schedulingOrder;
+    QStringList m_fileList;
+    QString m_scanIndexDirectory;
+    ScanIndex *m_scanIndex;
+    bool m_resume;
+    JobJournal *m_journal;
+    bool m_deleteInput;
+    int m_fileConflictMode;
+    TransformChain m_transform;
+    TransformChain m_activeTransform;   // m_transform, inverted when restoring
+    qint64 m_mmapThreshold;
+    int m_workerCount;
+    QThreadPool *m_workerPool;
+    QThreadPool *m_sharedPool;
+    bool m_splitLargeFiles;
+    qint64 m_splitChunkSize;
+    int m_splitThreadCount;
+    int m_bufferSize;
+    int m_queueDepth;
+    IoPipeline::Backend m_ioBackend;
+    bool m_inPlace;
+    QList<IoPipeline *> m_idlePipelines;
+    QMutex m_pipelineMutex;
+    QAtomicInteger<qint64> m_transformBytes;
+    QAtomicInteger<qint64> m_transformNsecs;
+    ProcessingControl m_control;
+    
+    LiveSettings m_settings;
+    QMutex m_settingsMutex;
+    QAtomicInt m_settingsChanged;
+    // Held for reading while a file is processed, so that new settings are
+    // only taken over between files
+    QReadWriteLock m_fileLock;
+    
+    QList<Job> m_jobs;
+    mutable QMutex m_jobMutex;
+    bool m_busy;                // a queued run is in progress or scheduled
+    
+    // "Add counter" mode: names reserved and created by this processor
+    OutputNameTable m_outputNames;
+    
+    // Overwrite mode: output names claimed by files currently being written
+    QSet<QString> m_activeOutputs;
+    QMutex m_outputMutex;
+    QWaitCondition m_outputReleased;
+    
+    // Coalesced reporting, see reportProgress()
+    int m_reportInterval;
+    FileQueue *m_queue;
+    QAtomicInt m_filesDone;
+    QAtomicInteger<qint64> m_bytesDone;
+    QAtomicInteger<qint64> m_bytesTotal;
+    QAtomicInteger<qint64> m_nextReportAt;
+    QMutex m_reportMutex;
+    QStringList m_finishedFiles;
+    QString m_currentFile;
+    int m_lastProgress;
+    qint64 m_lastReportBytes;
+    qint64 m_lastReportTime;
+    double m_bytesPerSecond;
+    QElapsedTimer m_clock;
+    
+    ProcessingMetrics m_metrics;
+    int m_metricsInterval;
+    QString m_metricsFile;
+    bool m_metricsFileFailed;
+    QAtomicInteger<qint64> m_nextMetricsAt;
+    QMutex m_metricsMutex;
+    
+    OutputCommitter m_committer;
+    QString m_cleanedOutputPath;
+    
+    IntegrityManifest::Coverage m_checksums;
+    QString m_manifestFile;
+    QString m_verifyManifest;
+    IntegrityManifest *m_manifest;
+    
+    int m_compressionLevel;
+    bool m_restore;
+    
+    Prefetcher m_prefetcher;
+    
+    qint64 m_smallFileLimit;
+    bool m_bundleOutput;
+    
+    Throttle m_readThrottle;
+    Throttle m_writeThrottle;
+    int m_maxOpenFiles;
+    QSemaphore *m_sharedOpenFiles;
+    // Open files no worker holds, which split threads can take; null
+    // without a limit
+    QSemaphore *m_spareFiles;
+    
+    // A member of the bundle a worker is filling
+    struct BundledFile {
+        QString input;
+        qint64 size;
+        ScanIndex::FileKey key;
+        QElapsedTimer timer;
+    };
+    
+    void processQueue();
+    void run();
+    void applySettings(bool runStart);
+    void commitIfDue();
+    void findFiles(FileQueue &queue);
+    void finishScanIndex();
+    void finishJournal();
+    void finishManifest();
+    void verifyManifest(const QString &manifestFile);
+    bool verifyFile(const IntegrityManifest::Entry &entry, QByteArray &buffer, QString *problem);
+    void processFiles(FileQueue &queue);
+    void processInputFile(const QString &inputFile);
+    void processSmallFiles(const QStringList &files, QByteArray *buffer);
+    void submitOutput(OutputCommitter::Entry entry, const QString &inputFile, qint64 inputSize,
+                      const QElapsedTimer &fileTimer, bool journaled, const ScanIndex::FileKey &key,
+                      const IntegrityManifest::Digests &digests);
+    void submitBundle(FileBundle *bundle, const QString &target, const QList<BundledFile> &files);
+    void finishFile(const QString &inputFile, const QString &outputFile, qint64 inputSize, qint64 nsecs,
+                    bool processed, bool keepOutput = false);
+    void reportProgress(bool force);
+    void publishMetrics(bool force);
+    QString outputFileName(const QString &inputFile) const;
+    QString generateOutputFileName(const QString &inputFile);
+    // In counter mode direct creates the name right away, for data written
+    // straight to it; otherwise it is only reserved and the commit's rename
+    // claims it
+    QString acquireOutputFileName(const QString &inputFile, const JobJournal::FileState &resumed, bool direct);
+    void releaseOutputFileName(const QString &outputFile);
+    bool processFile(const QString &inputFile, const QString &outputFile, JobJournal::FileState *job,
+                     IntegrityManifest::Digests *digests);
+    bool processFileMapped(QFile &input, const QString &outputFile, JobJournal::FileState *job,
+                           IntegrityManifest::Digests *digests);
+    bool processFileSplit(QFile &input, const QString &outputFile, int threads, JobJournal::FileState *job,
+                          IntegrityManifest::Digests *digests);
+    bool processFileCompressed(QFile &input, const QString &outputFile, IntegrityManifest::Digests *digests);
+    bool processFileDecompress(QFile &input, const QString &outputFile, IntegrityManifest::Digests *digests);
+    bool checkpoint(JobJournal::FileState *job, int fd, qint64 begin, qint64 end);
+    bool processFileInPlace(const QString &inputFile, IntegrityManifest::Digests *digests);
+    int splitThreadCount() const;
+    IoPipeline *acquirePipeline();
+    void releasePipeline(IoPipeline *pipeline);
+    void clearPipelines();
+    qint64 transformData(const char *src, char *dst, qint64 size, qint64 offset);
+    void updateDigests(IntegrityManifest::Digests *digests, IntegrityManifest::Coverage side,
+                       const char *data, qint64 size);
+    bool checksumRange(const QString &path, qint64 begin, qint64 end, bool transformed,
+                       IntegrityManifest::Digests *digests);
+};
+
+#endif // FILEPROCESSOR_H 
@@ -0,0 +1,144 @@
+#include "filequeue.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QDeadlineTimer>
+#include <QVector>
+#include <utility>
+
+FileQueue::FileQueue(Order order)
+    : m_order(order)
+    , m_pushed(0)
+    , m_closed(false)
+{
+}
+
+void FileQueue::push(const QStringList &files)
+{
+    if (m_order == Fifo) {
+        QMutexLocker locker(&m_mutex);
+        for (const QString &file : files) {
+            m_files.enqueue(file);
+        }
+        m_pushed += files.size();
+        m_changed.wakeAll();
+        return;
+    }
+
+    // Outside the lock, so that the workers are not held up by the stat calls
+    QVector<std::pair<qint64, QString>> keyed;
+    keyed.reserve(files.size());
+    for (const QString &file : files) {
+        const QFileInfo fileInfo(file);
+        qint64 key = 0;
+        switch (m_order) {
+        case SmallestFirst:
+            key = fileInfo.size();
+            break;
+        case LargestFirst:
+            key = -fileInfo.size();
+            break;
+        case OldestFirst:
+            key = fileInfo.lastModified().toMSecsSinceEpoch();
+            break;
+        case Fifo:
+            break;
+        }
+        keyed.append(std::make_pair(key, file));
+    }
+
+    QMutexLocker locker(&m_mutex);
+    for (const auto &entry : keyed) {
+        m_sorted.insert(entry);
+    }
+    m_pushed += files.size();
+    m_changed.wakeAll();
+}
+
+void FileQueue::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_closed = true;
+    m_changed.wakeAll();
+}
+
+int FileQueue::queuedCount() const
+{
+    return m_order == Fifo ? int(m_files.size()) : int(m_sorted.size());
+}
+
+QString FileQueue::take()
+{
+    if (m_order == Fifo) {
+        return m_files.dequeue();
+    }
+    const auto first = m_sorted.begin();
+    const QString file = first->second;
+    m_sorted.erase(first);
+    return file;
+}
+
+bool FileQueue::pop(QString *file)
+{
+    QMutexLocker locker(&m_mutex);
+    while (queuedCount() == 0 && !m_closed) {
+        m_changed.wait(&m_mutex);
+    }
+    if (queuedCount() == 0) {
+        return false;
+    }
+    *file = take();
+    return true;
+}
+
+bool FileQueue::pop(QStringList *files, int maxFiles, int workers, int msec)
+{
+    // A negative time never expires
+    const QDeadlineTimer deadline(msec);
+    QMutexLocker locker(&m_mutex);
+    while (queuedCount() == 0 && !m_closed) {
+        if (!m_changed.wait(&m_mutex, deadline)) {
+            break;
+        }
+    }
+    if (queuedCount() == 0) {
+        return false;
+    }
+    const int count = qBound(1, queuedCount() / qMax(1, workers), maxFiles);
+    files->clear();
+    for (int i = 0; i < count; ++i) {
+        files->append(take());
+    }
+    return true;
+}
+
+QStringList FileQueue::upcoming(int count) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_order == Fifo) {
+        return m_files.mid(0, count);
+    }
+    QStringList files;
+    for (auto it = m_sorted.begin(); it != m_sorted.end() && files.size() < count; ++it) {
+        files.append(it->second);
+    }
+    return files;
+}
+
+bool FileQueue::isClosed() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_closed;
+}
+
+bool FileQueue::isDone() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_closed && queuedCount() == 0;
+}
+
+int FileQueue::pushedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pushed;
+}
@@ -0,0 +1,65 @@
+#ifndef FILEQUEUE_H
+#define FILEQUEUE_H
+
+#include <QString>
+#include <QStringList>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <map>
+
+// Hands files from a producer (a directory scan or a given list) to the
+// worker threads while the producer is still running
+class FileQueue
+{
+public:
+    // Which of the queued files a worker gets next. Only files queued so far
+    // are compared: while the scan is still running, a file it finds later
+    // may come after one it would have preceded.
+    enum Order {
+        Fifo,           // as pushed
+        SmallestFirst,
+        LargestFirst,
+        OldestFirst     // by modification time
+    };
+
+    explicit FileQueue(Order order = Fifo);
+
+    Order order() const { return m_order; }
+
+    void push(const QStringList &files);
+    // No more files will be pushed
+    void close();
+
+    // Blocks until a file is available; false once the queue is closed and
+    // empty
+    bool pop(QString *file);
+    // Takes up to maxFiles at once, but no more than an even share of the
+    // queued files among workers, so that the end of a run stays balanced.
+    // Waits at most msec for a file (-1 without a limit); false if none came
+    // in time or the queue is done.
+    bool pop(QStringList *files, int maxFiles, int workers, int msec = -1);
+    // The next count files pop() would return, left in the queue
+    QStringList upcoming(int count) const;
+
+    bool isClosed() const;
+    // Closed and empty
+    bool isDone() const;
+    int pushedCount() const;
+
+private:
+    const Order m_order;
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;
+    // Fifo keeps m_files; the other orders keep m_sorted, where files with
+    // equal keys stay in the order they were pushed
+    QQueue<QString> m_files;
+    std::multimap<qint64, QString> m_sorted;
+    int m_pushed;
+    bool m_closed;
+
+    int queuedCount() const;
+    QString take();
+};
+
+#endif // FILEQUEUE_H
@@ -0,0 +1,180 @@
+#include "framecodec.h"
+#include <QtEndian>
+
+#ifdef FILEMODIFIER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+// CRC-32 and size of the data, as gzip requires
+const int TrailerSize = 8;
+
+
+void writeHeader(uchar *header, quint32 memberSize, quint32 dataSize)
+{
+    header[0] = 0x1F;
+    header[1] = 0x8B;
+    header[2] = 8;      // deflate
+    header[3] = 0x04;   // FEXTRA
+    qToLittleEndian<quint32>(0, header + 4);    // no modification time
+    header[8] = 0;
+    header[9] = 255;    // unknown OS
+    qToLittleEndian<quint16>(12, header + 10);  // XLEN
+    header[12] = 'F';
+    header[13] = 'M';
+    qToLittleEndian<quint16>(8, header + 14);
+    qToLittleEndian<quint32>(memberSize, header + 16);
+    qToLittleEndian<quint32>(dataSize, header + 20);
+}
+
+} // namespace
+
+struct FrameCodec::Streams {
+#ifdef FILEMODIFIER_HAVE_ZLIB
+    z_stream deflater;
+    z_stream inflater;
+#endif
+    bool deflating = false;
+    bool inflating = false;
+};
+
+bool FrameCodec::isAvailable()
+{
+#ifdef FILEMODIFIER_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 FrameCodec::maxMemberSize()
+{
+    // zlib's compressBound(); at least deflateBound() for the raw stream
+    // compress() sets up
+    const qint64 bound = FrameSize + (FrameSize >> 12) + (FrameSize >> 14) + (FrameSize >> 25) + 13;
+    return HeaderSize + bound + TrailerSize;
+}
+
+bool FrameCodec::parseHeader(const char *header, qint64 size, qint64 *memberSize, qint64 *dataSize)
+{
+    const uchar *h = reinterpret_cast<const uchar *>(header);
+    if (size < HeaderSize || h[0] != 0x1F || h[1] != 0x8B || h[2] != 8 || h[3] != 0x04
+            || qFromLittleEndian<quint16>(h + 10) != 12 || h[12] != 'F' || h[13] != 'M'
+            || qFromLittleEndian<quint16>(h + 14) != 8) {
+        return false;
+    }
+    *memberSize = qFromLittleEndian<quint32>(h + 16);
+    *dataSize = qFromLittleEndian<quint32>(h + 20);
+    return *memberSize >= HeaderSize + TrailerSize && *memberSize <= maxMemberSize()
+            && *dataSize <= FrameSize;
+}
+
+FrameCodec::FrameCodec(int level)
+    : m_streams(new Streams)
+    , m_level(qBound(1, level, 9))
+{
+}
+
+FrameCodec::~FrameCodec()
+{
+#ifdef FILEMODIFIER_HAVE_ZLIB
+    if (m_streams->deflating) {
+        deflateEnd(&m_streams->deflater);
+    }
+    if (m_streams->inflating) {
+        inflateEnd(&m_streams->inflater);
+    }
+#endif
+    delete m_streams;
+}
+
+bool FrameCodec::compress(const char *data, qint64 size, QByteArray *member)
+{
+#ifdef FILEMODIFIER_HAVE_ZLIB
+    if (size < 0 || size > FrameSize) {
+        return false;
+    }
+
+    // Raw deflate; the gzip header and trailer are written here, because
+    // the header has to hold the compressed size
+    z_stream &stream = m_streams->deflater;
+    if (!m_streams->deflating) {
+        stream = z_stream();
+        if (deflateInit2(&stream, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        m_streams->deflating = true;
+    } else if (deflateReset(&stream) != Z_OK) {
+        return false;
+    }
+
+    const qint64 bound = qint64(deflateBound(&stream, uLong(size)));
+    member->resize(int(HeaderSize + bound + TrailerSize));
+    uchar *out = reinterpret_cast<uchar *>(member->data());
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = uInt(size);
+    stream.next_out = out + HeaderSize;
+    stream.avail_out = uInt(bound);
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        return false;
+    }
+
+    const qint64 compressed = qint64(stream.total_out);
+    const qint64 memberSize = HeaderSize + compressed + TrailerSize;
+    writeHeader(out, quint32(memberSize), quint32(size));
+    const uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data), uInt(size));
+    qToLittleEndian<quint32>(quint32(crc), out + HeaderSize + compressed);
+    qToLittleEndian<quint32>(quint32(size), out + HeaderSize + compressed + 4);
+    member->resize(int(memberSize));
+    return true;
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(size)
+    Q_UNUSED(member)
+    return false;
+#endif
+}
+
+bool FrameCodec::decompress(const char *member, qint64 memberSize, char *data, qint64 dataSize)
+{
+#ifdef FILEMODIFIER_HAVE_ZLIB
+    if (memberSize < HeaderSize + TrailerSize || memberSize > maxMemberSize() || dataSize < 0
+            || dataSize > FrameSize) {
+        return false;
+    }
+
+    z_stream &stream = m_streams->inflater;
+    if (!m_streams->inflating) {
+        stream = z_stream();
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            return false;
+        }
+        m_streams->inflating = true;
+    } else if (inflateReset(&stream) != Z_OK) {
+        return false;
+    }
+
+    // An empty frame still needs somewhere to point
+    char empty;
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(member + HeaderSize));
+    stream.avail_in = uInt(memberSize - HeaderSize - TrailerSize);
+    stream.next_out = reinterpret_cast<Bytef *>(dataSize > 0 ? data : &empty);
+    stream.avail_out = uInt(dataSize);
+    if (inflate(&stream, Z_FINISH) != Z_STREAM_END || qint64(stream.total_out) != dataSize) {
+        return false;
+    }
+
+    const uchar *trailer = reinterpret_cast<const uchar *>(member + memberSize - TrailerSize);
+    const uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data), uInt(dataSize));
+    return qFromLittleEndian<quint32>(trailer) == quint32(crc)
+            && qFromLittleEndian<quint32>(trailer + 4) == quint32(dataSize);
+#else
+    Q_UNUSED(member)
+    Q_UNUSED(memberSize)
+    Q_UNUSED(data)
+    Q_UNUSED(dataSize)
+    return false;
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+// Compression of outputs in independent frames. Every frame is a complete
+// gzip member, so a compressed output is an ordinary multi-member .gz file
+// that gzip and zcat read as a whole. The header of each member carries an
+// extra field ("FM") with the sizes of the member and of its data: a
+// reader can find every frame from the headers alone, and frames can be
+// compressed and decompressed on several threads at once.
+//
+// Needs zlib; without it (FILEMODIFIER_HAVE_ZLIB undefined) isAvailable()
+// is false and every operation fails.
+class FrameCodec
+{
+public:
+    // Fixed size of the member header written by compress()
+    static const int HeaderSize = 24;
+    // Data per frame; large enough for a good ratio, small enough to keep
+    // every core busy on a file of a few megabytes. Longer frames are
+    // neither written nor accepted.
+    static const int FrameSize = 1024 * 1024;
+    // Largest member a frame of FrameSize bytes can compress to
+    static qint64 maxMemberSize();
+
+    static bool isAvailable();
+    static const char *suffix() { return ".gz"; }
+
+    // Reads the sizes from a member header; false if header does not start
+    // a member written by compress() or claims sizes no frame can have
+    static bool parseHeader(const char *header, qint64 size, qint64 *memberSize, qint64 *dataSize);
+
+    // Level 1 (fastest) to 9 (smallest). The deflate state is kept between
+    // frames, so a codec should be reused for the frames of one thread.
+    explicit FrameCodec(int level = 6);
+    ~FrameCodec();
+
+    // Replaces member with the gzip member holding data
+    bool compress(const char *data, qint64 size, QByteArray *member);
+    // Unpacks a whole member into data, which must hold the dataSize given
+    // by its header; the gzip CRC and size are checked
+    bool decompress(const char *member, qint64 memberSize, char *data, qint64 dataSize);
+
+private:
+    struct Streams;
+    Streams *m_streams;
+    int m_level;
+
+    Q_DISABLE_COPY(FrameCodec)
+};
+
+#endif // FRAMECODEC_H
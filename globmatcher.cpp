@@ -0,0 +1,128 @@
+#include "globmatcher.h"
+#include <QFile>
+#include <QStringList>
+
+namespace {
+
+inline char foldCase(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+} // namespace
+
+GlobMatcher::GlobMatcher()
+{
+}
+
+GlobMatcher::GlobMatcher(const QString &masks)
+{
+    const QStringList parts = masks.split(';', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        const QByteArray mask = QFile::encodeName(part.trimmed()).toLower();
+        if (mask.isEmpty()) {
+            continue;
+        }
+
+        // Most masks are "*", "*.ext" or "name*"; these avoid the generic matcher
+        Pattern pattern;
+        const int stars = mask.count('*');
+        const bool questions = mask.contains('?');
+        if (mask == "*") {
+            pattern.kind = Any;
+        } else if (stars == 0 && !questions) {
+            pattern.kind = Literal;
+            pattern.text = mask;
+        } else if (stars == 1 && !questions && mask.startsWith('*')) {
+            pattern.kind = Suffix;
+            pattern.text = mask.mid(1);
+        } else if (stars == 1 && !questions && mask.endsWith('*')) {
+            pattern.kind = Prefix;
+            pattern.text = mask.left(mask.size() - 1);
+        } else {
+            pattern.kind = Generic;
+            pattern.text = mask;
+        }
+        m_patterns.append(pattern);
+    }
+}
+
+bool GlobMatcher::equalsFolded(const char *name, const char *pattern, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        if (foldCase(name[i]) != pattern[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GlobMatcher::matchGeneric(const QByteArray &pattern, const char *name, int length)
+{
+    // Iterative matching with a single backtrack point: on a mismatch the
+    // last '*' absorbs one more character. Linear for masks with one '*',
+    // never exponential.
+    const char *p = pattern.constData();
+    const int patternLength = pattern.size();
+    int pi = 0;
+    int ni = 0;
+    int starPattern = -1;
+    int starName = 0;
+
+    while (ni < length) {
+        if (pi < patternLength && (p[pi] == '?' || p[pi] == foldCase(name[ni]))) {
+            ++pi;
+            ++ni;
+        } else if (pi < patternLength && p[pi] == '*') {
+            starPattern = pi++;
+            starName = ni;
+        } else if (starPattern >= 0) {
+            pi = starPattern + 1;
+            ni = ++starName;
+        } else {
+            return false;
+        }
+    }
+    while (pi < patternLength && p[pi] == '*') {
+        ++pi;
+    }
+    return pi == patternLength;
+}
+
+bool GlobMatcher::matches(const char *name, int length) const
+{
+    for (const Pattern &pattern : m_patterns) {
+        const int size = pattern.text.size();
+        switch (pattern.kind) {
+        case Any:
+            return true;
+        case Literal:
+            if (length == size && equalsFolded(name, pattern.text.constData(), size)) {
+                return true;
+            }
+            break;
+        case Suffix:
+            if (length >= size && equalsFolded(name + length - size, pattern.text.constData(), size)) {
+                return true;
+            }
+            break;
+        case Prefix:
+            if (length >= size && equalsFolded(name, pattern.text.constData(), size)) {
+                return true;
+            }
+            break;
+        case Generic:
+            if (matchGeneric(pattern.text, name, length)) {
+                return true;
+            }
+            break;
+        }
+    }
+    return false;
+}
+
+bool GlobMatcher::matches(const QString &fileName) const
+{
+    const QByteArray name = QFile::encodeName(fileName);
+    return matches(name.constData(), name.size());
+}
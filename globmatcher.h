@@ -0,0 +1,43 @@
+#ifndef GLOBMATCHER_H
+#define GLOBMATCHER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// File name mask such as "*.bin;*.dat", compiled once. '*' matches any run of
+// characters, '?' a single character; ';' separates alternatives. Matching is
+// case-insensitive for ASCII and works on the encoded file name, so directory
+// scanners can test raw entry names without converting them to QString.
+class GlobMatcher
+{
+public:
+    GlobMatcher();
+    explicit GlobMatcher(const QString &masks);
+
+    bool isEmpty() const { return m_patterns.isEmpty(); }
+
+    bool matches(const char *name, int length) const;
+    bool matches(const QString &fileName) const;
+
+private:
+    enum Kind {
+        Any,        // "*"
+        Literal,    // no wildcards
+        Prefix,     // "abc*"
+        Suffix,     // "*.abc"
+        Generic
+    };
+
+    struct Pattern {
+        Kind kind;
+        QByteArray text;    // lower-case; without the '*' for Prefix/Suffix
+    };
+
+    QList<Pattern> m_patterns;
+
+    static bool equalsFolded(const char *name, const char *pattern, int length);
+    static bool matchGeneric(const QByteArray &pattern, const char *name, int length);
+};
+
+#endif // GLOBMATCHER_H
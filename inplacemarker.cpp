@@ -0,0 +1,208 @@
+#include "inplacemarker.h"
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MarkerSuffix[] = ".fmpart";
+const char MarkerMagic[] = "FMXOR1";
+
+// Records are rewritten in place at a fixed size, so a shorter line never
+// leaves stale characters behind
+const int RecordSize = 160;
+
+// Short writes to regular files stop at page boundaries
+const qint64 PageSize = 4096;
+
+quint64 fileIdentity(const QFile &file)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (fstat(file.handle(), &st) == 0) {
+        return quint64(st.st_ino);
+    }
+#else
+    Q_UNUSED(file)
+#endif
+    return 0;
+}
+
+// A marker left behind for a different file with the same name is stale
+bool belongsTo(const QList<QByteArray> &fields, quint64 fileId, qint64 fileSize)
+{
+    return fields.size() == 8 && fields.at(0) == MarkerMagic
+            && fields.at(2).toULongLong(nullptr, 16) == fileId && fields.at(3).toLongLong() == fileSize;
+}
+
+} // namespace
+
+InPlaceMarker::InPlaceMarker(const QString &file)
+    : m_marker(markerPath(file))
+    , m_key(0)
+    , m_fileId(0)
+    , m_fileSize(0)
+{
+}
+
+InPlaceMarker::~InPlaceMarker()
+{
+    m_marker.close();
+}
+
+QString InPlaceMarker::markerPath(const QString &file)
+{
+    return file + MarkerSuffix;
+}
+
+bool InPlaceMarker::isMarkerFile(const QString &fileName)
+{
+    return fileName.endsWith(MarkerSuffix);
+}
+
+quint64 InPlaceMarker::hash(const char *data, qint64 size)
+{
+    return quint64(qHashBits(data, size_t(size), 0x9E3779B9u));
+}
+
+bool InPlaceMarker::isPending(const QString &file)
+{
+    QFile marker(markerPath(file));
+    if (!marker.exists()) {
+        return false;
+    }
+    QFile data(file);
+    if (!marker.open(QIODevice::ReadOnly) || !data.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return belongsTo(marker.read(RecordSize).trimmed().split(' '), fileIdentity(data), data.size());
+}
+
+bool InPlaceMarker::syncData(QFile &file)
+{
+#if defined(Q_OS_LINUX)
+    return ::fdatasync(file.handle()) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file.handle()) == 0;
+#else
+    Q_UNUSED(file)
+    return true;
+#endif
+}
+
+bool InPlaceMarker::open(QFile &file, const TransformChain &transform, qint64 *committed)
+{
+    m_key = transform.fingerprint();
+    m_undo = transform.inverse();
+    m_fileId = fileIdentity(file);
+    m_fileSize = file.size();
+    *committed = 0;
+
+    const bool existed = m_marker.exists();
+    if (!m_marker.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        m_errorString = m_marker.errorString();
+        return false;
+    }
+
+    if (existed) {
+        const QList<QByteArray> fields = m_marker.read(RecordSize).trimmed().split(' ');
+        if (belongsTo(fields, m_fileId, m_fileSize)) {
+            if (fields.at(1).toULongLong(nullptr, 16) != m_key) {
+                m_errorString = "файл частично обработан другим преобразованием";
+                return false;
+            }
+
+            qint64 done = fields.at(4).toLongLong();
+            const qint64 pendingLength = fields.at(5).toLongLong();
+            if (pendingLength > 0) {
+                qint64 transformedLength = 0;
+                if (!recoverChunk(file, done, pendingLength, fields.at(6).toULongLong(nullptr, 16),
+                                  fields.at(7).toULongLong(nullptr, 16), &transformedLength)) {
+                    return false;
+                }
+                done += transformedLength;
+            }
+            *committed = done;
+        }
+    }
+
+    return write(*committed, 0, 0, 0);
+}
+
+bool InPlaceMarker::recoverChunk(QFile &file, qint64 offset, qint64 length, quint64 originalHash,
+                                 quint64 transformedHash, qint64 *transformedLength)
+{
+    QByteArray chunk(int(length), Qt::Uninitialized);
+    if (!file.seek(offset) || file.read(chunk.data(), length) != length) {
+        m_errorString = file.errorString();
+        return false;
+    }
+
+    const quint64 current = hash(chunk.constData(), length);
+    if (current == transformedHash) {
+        *transformedLength = length;
+        return true;
+    }
+    if (current == originalHash) {
+        *transformedLength = 0;
+        return true;
+    }
+
+    // A torn write left a transformed prefix: undo it page by page until the
+    // chunk hashes back to its original contents
+    qint64 split = 0;
+    while (split < length) {
+        const qint64 next = qMin(length, (offset + split) / PageSize * PageSize + PageSize - offset);
+        m_undo.apply(chunk.data() + split, next - split, offset + split);
+        split = next;
+        if (hash(chunk.constData(), length) == originalHash) {
+            *transformedLength = split;
+            return true;
+        }
+    }
+
+    m_errorString = "не удалось определить состояние прерванного фрагмента";
+    return false;
+}
+
+bool InPlaceMarker::beginChunk(qint64 offset, qint64 length, quint64 originalHash, quint64 transformedHash)
+{
+    return write(offset, length, originalHash, transformedHash);
+}
+
+bool InPlaceMarker::finish()
+{
+    return write(m_fileSize, 0, 0, 0);
+}
+
+void InPlaceMarker::remove()
+{
+    m_marker.close();
+    m_marker.remove();
+}
+
+bool InPlaceMarker::write(qint64 committed, qint64 pendingLength, quint64 originalHash, quint64 transformedHash)
+{
+    QByteArray record = QByteArray(MarkerMagic)
+            + ' ' + QByteArray::number(m_key, 16)
+            + ' ' + QByteArray::number(m_fileId, 16)
+            + ' ' + QByteArray::number(m_fileSize)
+            + ' ' + QByteArray::number(committed)
+            + ' ' + QByteArray::number(pendingLength)
+            + ' ' + QByteArray::number(originalHash, 16)
+            + ' ' + QByteArray::number(transformedHash, 16);
+    record = record.leftJustified(RecordSize - 1, ' ') + '\n';
+
+    // One small write at offset 0 is never seen half-done by a later run;
+    // the sync keeps it ahead of the data write that follows
+    if (!m_marker.seek(0) || m_marker.write(record) != record.size() || !syncData(m_marker)) {
+        m_errorString = m_marker.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef INPLACEMARKER_H
+#define INPLACEMARKER_H
+
+#include <QString>
+#include <QFile>
+#include "transformchain.h"
+
+// Progress record kept next to a file that is being transformed in place
+// ("<file>.fmpart"). Applying a transform twice silently corrupts the bytes
+// (for XOR it restores them); the marker tells an interrupted run exactly
+// which bytes are already transformed. Before each chunk is written back the
+// marker stores the chunk range together with hashes of its original and
+// transformed contents, which lets recovery classify the chunk afterwards,
+// including a write that was cut short at a page boundary. Every record is
+// synced before the caller goes on, and the caller syncs the data of a chunk
+// before the next record moves past it, so that after a power loss the
+// marker is never behind or ahead of the file.
+class InPlaceMarker
+{
+public:
+    explicit InPlaceMarker(const QString &file);
+    ~InPlaceMarker();
+
+    static QString markerPath(const QString &file);
+    static bool isMarkerFile(const QString &fileName);
+    static quint64 hash(const char *data, qint64 size);
+    // True if file has a marker that belongs to it, i.e. it is partly
+    // transformed and only an in-place run can continue it
+    static bool isPending(const QString &file);
+    // Makes the written data of file durable
+    static bool syncData(QFile &file);
+
+    // Opens or creates the marker for file (open for reading and writing) and
+    // returns in committed how many leading bytes are already transformed.
+    // Returns false if that cannot be determined safely, or if the file was
+    // partly transformed by a different chain.
+    bool open(QFile &file, const TransformChain &transform, qint64 *committed);
+
+    bool beginChunk(qint64 offset, qint64 length, quint64 originalHash, quint64 transformedHash);
+    bool finish();
+    void remove();
+
+    QString errorString() const { return m_errorString; }
+
+private:
+    QFile m_marker;
+    quint64 m_key;
+    TransformChain m_undo;
+    quint64 m_fileId;
+    qint64 m_fileSize;
+    QString m_errorString;
+
+    bool write(qint64 committed, qint64 pendingLength, quint64 originalHash, quint64 transformedHash);
+    bool recoverChunk(QFile &file, qint64 offset, qint64 length, quint64 originalHash,
+                      quint64 transformedHash, qint64 *transformedLength);
+};
+
+#endif // INPLACEMARKER_H
@@ -0,0 +1,142 @@
+#include "integritymanifest.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QByteArrayList>
+#include <QMutexLocker>
+
+namespace {
+
+const char ManifestSuffix[] = ".fmmanifest";
+const char Header[] = "# FileModifier manifest 1: size, crc32c of input, crc32c of output, microseconds, output, input\n";
+
+QByteArray digestField(bool present, quint32 digest)
+{
+    return present ? QByteArray::number(digest, 16).rightJustified(8, '0') : QByteArray("-");
+}
+
+bool parseDigest(const QByteArray &field, quint32 *digest)
+{
+    if (field == "-") {
+        return false;
+    }
+    bool ok = false;
+    *digest = field.toUInt(&ok, 16);
+    return ok;
+}
+
+} // namespace
+
+IntegrityManifest::IntegrityManifest(const QString &fileName)
+    : m_file(fileName)
+    , m_count(0)
+    , m_failed(false)
+{
+}
+
+IntegrityManifest::~IntegrityManifest()
+{
+    close();
+}
+
+QString IntegrityManifest::defaultPath(const QString &outputPath)
+{
+    return QDir(outputPath).absoluteFilePath(QString("filemodifier-%1%2")
+                                             .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"))
+                                             .arg(ManifestSuffix));
+}
+
+bool IntegrityManifest::isManifestFile(const QString &fileName)
+{
+    return fileName.endsWith(ManifestSuffix);
+}
+
+bool IntegrityManifest::add(const Entry &entry)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_failed) {
+        return false;
+    }
+    if (!m_file.isOpen()) {
+        const bool created = !m_file.exists();
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append) || (created && m_file.write(Header) < 0)) {
+            m_errorString = m_file.errorString();
+            m_failed = true;
+            return false;
+        }
+    }
+
+    const QString output = QFileInfo(m_file.fileName()).absoluteDir().relativeFilePath(entry.output);
+    const QByteArray line = QByteArray::number(entry.size) + '\t'
+            + digestField(entry.coverage & Input, entry.digests.input) + '\t'
+            + digestField(entry.coverage & Output, entry.digests.output) + '\t'
+            + QByteArray::number(entry.nsecs / 1000) + '\t'
+            + output.toUtf8().toPercentEncoding("/") + '\t'
+            + entry.input.toUtf8().toPercentEncoding("/") + '\n';
+    if (m_file.write(line) != line.size()) {
+        m_errorString = m_file.errorString();
+        m_failed = true;
+        return false;
+    }
+    ++m_count;
+    return true;
+}
+
+bool IntegrityManifest::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return !m_failed;
+    }
+    if (!m_file.flush()) {
+        m_errorString = m_file.errorString();
+        m_failed = true;
+    }
+    m_file.close();
+    return !m_failed;
+}
+
+bool IntegrityManifest::load(const QString &fileName, QList<Entry> *entries, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    const QDir directory = QFileInfo(fileName).absoluteDir();
+    const QByteArrayList lines = file.readAll().split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        const QByteArray &line = lines.at(i);
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        const QByteArrayList fields = line.split('\t');
+        Entry entry;
+        bool sizeOk = false;
+        bool timeOk = false;
+        if (fields.size() == 6) {
+            entry.size = fields.at(0).toLongLong(&sizeOk);
+            entry.nsecs = fields.at(3).toLongLong(&timeOk) * 1000;
+        }
+        if (!sizeOk || !timeOk) {
+            *error = QString("строка %1 повреждена").arg(i + 1);
+            return false;
+        }
+
+        int coverage = None;
+        if (parseDigest(fields.at(1), &entry.digests.input)) {
+            coverage |= Input;
+        }
+        if (parseDigest(fields.at(2), &entry.digests.output)) {
+            coverage |= Output;
+        }
+        entry.coverage = Coverage(coverage);
+        entry.output = QDir::cleanPath(directory.absoluteFilePath(
+                QString::fromUtf8(QByteArray::fromPercentEncoding(fields.at(4)))));
+        entry.input = QString::fromUtf8(QByteArray::fromPercentEncoding(fields.at(5)));
+        entries->append(entry);
+    }
+    return true;
+}
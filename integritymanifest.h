@@ -0,0 +1,72 @@
+#ifndef INTEGRITYMANIFEST_H
+#define INTEGRITYMANIFEST_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <QMutex>
+
+// List of the outputs of a run with their size, CRC-32C and processing time.
+// The checksums are taken from the buffers as the data streams through the
+// processor, so writing the manifest costs no extra reads; verifying against
+// it later reads each output once.
+//
+// A text file, one output per line:
+//   <size> <crc32c of input> <crc32c of output> <microseconds> <output> <input>
+// separated by tabs, checksums in hex or "-" when not computed, paths
+// percent-encoded and the output relative to the manifest's directory.
+// Lines starting with '#' are comments.
+class IntegrityManifest
+{
+public:
+    enum Coverage {
+        None = 0,
+        Input = 1,
+        Output = 2,
+        Both = Input | Output
+    };
+
+    struct Digests {
+        quint32 input = 0;
+        quint32 output = 0;
+    };
+
+    struct Entry {
+        QString output;     // absolute
+        QString input;
+        qint64 size = 0;
+        Coverage coverage = None;
+        Digests digests;
+        qint64 nsecs = 0;
+    };
+
+    explicit IntegrityManifest(const QString &fileName);
+    ~IntegrityManifest();
+
+    // A new name per run in outputPath: "filemodifier-<date>-<time>.fmmanifest"
+    static QString defaultPath(const QString &outputPath);
+    static bool isManifestFile(const QString &fileName);
+
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_errorString; }
+    int count() const { return m_count; }
+
+    // Safe to call from several threads. The file is created with the first
+    // entry, so a run that writes nothing leaves no manifest; an existing
+    // manifest is appended to.
+    bool add(const Entry &entry);
+    bool close();
+
+    // Entries of a manifest with their output paths made absolute
+    static bool load(const QString &fileName, QList<Entry> *entries, QString *error);
+
+private:
+    QFile m_file;
+    QMutex m_mutex;
+    int m_count;
+    QString m_errorString;
+    bool m_failed;
+};
+
+#endif // INTEGRITYMANIFEST_H
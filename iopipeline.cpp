@@ -0,0 +1,677 @@
+#include "iopipeline.h"
+#include "processingmetrics.h"
+#include "processingcontrol.h"
+#include "throttle.h"
+#include <QFile>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutexLocker>
+#include <QVector>
+#include <cstring>
+#include <limits>
+
+#if defined(Q_OS_LINUX) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define IOPIPELINE_HAVE_IO_URING
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#    include <cerrno>
+#  endif
+#endif
+
+namespace {
+
+// Buffers are page aligned so they can also serve unbuffered/direct I/O
+const size_t BufferAlignment = 4096;
+
+#ifdef IOPIPELINE_HAVE_IO_URING
+
+// Minimal io_uring wrapper on the raw syscalls, so that no liburing is needed
+class Ring
+{
+public:
+    Ring()
+        : m_fd(-1)
+        , m_sqRing(MAP_FAILED)
+        , m_cqRing(MAP_FAILED)
+        , m_sqes(MAP_FAILED)
+        , m_sqRingSize(0)
+        , m_cqRingSize(0)
+        , m_sqesSize(0)
+        , m_sqEntries(0)
+        , m_sqLocalTail(0)
+        , m_pending(0)
+    {
+    }
+
+    ~Ring()
+    {
+        if (m_sqes != MAP_FAILED) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing != MAP_FAILED) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    bool init(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            return false;
+        }
+
+        // IORING_OP_READ/WRITE arrived in the same kernel (5.6) as this flag
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            return false;
+        }
+
+        m_sqEntries = params.sq_entries;
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) {
+            m_sqRingSize = m_cqRingSize = qMax(m_sqRingSize, m_cqRingSize);
+        }
+
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            return false;
+        }
+        if (singleMmap) {
+            m_cqRing = m_sqRing;
+        } else {
+            m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            m_fd, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED) {
+                return false;
+            }
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_fd, IORING_OFF_SQES);
+        if (m_sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char *sq = static_cast<char *>(m_sqRing);
+        m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        m_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+        char *cq = static_cast<char *>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        m_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        m_sqLocalTail = *m_sqTail;
+        return true;
+    }
+
+    io_uring_sqe *nextSqe()
+    {
+        const unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqLocalTail - head >= m_sqEntries) {
+            return nullptr;
+        }
+        const unsigned index = m_sqLocalTail & *m_sqMask;
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(m_sqes) + index;
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        ++m_sqLocalTail;
+        ++m_pending;
+        return sqe;
+    }
+
+    // Submits queued entries and waits until at least waitFor completions are available
+    int submitAndWait(unsigned waitFor)
+    {
+        __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+        for (;;) {
+            const int rc = int(syscall(__NR_io_uring_enter, m_fd, m_pending, waitFor,
+                                       waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (rc >= 0) {
+                m_pending -= unsigned(rc);
+                return rc;
+            }
+            if (errno != EINTR) {
+                return -errno;
+            }
+        }
+    }
+
+    bool popCompletion(io_uring_cqe *cqe)
+    {
+        const unsigned head = *m_cqHead;
+        if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        *cqe = m_cqes[head & *m_cqMask];
+        __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int m_fd;
+    void *m_sqRing;
+    void *m_cqRing;
+    void *m_sqes;
+    size_t m_sqRingSize;
+    size_t m_cqRingSize;
+    size_t m_sqesSize;
+    unsigned m_sqEntries;
+    unsigned m_sqLocalTail;
+    unsigned m_pending;
+    unsigned *m_sqHead;
+    unsigned *m_sqTail;
+    unsigned *m_sqMask;
+    unsigned *m_sqArray;
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned *m_cqMask;
+    io_uring_cqe *m_cqes;
+};
+
+#endif // IOPIPELINE_HAVE_IO_URING
+
+} // namespace
+
+IoPipeline::IoPipeline(int bufferSize, int queueDepth, Backend backend)
+    : m_bufferSize(qMax(bufferSize, 4096))
+    , m_queueDepth(qMax(queueDepth, 1))
+    , m_backend(backend)
+    , m_metrics(nullptr)
+    , m_readThrottle(nullptr)
+    , m_writeThrottle(nullptr)
+    , m_writtenOffset(0)
+    , m_reader(nullptr)
+    , m_writer(nullptr)
+    , m_input(nullptr)
+    , m_output(nullptr)
+    , m_generation(0)
+    , m_shutdown(false)
+    , m_failed(false)
+    , m_abort(false)
+    , m_readerDone(true)
+    , m_writerDone(true)
+{
+    for (int i = 0; i < m_queueDepth; ++i) {
+        m_buffers.append(static_cast<char *>(qMallocAligned(size_t(m_bufferSize), BufferAlignment)));
+    }
+}
+
+IoPipeline::~IoPipeline()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_shutdown = true;
+        m_changed.wakeAll();
+    }
+    if (m_reader) {
+        m_reader->wait();
+        delete m_reader;
+    }
+    if (m_writer) {
+        m_writer->wait();
+        delete m_writer;
+    }
+    for (char *buffer : m_buffers) {
+        qFreeAligned(buffer);
+    }
+}
+
+bool IoPipeline::isIoUringAvailable()
+{
+#ifdef IOPIPELINE_HAVE_IO_URING
+    // Seccomp profiles and kernel.io_uring_disabled may block it at runtime
+    static const bool available = Ring().init(4);
+    return available;
+#else
+    return false;
+#endif
+}
+
+const char *IoPipeline::backendName(Backend backend)
+{
+    switch (backend) {
+    case Threads:
+        return "threads";
+    case IoUring:
+        return "io_uring";
+    default:
+        return "auto";
+    }
+}
+
+bool IoPipeline::run(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control)
+{
+    m_errorString.clear();
+    m_writtenOffset.storeRelease(0);
+
+    for (char *buffer : m_buffers) {
+        if (!buffer) {
+            m_errorString = "Не удалось выделить буферы";
+            return false;
+        }
+    }
+
+    // Nothing to overlap for a single chunk
+    if (m_queueDepth < 2 || input.size() <= m_bufferSize) {
+        return runDirect(input, output, transform, control);
+    }
+
+#ifdef IOPIPELINE_HAVE_IO_URING
+    if (m_backend != Threads && isIoUringAvailable()) {
+        return runIoUring(input, output, transform, control);
+    }
+#endif
+    return runThreads(input, output, transform, control);
+}
+
+bool IoPipeline::runDirect(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control)
+{
+    char *buffer = m_buffers.first();
+    qint64 offset = 0;
+    QElapsedTimer timer;
+
+    for (;;) {
+        // Nothing is in flight between chunks, so a pause holds no data
+        if (!control->checkpoint()) {
+            return false;
+        }
+        timer.start();
+        const qint64 bytesRead = input.read(buffer, m_bufferSize);
+        if (bytesRead < 0) {
+            m_errorString = input.errorString();
+            return false;
+        }
+        if (bytesRead == 0) {
+            return true;
+        }
+        if (m_metrics) {
+            m_metrics->record(ProcessingMetrics::Read, timer.nsecsElapsed(), bytesRead);
+        }
+        if (m_readThrottle) {
+            m_readThrottle->acquire(bytesRead);
+        }
+
+        transform(buffer, bytesRead, offset);
+        offset += bytesRead;
+
+        if (m_writeThrottle) {
+            m_writeThrottle->acquire(bytesRead);
+        }
+        timer.start();
+        if (output.write(buffer, bytesRead) != bytesRead) {
+            m_errorString = output.errorString();
+            return false;
+        }
+        if (m_metrics) {
+            m_metrics->record(ProcessingMetrics::Write, timer.nsecsElapsed(), bytesRead);
+        }
+        m_writtenOffset.storeRelease(offset);
+    }
+}
+
+void IoPipeline::startThreads()
+{
+    if (m_reader) {
+        return;
+    }
+    m_reader = QThread::create([this]() { readerLoop(); });
+    m_writer = QThread::create([this]() { writerLoop(); });
+    m_reader->start();
+    m_writer->start();
+}
+
+bool IoPipeline::runThreads(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control)
+{
+    startThreads();
+
+    QMutexLocker locker(&m_mutex);
+    m_input = &input;
+    m_output = &output;
+    m_failed = false;
+    m_abort = false;
+    m_readerDone = false;
+    m_writerDone = false;
+    m_freeChunks.clear();
+    m_readChunks.clear();
+    m_writeChunks.clear();
+    for (char *buffer : m_buffers) {
+        m_freeChunks.append(Chunk{buffer, 0, 0});
+    }
+    ++m_generation;
+    m_changed.wakeAll();
+
+    // Chunks arrive from the reader in file order; a zero-sized chunk marks
+    // the end of the input and is passed on so the writer stops as well
+    for (;;) {
+        while (m_readChunks.isEmpty() && !m_abort) {
+            m_changed.wait(&m_mutex);
+        }
+        if (m_abort) {
+            break;
+        }
+
+        Chunk chunk = m_readChunks.takeFirst();
+        if (chunk.size > 0) {
+            // A pause waits here without holding up the helper threads
+            locker.unlock();
+            const bool proceed = control->checkpoint();
+            if (proceed) {
+                transform(chunk.data, chunk.size, chunk.offset);
+            }
+            locker.relock();
+            if (!proceed) {
+                m_abort = true;
+                m_changed.wakeAll();
+                break;
+            }
+        }
+
+        m_writeChunks.append(chunk);
+        m_changed.wakeAll();
+        if (chunk.size == 0) {
+            break;
+        }
+    }
+
+    while (!m_readerDone || !m_writerDone) {
+        m_changed.wait(&m_mutex);
+    }
+    m_input = nullptr;
+    m_output = nullptr;
+
+    return !m_failed && !m_abort;
+}
+
+void IoPipeline::readerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    quint64 generation = 0;
+
+    for (;;) {
+        while (!m_shutdown && m_generation == generation) {
+            m_changed.wait(&m_mutex);
+        }
+        if (m_shutdown) {
+            return;
+        }
+        generation = m_generation;
+
+        qint64 offset = 0;
+        for (;;) {
+            while (m_freeChunks.isEmpty() && !m_abort) {
+                m_changed.wait(&m_mutex);
+            }
+            if (m_abort) {
+                break;
+            }
+
+            Chunk chunk = m_freeChunks.takeFirst();
+            locker.unlock();
+            QElapsedTimer timer;
+            timer.start();
+            const qint64 bytesRead = m_input->read(chunk.data, m_bufferSize);
+            if (m_metrics && bytesRead > 0) {
+                m_metrics->record(ProcessingMetrics::Read, timer.nsecsElapsed(), bytesRead);
+            }
+            // Charged after the read, whose size is only known then; the
+            // wait holds back the next one
+            if (m_readThrottle && bytesRead > 0) {
+                m_readThrottle->acquire(bytesRead);
+            }
+            locker.relock();
+
+            if (bytesRead < 0) {
+                m_errorString = m_input->errorString();
+                m_failed = true;
+                m_abort = true;
+                m_changed.wakeAll();
+                break;
+            }
+
+            chunk.size = bytesRead;
+            chunk.offset = offset;
+            offset += bytesRead;
+            m_readChunks.append(chunk);
+            m_changed.wakeAll();
+            if (bytesRead == 0) {
+                break;
+            }
+        }
+
+        m_readerDone = true;
+        m_changed.wakeAll();
+    }
+}
+
+void IoPipeline::writerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    quint64 generation = 0;
+
+    for (;;) {
+        while (!m_shutdown && m_generation == generation) {
+            m_changed.wait(&m_mutex);
+        }
+        if (m_shutdown) {
+            return;
+        }
+        generation = m_generation;
+
+        for (;;) {
+            while (m_writeChunks.isEmpty() && !m_abort) {
+                m_changed.wait(&m_mutex);
+            }
+            if (m_abort) {
+                break;
+            }
+
+            Chunk chunk = m_writeChunks.takeFirst();
+            if (chunk.size == 0) {
+                break;
+            }
+
+            locker.unlock();
+            if (m_writeThrottle) {
+                m_writeThrottle->acquire(chunk.size);
+            }
+            QElapsedTimer timer;
+            timer.start();
+            const bool written = m_output->write(chunk.data, chunk.size) == chunk.size;
+            if (m_metrics && written) {
+                m_metrics->record(ProcessingMetrics::Write, timer.nsecsElapsed(), chunk.size);
+            }
+            locker.relock();
+
+            if (!written) {
+                m_errorString = m_output->errorString();
+                m_failed = true;
+                m_abort = true;
+                m_changed.wakeAll();
+                break;
+            }
+
+            // Chunks are written one after another, in file order
+            m_writtenOffset.storeRelease(chunk.offset + chunk.size);
+            m_freeChunks.append(chunk);
+            m_changed.wakeAll();
+        }
+
+        m_writerDone = true;
+        m_changed.wakeAll();
+    }
+}
+
+bool IoPipeline::runIoUring(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control)
+{
+#ifdef IOPIPELINE_HAVE_IO_URING
+    Ring ring;
+    if (!ring.init(unsigned(m_queueDepth))) {
+        return runThreads(input, output, transform, control);
+    }
+
+    enum SlotState { Idle, Reading, ReadDone, Writing };
+    struct Slot {
+        SlotState state;
+        qint64 offset;
+        qint64 length;
+        qint64 done;
+        qint64 startedAt;
+    };
+
+    const int inputFd = input.handle();
+    const int outputFd = output.handle();
+    // Positional I/O bypasses QFile, so start from its current positions
+    const qint64 inputBase = input.pos();
+    const qint64 outputBase = output.pos();
+    const qint64 size = input.size() - inputBase;
+
+    QVector<Slot> ringSlots(m_queueDepth);
+    qint64 nextReadOffset = 0;
+    qint64 nextTransformOffset = 0;
+    int inFlight = 0;
+    bool failed = false;
+    bool stopping = false;
+    // Start of the first write given up on a stop or an error
+    qint64 abandonedWrite = std::numeric_limits<qint64>::max();
+    // Latencies are measured from submission to completion of a whole chunk
+    QElapsedTimer clock;
+    clock.start();
+
+    auto submit = [&](int index) {
+        Slot &slot = ringSlots[index];
+        io_uring_sqe *sqe = ring.nextSqe();
+        const bool reading = slot.state == Reading;
+        sqe->opcode = reading ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->fd = reading ? inputFd : outputFd;
+        sqe->addr = quint64(quintptr(m_buffers.at(index) + slot.done));
+        sqe->len = unsigned(slot.length - slot.done);
+        sqe->off = quint64((reading ? inputBase : outputBase) + slot.offset + slot.done);
+        sqe->user_data = quint64(index);
+        ++inFlight;
+    };
+
+    auto startRead = [&](int index) {
+        if (nextReadOffset >= size || stopping || failed) {
+            ringSlots[index].state = Idle;
+            return;
+        }
+        const qint64 length = qMin<qint64>(m_bufferSize, size - nextReadOffset);
+        if (m_readThrottle) {
+            m_readThrottle->acquire(length);
+        }
+        ringSlots[index] = Slot{Reading, nextReadOffset, length, 0, clock.nsecsElapsed()};
+        nextReadOffset += ringSlots[index].length;
+        submit(index);
+    };
+
+    for (int i = 0; i < m_queueDepth; ++i) {
+        startRead(i);
+    }
+
+    while (inFlight > 0) {
+        const int rc = ring.submitAndWait(1);
+        if (rc < 0) {
+            // The ring is unusable; in-flight requests are cancelled when it closes
+            m_errorString = qt_error_string(-rc);
+            return false;
+        }
+
+        io_uring_cqe cqe;
+        while (ring.popCompletion(&cqe)) {
+            --inFlight;
+            const int index = int(cqe.user_data);
+            Slot &slot = ringSlots[index];
+
+            if (cqe.res < 0 || (cqe.res == 0 && slot.done < slot.length)) {
+                if (!failed) {
+                    m_errorString = cqe.res < 0 ? qt_error_string(-cqe.res)
+                                                : QString("Файл изменился во время обработки");
+                }
+                failed = true;
+            }
+            if (failed || stopping) {
+                if (slot.state == Writing) {
+                    abandonedWrite = qMin(abandonedWrite, slot.offset);
+                }
+                slot.state = Idle;
+                continue;
+            }
+
+            slot.done += cqe.res;
+            if (slot.done < slot.length) {
+                submit(index); // short read or write, continue where it stopped
+                continue;
+            }
+            if (m_metrics) {
+                m_metrics->record(slot.state == Reading ? ProcessingMetrics::Read : ProcessingMetrics::Write,
+                                  clock.nsecsElapsed() - slot.startedAt, slot.length);
+            }
+            if (slot.state == Reading) {
+                slot.state = ReadDone;
+            } else {
+                startRead(index);
+            }
+        }
+
+        // Everything below the lowest write still pending is on disk
+        qint64 written = qMin(nextTransformOffset, abandonedWrite);
+        for (const Slot &slot : ringSlots) {
+            if (slot.state == Writing) {
+                written = qMin(written, slot.offset);
+            }
+        }
+        m_writtenOffset.storeRelease(written);
+
+        // Transform strictly in file order, so stateful consumers see a stream
+        for (bool progressed = true; progressed && !failed && !stopping; ) {
+            progressed = false;
+            for (int i = 0; i < ringSlots.size(); ++i) {
+                Slot &slot = ringSlots[i];
+                if (slot.state != ReadDone || slot.offset != nextTransformOffset) {
+                    continue;
+                }
+                if (!control->checkpoint()) {
+                    stopping = true;
+                    break;
+                }
+                transform(m_buffers.at(i), slot.length, slot.offset);
+                nextTransformOffset += slot.length;
+                if (m_writeThrottle) {
+                    m_writeThrottle->acquire(slot.length);
+                }
+                slot.state = Writing;
+                slot.done = 0;
+                slot.startedAt = clock.nsecsElapsed();
+                submit(i);
+                progressed = true;
+            }
+        }
+    }
+
+    if (!failed && !stopping) {
+        // Keep QFile's idea of the positions in line with what was transferred
+        input.seek(inputBase + size);
+        output.seek(outputBase + size);
+    }
+    return !failed && !stopping;
+#else
+    return runThreads(input, output, transform, control);
+#endif
+}
@@ -0,0 +1,103 @@
+#ifndef IOPIPELINE_H
+#define IOPIPELINE_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <functional>
+
+class QFile;
+class QThread;
+class ProcessingMetrics;
+class ProcessingControl;
+class Throttle;
+
+// Streams a file through a ring of reusable, aligned buffers so that reading
+// chunk N+1, transforming chunk N and writing chunk N-1 overlap. The
+// transform runs on the calling thread; reads and writes are carried either
+// by two helper threads owned by the pipeline, or by io_uring on Linux.
+class IoPipeline
+{
+public:
+    enum Backend {
+        Auto,
+        Threads,
+        IoUring
+    };
+
+    // Called for every chunk, in file order; offset is the position of data[0]
+    typedef std::function<void(char *data, qint64 size, qint64 offset)> Transform;
+
+    IoPipeline(int bufferSize, int queueDepth, Backend backend);
+    ~IoPipeline();
+
+    int bufferSize() const { return m_bufferSize; }
+    int queueDepth() const { return m_queueDepth; }
+    Backend backend() const { return m_backend; }
+
+    // Read and write calls are recorded there when set
+    void setMetrics(ProcessingMetrics *metrics) { m_metrics = metrics; }
+    // Every read and write passes these bandwidth limits when set
+    void setThrottles(Throttle *read, Throttle *write) { m_readThrottle = read; m_writeThrottle = write; }
+
+    // Copies input to output through transform. Both files must be open;
+    // control is checked before every chunk is transformed, which also
+    // holds the pipeline while paused. Returns false on I/O error or when
+    // stopped, with the reason in errorString().
+    bool run(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control);
+    QString errorString() const { return m_errorString; }
+    // Length of the data, counted from where run() started, that has been
+    // written without gaps. Writes may complete out of order, so this can
+    // lag behind the transform by more than the ring; safe to call from
+    // the transform.
+    qint64 writtenOffset() const { return m_writtenOffset.loadAcquire(); }
+
+    static bool isIoUringAvailable();
+    static const char *backendName(Backend backend);
+
+private:
+    struct Chunk {
+        char *data;
+        qint64 size;
+        qint64 offset;
+    };
+
+    int m_bufferSize;
+    int m_queueDepth;
+    Backend m_backend;
+    QList<char *> m_buffers;
+    QString m_errorString;
+    ProcessingMetrics *m_metrics;
+    Throttle *m_readThrottle;
+    Throttle *m_writeThrottle;
+    QAtomicInteger<qint64> m_writtenOffset;
+
+    // Threads backend state, guarded by m_mutex
+    QMutex m_mutex;
+    QWaitCondition m_changed;
+    QThread *m_reader;
+    QThread *m_writer;
+    QFile *m_input;
+    QFile *m_output;
+    quint64 m_generation;
+    bool m_shutdown;
+    bool m_failed;
+    bool m_abort;
+    bool m_readerDone;
+    bool m_writerDone;
+    QList<Chunk> m_freeChunks;
+    QList<Chunk> m_readChunks;
+    QList<Chunk> m_writeChunks;
+
+    bool runDirect(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control);
+    bool runThreads(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control);
+    bool runIoUring(QFile &input, QFile &output, const Transform &transform, ProcessingControl *control);
+    void startThreads();
+    void readerLoop();
+    void writerLoop();
+};
+
+#endif // IOPIPELINE_H
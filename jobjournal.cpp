@@ -0,0 +1,239 @@
+#include "jobjournal.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QByteArrayList>
+#include <QMutexLocker>
+
+namespace {
+
+const char JournalName[] = ".filemodifier.fmjournal";
+
+QByteArray encodePath(const QString &path)
+{
+    return path.toUtf8().toPercentEncoding("/");
+}
+
+QString decodePath(const QByteArray &field)
+{
+    return QString::fromUtf8(QByteArray::fromPercentEncoding(field));
+}
+
+bool parseKey(const QByteArrayList &fields, int first, ScanIndex::FileKey *key)
+{
+    bool ok[4];
+    key->device = fields.at(first).toULongLong(&ok[0]);
+    key->inode = fields.at(first + 1).toULongLong(&ok[1]);
+    key->size = fields.at(first + 2).toLongLong(&ok[2]);
+    key->mtime = fields.at(first + 3).toLongLong(&ok[3]);
+    return ok[0] && ok[1] && ok[2] && ok[3];
+}
+
+} // namespace
+
+qint64 JobJournal::FileState::completedPrefix() const
+{
+    return !completed.isEmpty() && completed.first().begin == 0 ? completed.first().end : 0;
+}
+
+JobJournal::JobJournal(const QString &outputPath)
+    : m_file(journalPath(outputPath))
+    , m_nextId(0)
+{
+}
+
+JobJournal::~JobJournal()
+{
+    m_file.close();
+}
+
+QString JobJournal::journalPath(const QString &outputPath)
+{
+    return QDir(outputPath).absoluteFilePath(JournalName);
+}
+
+bool JobJournal::isJournalFile(const QString &fileName)
+{
+    return fileName.endsWith(JournalName);
+}
+
+QByteArray JobJournal::keyFields(const ScanIndex::FileKey &key)
+{
+    return QByteArray::number(key.device) + '\t' + QByteArray::number(key.inode) + '\t'
+            + QByteArray::number(key.size) + '\t' + QByteArray::number(key.mtime);
+}
+
+void JobJournal::mergeRange(QList<Range> &ranges, qint64 begin, qint64 end)
+{
+    int i = 0;
+    while (i < ranges.size() && ranges.at(i).end < begin) {
+        ++i;
+    }
+    // Absorbs every range that overlaps or touches [begin, end)
+    while (i < ranges.size() && ranges.at(i).begin <= end) {
+        begin = qMin(begin, ranges.at(i).begin);
+        end = qMax(end, ranges.at(i).end);
+        ranges.removeAt(i);
+    }
+    ranges.insert(i, Range{ begin, end });
+}
+
+bool JobJournal::open()
+{
+    QMutexLocker locker(&m_mutex);
+    m_done.clear();
+    m_partial.clear();
+    m_nextId = 0;
+
+    if (m_file.exists()) {
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        QByteArrayList lines = m_file.readAll().split('\n');
+        m_file.close();
+        // Either empty or cut short by a crash
+        lines.removeLast();
+
+        QHash<qint64, QString> inputs;
+        for (const QByteArray &line : lines) {
+            const QByteArrayList fields = line.split('\t');
+            ScanIndex::FileKey key;
+            if (fields.first() == "D" && fields.size() == 6 && parseKey(fields, 1, &key)) {
+                const QString input = decodePath(fields.at(5));
+                m_done.insert(input, key);
+                m_partial.remove(input);
+            } else if (fields.first() == "F" && fields.size() == 9 && parseKey(fields, 2, &key)) {
+                FileState state;
+                state.id = fields.at(1).toLongLong();
+                state.input = decodePath(fields.at(6));
+                state.key = key;
+                state.target = decodePath(fields.at(7));
+                state.partial = decodePath(fields.at(8));
+                inputs.insert(state.id, state.input);
+                m_partial.insert(state.input, state);
+            } else if (fields.first() == "R" && fields.size() == 4) {
+                auto it = m_partial.find(inputs.value(fields.at(1).toLongLong()));
+                if (it != m_partial.end() && it->id == fields.at(1).toLongLong()) {
+                    mergeRange(it->completed, fields.at(2).toLongLong(), fields.at(3).toLongLong());
+                }
+            }
+        }
+    }
+
+    // Written anew, one record per file and merged ranges, so the journal of
+    // a job that is stopped again and again does not keep growing
+    for (auto it = m_partial.begin(); it != m_partial.end(); ) {
+        if (it->completed.isEmpty() || !QFile::exists(it->partial)) {
+            it = m_partial.erase(it);
+        } else {
+            it->id = m_nextId++;
+            ++it;
+        }
+    }
+
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    for (auto it = m_done.constBegin(); it != m_done.constEnd(); ++it) {
+        file.write("D\t" + keyFields(it.value()) + '\t' + encodePath(it.key()) + '\n');
+    }
+    for (auto it = m_partial.constBegin(); it != m_partial.constEnd(); ++it) {
+        const FileState &state = it.value();
+        file.write("F\t" + QByteArray::number(state.id) + '\t' + keyFields(state.key) + '\t'
+                   + encodePath(state.input) + '\t' + encodePath(state.target) + '\t'
+                   + encodePath(state.partial) + '\n');
+        for (const Range &range : state.completed) {
+            file.write("R\t" + QByteArray::number(state.id) + '\t' + QByteArray::number(range.begin) + '\t'
+                       + QByteArray::number(range.end) + '\n');
+        }
+    }
+    if (!file.commit()) {
+        return false;
+    }
+    return m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void JobJournal::remove()
+{
+    QMutexLocker locker(&m_mutex);
+    m_file.close();
+    m_file.remove();
+    m_done.clear();
+    m_partial.clear();
+}
+
+void JobJournal::append(const QByteArray &line)
+{
+    // Written through at once: a killed process loses nothing it recorded
+    if (m_file.isOpen()) {
+        m_file.write(line + '\n');
+        m_file.flush();
+    }
+}
+
+bool JobJournal::isDone(const QString &input, const ScanIndex::FileKey &key) const
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_done.constFind(input);
+    return it != m_done.constEnd() && it.value() == key;
+}
+
+void JobJournal::markDone(const QString &input, const ScanIndex::FileKey &key)
+{
+    QMutexLocker locker(&m_mutex);
+    m_done.insert(input, key);
+    m_partial.remove(input);
+    append("D\t" + keyFields(key) + '\t' + encodePath(input));
+}
+
+JobJournal::FileState JobJournal::resumable(const QString &input, const ScanIndex::FileKey &key) const
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_partial.constFind(input);
+    if (it != m_partial.constEnd() && it->key == key
+            && QFileInfo(it->partial).size() >= it->completed.last().end) {
+        return it.value();
+    }
+
+    FileState state;
+    state.input = input;
+    state.key = key;
+    return state;
+}
+
+void JobJournal::addRange(FileState *state, qint64 begin, qint64 end)
+{
+    QMutexLocker locker(&m_mutex);
+    if (state->id < 0) {
+        state->id = m_nextId++;
+        append("F\t" + QByteArray::number(state->id) + '\t' + keyFields(state->key) + '\t'
+               + encodePath(state->input) + '\t' + encodePath(state->target) + '\t'
+               + encodePath(state->partial));
+    }
+    mergeRange(state->completed, begin, end);
+    m_partial.insert(state->input, *state);
+    append("R\t" + QByteArray::number(state->id) + '\t' + QByteArray::number(begin) + '\t'
+           + QByteArray::number(end));
+}
+
+bool JobJournal::isCompleted(const FileState *state, qint64 begin, qint64 end) const
+{
+    QMutexLocker locker(&m_mutex);
+    for (const Range &range : state->completed) {
+        if (range.begin <= begin && range.end >= end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QSet<QString> JobJournal::partialFiles() const
+{
+    QMutexLocker locker(&m_mutex);
+    QSet<QString> files;
+    for (const FileState &state : m_partial) {
+        files.insert(state.partial);
+    }
+    return files;
+}
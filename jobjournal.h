@@ -0,0 +1,82 @@
+#ifndef JOBJOURNAL_H
+#define JOBJOURNAL_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QFile>
+#include <QMutex>
+#include "scanindex.h"
+
+// Append-only record of a run in progress, kept in the output directory
+// (".filemodifier.fmjournal"). It lists the files that are complete and, for
+// large files, the byte ranges of the partial output that are already on
+// disk, so that a run restarted after a stop or a crash skips the former and
+// continues the latter where they stopped. The journal is removed when a run
+// completes. A torn last line is ignored; a file whose identity changed
+// since it was recorded starts from zero.
+class JobJournal
+{
+public:
+    struct Range {
+        qint64 begin;
+        qint64 end;
+    };
+
+    // One file being written; filled by resumable() and updated by addRange()
+    struct FileState {
+        qint64 id = -1;            // -1 until the first range is recorded
+        QString input;
+        ScanIndex::FileKey key = {};
+        QString target;
+        QString partial;           // where the data is written
+        QList<Range> completed;    // sorted and merged
+
+        qint64 completedPrefix() const;
+    };
+
+    explicit JobJournal(const QString &outputPath);
+    ~JobJournal();
+
+    static QString journalPath(const QString &outputPath);
+    static bool isJournalFile(const QString &fileName);
+
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_file.errorString(); }
+
+    // Loads what an earlier run left and rewrites it without the records
+    // that no longer matter
+    bool open();
+    // The run completed; nothing is left to resume
+    void remove();
+
+    // The following are safe to call from several worker threads.
+
+    bool isDone(const QString &input, const ScanIndex::FileKey &key) const;
+    void markDone(const QString &input, const ScanIndex::FileKey &key);
+
+    // The state left by an earlier run if its partial output can be
+    // continued; otherwise a fresh state for input
+    FileState resumable(const QString &input, const ScanIndex::FileKey &key) const;
+    // Records that [begin, end) of state->partial is on disk
+    void addRange(FileState *state, qint64 begin, qint64 end);
+    bool isCompleted(const FileState *state, qint64 begin, qint64 end) const;
+
+    // Partial outputs that must not be cleaned up as stale
+    QSet<QString> partialFiles() const;
+
+private:
+    QFile m_file;
+    mutable QMutex m_mutex;
+    QHash<QString, ScanIndex::FileKey> m_done;
+    QHash<QString, FileState> m_partial;
+    qint64 m_nextId;
+
+    void append(const QByteArray &line);
+    static QByteArray keyFields(const ScanIndex::FileKey &key);
+    static void mergeRange(QList<Range> &ranges, qint64 begin, qint64 end);
+};
+
+#endif // JOBJOURNAL_H
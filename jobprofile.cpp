@@ -0,0 +1,64 @@
+#include "jobprofile.h"
+#include "fileprocessor.h"
+#include "transformchain.h"
+#include <QDir>
+#include <QSettings>
+
+bool JobProfile::apply(FileProcessor *processor, QString *error) const
+{
+    TransformChain chain;
+    QString parseError;
+    if (!TransformChain::parse(transform, &chain, &parseError)) {
+        if (error) {
+            *error = parseError;
+        }
+        return false;
+    }
+
+    processor->setInputMask(inputMask);
+    processor->setInputPath(inputPath.isEmpty() ? QDir::currentPath() : inputPath);
+    processor->setOutputPath(outputPath);
+    processor->setDeleteInput(deleteInput);
+    processor->setFileConflictMode(fileConflictMode);
+    processor->setTransform(chain);
+    return true;
+}
+
+QList<JobProfile> JobProfile::load(QSettings &settings)
+{
+    QList<JobProfile> profiles;
+    const int count = settings.beginReadArray("profiles");
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        JobProfile profile;
+        profile.name = settings.value("name").toString();
+        profile.inputPath = settings.value("inputPath").toString();
+        profile.inputMask = settings.value("inputMask", profile.inputMask).toString();
+        profile.outputPath = settings.value("outputPath").toString();
+        profile.transform = settings.value("transform", profile.transform).toString();
+        profile.fileConflictMode = settings.value("fileConflictMode", 0).toInt();
+        profile.deleteInput = settings.value("deleteInput", false).toBool();
+        profiles.append(profile);
+    }
+    settings.endArray();
+    return profiles;
+}
+
+void JobProfile::save(QSettings &settings, const QList<JobProfile> &profiles)
+{
+    // Without the remove a shorter list would keep the surplus entries
+    settings.remove("profiles");
+    settings.beginWriteArray("profiles", int(profiles.size()));
+    for (int i = 0; i < profiles.size(); ++i) {
+        const JobProfile &profile = profiles.at(i);
+        settings.setArrayIndex(i);
+        settings.setValue("name", profile.name);
+        settings.setValue("inputPath", profile.inputPath);
+        settings.setValue("inputMask", profile.inputMask);
+        settings.setValue("outputPath", profile.outputPath);
+        settings.setValue("transform", profile.transform);
+        settings.setValue("fileConflictMode", profile.fileConflictMode);
+        settings.setValue("deleteInput", profile.deleteInput);
+    }
+    settings.endArray();
+}
@@ -0,0 +1,33 @@
+#ifndef JOBPROFILE_H
+#define JOBPROFILE_H
+
+#include <QString>
+#include <QList>
+
+class QSettings;
+class FileProcessor;
+
+// The settings that differ between drop folders: where files come from,
+// which ones, how they are transformed and where they go. Each profile is
+// run by its own FileProcessor; the processors share one worker pool, see
+// FileProcessor::setWorkerPool().
+struct JobProfile
+{
+    QString name;
+    QString inputPath;          // empty for the current directory
+    QString inputMask = "*.txt";
+    QString outputPath;
+    QString transform = "xor:0123456789ABCDEF";     // see TransformChain::parse
+    int fileConflictMode = 0;
+    bool deleteInput = false;
+
+    // Hands the profile to processor with the setters that may be used
+    // during a run; false if the transform does not parse
+    bool apply(FileProcessor *processor, QString *error = nullptr) const;
+
+    // The "profiles" array of settings; empty if there is none yet
+    static QList<JobProfile> load(QSettings &settings);
+    static void save(QSettings &settings, const QList<JobProfile> &profiles);
+};
+
+#endif // JOBPROFILE_H
@@ -1,319 +1,1179 @@
-#include "mainwindow.h"
-#include "./ui_mainwindow.h"
-#include <QDir>
-#include <QStandardPaths>
-#include <QDateTime>
-
-MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent)
-    , ui(new Ui::MainWindow)
-    , m_timer(new QTimer(this))
-    , m_processor(new FileProcessor())
-    , m_processorThread(new QThread())
-{
-    ui->setupUi(this);
-    setupUI();
-    connectSignals();
-    loadSettings();
-    
-    setWindowTitle("File Modifier - Модификатор файлов");
-    resize(800, 600);
-}
-
-MainWindow::~MainWindow()
-{
-    saveSettings();
-    if (m_processorThread->isRunning()) {
-        m_processor->stopProcessing();
-        m_processorThread->quit();
-        m_processorThread->wait();
-    }
-    delete ui;
-}
-
-void MainWindow::setupUI()
-{
-    QWidget *centralWidget = new QWidget(this);
-    setCentralWidget(centralWidget);
-    
-    QVBoxLayout *mainLayout = new QVBoxLayout(centralWidget);
-    
-    // Input Settings Group
-    QGroupBox *inputGroup = new QGroupBox("Настройки входных файлов", centralWidget);
-    QGridLayout *inputLayout = new QGridLayout(inputGroup);
-    
-    inputLayout->addWidget(new QLabel("Маска файлов:"), 0, 0);
-    m_inputMaskEdit = new QLineEdit("*.txt", inputGroup);
-    inputLayout->addWidget(m_inputMaskEdit, 0, 1);
-    
-    inputLayout->addWidget(new QLabel("Путь к файлам:"), 1, 0);
-    QHBoxLayout *inputPathLayout = new QHBoxLayout();
-    m_inputPathEdit = new QLineEdit(inputGroup);
-    m_inputPathEdit->setReadOnly(true);
-    m_inputPathEdit->setPlaceholderText("Выберите папку с файлами");
-    m_browseInputButton = new QPushButton("Обзор", inputGroup);
-    inputPathLayout->addWidget(m_inputPathEdit);
-    inputPathLayout->addWidget(m_browseInputButton);
-    inputLayout->addLayout(inputPathLayout, 1, 1);
-    
-    m_deleteInputCheckBox = new QCheckBox("Удалять входные файлы", inputGroup);
-    inputLayout->addWidget(m_deleteInputCheckBox, 2, 0, 1, 2);
-    
-    mainLayout->addWidget(inputGroup);
-    
-    // Output Settings Group
-    QGroupBox *outputGroup = new QGroupBox("Настройки выходных файлов", centralWidget);
-    QGridLayout *outputLayout = new QGridLayout(outputGroup);
-    
-    outputLayout->addWidget(new QLabel("Путь сохранения:"), 0, 0);
-    QHBoxLayout *outputPathLayout = new QHBoxLayout();
-    m_outputPathEdit = new QLineEdit(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation), outputGroup);
-    m_browseOutputButton = new QPushButton("Обзор", outputGroup);
-    outputPathLayout->addWidget(m_outputPathEdit);
-    outputPathLayout->addWidget(m_browseOutputButton);
-    outputLayout->addLayout(outputPathLayout, 0, 1);
-    
-    outputLayout->addWidget(new QLabel("При конфликте имен:"), 1, 0);
-    m_fileConflictComboBox = new QComboBox(outputGroup);
-    m_fileConflictComboBox->addItem("Перезаписать", 0);
-    m_fileConflictComboBox->addItem("Добавить счетчик", 1);
-    outputLayout->addWidget(m_fileConflictComboBox, 1, 1);
-    
-    mainLayout->addWidget(outputGroup);
-    
-    // Processing Settings Group
-    QGroupBox *processingGroup = new QGroupBox("Настройки обработки", centralWidget);
-    QGridLayout *processingLayout = new QGridLayout(processingGroup);
-    
-    processingLayout->addWidget(new QLabel("XOR значение (8 байт):"), 0, 0);
-    m_xorValueEdit = new QLineEdit("0123456789ABCDEF", processingGroup);
-    processingLayout->addWidget(m_xorValueEdit, 0, 1);
-    
-    m_timerModeCheckBox = new QCheckBox("Режим таймера", processingGroup);
-    processingLayout->addWidget(m_timerModeCheckBox, 1, 0);
-    
-    processingLayout->addWidget(new QLabel("Интервал (мс):"), 2, 0);
-    m_timerIntervalSpinBox = new QSpinBox(processingGroup);
-    m_timerIntervalSpinBox->setRange(1000, 60000);
-    m_timerIntervalSpinBox->setValue(5000);
-    m_timerIntervalSpinBox->setSuffix(" мс");
-    processingLayout->addWidget(m_timerIntervalSpinBox, 2, 1);
-    
-    mainLayout->addWidget(processingGroup);
-    
-    // Control Buttons
-    QHBoxLayout *buttonLayout = new QHBoxLayout();
-    m_startButton = new QPushButton("Старт", centralWidget);
-    m_stopButton = new QPushButton("Стоп", centralWidget);
-    m_stopButton->setEnabled(false);
-    buttonLayout->addWidget(m_startButton);
-    buttonLayout->addWidget(m_stopButton);
-    buttonLayout->addStretch();
-    mainLayout->addLayout(buttonLayout);
-    
-    // Progress and Status
-    m_statusLabel = new QLabel("Готов к работе", centralWidget);
-    mainLayout->addWidget(m_statusLabel);
-    
-    m_progressBar = new QProgressBar(centralWidget);
-    m_progressBar->setVisible(false);
-    mainLayout->addWidget(m_progressBar);
-    
-    // Log
-    QGroupBox *logGroup = new QGroupBox("Лог операций", centralWidget);
-    QVBoxLayout *logLayout = new QVBoxLayout(logGroup);
-    m_logTextEdit = new QTextEdit(logGroup);
-    m_logTextEdit->setMaximumHeight(150);
-    logLayout->addWidget(m_logTextEdit);
-    mainLayout->addWidget(logGroup);
-}
-
-void MainWindow::connectSignals()
-{
-    connect(m_startButton, &QPushButton::clicked, this, &MainWindow::onStartButtonClicked);
-    connect(m_stopButton, &QPushButton::clicked, this, &MainWindow::onStopButtonClicked);
-    connect(m_browseInputButton, &QPushButton::clicked, this, &MainWindow::onBrowseInputPathClicked);
-    connect(m_browseOutputButton, &QPushButton::clicked, this, &MainWindow::onBrowseOutputPathClicked);
-    
-    connect(m_timer, &QTimer::timeout, this, &MainWindow::onTimerTimeout);
-    
-    // File processor signals
-    connect(m_processor, &FileProcessor::progressChanged, this, &MainWindow::onProcessingProgress);
-    connect(m_processor, &FileProcessor::processingFinished, this, &MainWindow::onProcessingFinished);
-    connect(m_processor, &FileProcessor::processingError, this, &MainWindow::onProcessingError);
-    connect(m_processor, &FileProcessor::fileProcessed, this, &MainWindow::onFileProcessed);
-    connect(m_processor, &FileProcessor::statusChanged, m_statusLabel, &QLabel::setText);
-    
-    // Move processor to separate thread
-    m_processor->moveToThread(m_processorThread);
-    connect(m_processorThread, &QThread::started, m_processor, &FileProcessor::startProcessing);
-    connect(m_processor, &FileProcessor::processingFinished, m_processorThread, &QThread::quit);
-}
-
-void MainWindow::onStartButtonClicked()
-{
-    if (!validateInputs()) {
-        return;
-    }
-    
-    // Configure processor
-    m_processor->setInputMask(m_inputMaskEdit->text());
-    m_processor->setOutputPath(m_outputPathEdit->text());
-    m_processor->setDeleteInput(m_deleteInputCheckBox->isChecked());
-    m_processor->setFileConflictMode(m_fileConflictComboBox->currentData().toInt());
-    m_processor->setXorValue(parseXorValue(m_xorValueEdit->text()));
-    // Use the selected input path or current directory
-    QString inputPath = m_inputPath.isEmpty() ? QDir::currentPath() : m_inputPath;
-    m_processor->setInputPath(inputPath);
-    
-    updateUIState(true);
-    m_logTextEdit->append(QString("[%1] Начало обработки файлов...").arg(QDateTime::currentDateTime().toString("hh:mm:ss")));
-    
-    if (m_timerModeCheckBox->isChecked()) {
-        m_timer->start(m_timerIntervalSpinBox->value());
-        m_logTextEdit->append(QString("[%1] Таймер запущен с интервалом %2 мс").arg(QDateTime::currentDateTime().toString("hh:mm:ss")).arg(m_timerIntervalSpinBox->value()));
-    } else {
-        m_processorThread->start();
-    }
-}
-
-void MainWindow::onStopButtonClicked()
-{
-    m_timer->stop();
-    m_processor->stopProcessing();
-    updateUIState(false);
-    m_logTextEdit->append(QString("[%1] Обработка остановлена").arg(QDateTime::currentDateTime().toString("hh:mm:ss")));
-}
-
-void MainWindow::onBrowseInputPathClicked()
-{
-    QString dir = QFileDialog::getExistingDirectory(this, "Выберите папку с файлами");
-    if (!dir.isEmpty()) {
-        m_inputPath = dir;
-        m_inputPathEdit->setText(dir);
-        m_logTextEdit->append(QString("[%1] Установлена папка: %2").arg(QDateTime::currentDateTime().toString("hh:mm:ss")).arg(dir));
-    }
-}
-
-void MainWindow::onBrowseOutputPathClicked()
-{
-    QString dir = QFileDialog::getExistingDirectory(this, "Выберите папку для сохранения");
-    if (!dir.isEmpty()) {
-        m_outputPathEdit->setText(dir);
-    }
-}
-
-void MainWindow::onTimerTimeout()
-{
-    if (!m_processorThread->isRunning()) {
-        m_processorThread->start();
-    }
-}
-
-void MainWindow::onProcessingProgress(int progress)
-{
-    m_progressBar->setValue(progress);
-}
-
-void MainWindow::onProcessingFinished()
-{
-    updateUIState(false);
-    m_progressBar->setVisible(false);
-    m_logTextEdit->append(QString("[%1] Обработка завершена").arg(QDateTime::currentDateTime().toString("hh:mm:ss")));
-}
-
-void MainWindow::onProcessingError(const QString &error)
-{
-    m_logTextEdit->append(QString("[%1] Ошибка: %2").arg(QDateTime::currentDateTime().toString("hh:mm:ss")).arg(error));
-    QMessageBox::warning(this, "Ошибка", error);
-}
-
-void MainWindow::onFileProcessed(const QString &filename)
-{
-    m_logTextEdit->append(QString("[%1] Обработан файл: %2").arg(QDateTime::currentDateTime().toString("hh:mm:ss")).arg(filename));
-}
-
-void MainWindow::updateUIState(bool processing)
-{
-    m_startButton->setEnabled(!processing);
-    m_stopButton->setEnabled(processing);
-    m_progressBar->setVisible(processing);
-    
-    if (processing) {
-        m_progressBar->setValue(0);
-    }
-}
-
-bool MainWindow::validateInputs()
-{
-    if (m_inputMaskEdit->text().isEmpty()) {
-        QMessageBox::warning(this, "Ошибка", "Укажите маску файлов");
-        return false;
-    }
-    
-    if (m_outputPathEdit->text().isEmpty()) {
-        QMessageBox::warning(this, "Ошибка", "Укажите путь для сохранения");
-        return false;
-    }
-    
-    if (!QDir(m_outputPathEdit->text()).exists()) {
-        QMessageBox::warning(this, "Ошибка", "Папка для сохранения не существует");
-        return false;
-    }
-    
-    if (!isValidXorValue(m_xorValueEdit->text())) {
-        QMessageBox::warning(this, "Ошибка", "XOR значение должно быть 16 символов (8 байт в hex)");
-        return false;
-    }
-    
-    return true;
-}
-
-QString MainWindow::getXorValue()
-{
-    return m_xorValueEdit->text();
-}
-
-void MainWindow::saveSettings()
-{
-    QSettings settings("FileModifier", "Settings");
-    settings.setValue("inputMask", m_inputMaskEdit->text());
-    settings.setValue("inputPath", m_inputPath);
-    settings.setValue("outputPath", m_outputPathEdit->text());
-    settings.setValue("deleteInput", m_deleteInputCheckBox->isChecked());
-    settings.setValue("fileConflictMode", m_fileConflictComboBox->currentIndex());
-    settings.setValue("timerMode", m_timerModeCheckBox->isChecked());
-    settings.setValue("timerInterval", m_timerIntervalSpinBox->value());
-    settings.setValue("xorValue", m_xorValueEdit->text());
-}
-
-void MainWindow::loadSettings()
-{
-    QSettings settings("FileModifier", "Settings");
-    m_inputMaskEdit->setText(settings.value("inputMask", "*.txt").toString());
-    m_inputPath = settings.value("inputPath", "").toString();
-    m_inputPathEdit->setText(m_inputPath);
-    m_outputPathEdit->setText(settings.value("outputPath", QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)).toString());
-    m_deleteInputCheckBox->setChecked(settings.value("deleteInput", false).toBool());
-    m_fileConflictComboBox->setCurrentIndex(settings.value("fileConflictMode", 0).toInt());
-    m_timerModeCheckBox->setChecked(settings.value("timerMode", false).toBool());
-    m_timerIntervalSpinBox->setValue(settings.value("timerInterval", 5000).toInt());
-    m_xorValueEdit->setText(settings.value("xorValue", "0123456789ABCDEF").toString());
-}
-
-bool MainWindow::isValidXorValue(const QString &value)
-{
-    if (value.length() != 16) return false;
-    return QRegExp("^[0-9A-Fa-f]{16}$").exactMatch(value);
-}
-
-QByteArray MainWindow::parseXorValue(const QString &value)
-{
-    return QByteArray::fromHex(value.toUtf8());
-}
-
-bool MainWindow::isValidXorValue(const QString &value)
-{
-    if (value.length() != 16) return false;
-    return QRegExp("^[0-9A-Fa-f]{16}$").exactMatch(value);
-} 
\ No newline at end of file
+#include "mainwindow.h"
+#include "./ui_mainwindow.h"
+#include "framecodec.h"
+#include "filebundle.h"
+#include <QDir>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QLocale>
+#include <QScrollBar>
+#include <QApplication>
+#include <QInputDialog>
+#include <QHeaderView>
+#include <QFileInfo>
+
+namespace {
+
+QString formatDuration(qint64 nsecs)
+{
+    if (nsecs < 1000 * 1000) {
+        return QString("%1 мкс").arg(nsecs / 1000.0, 0, 'f', 0);
+    }
+    if (nsecs < 1000LL * 1000 * 1000) {
+        return QString("%1 мс").arg(nsecs / 1e6, 0, 'f', 1);
+    }
+    return QString("%1 с").arg(nsecs / 1e9, 0, 'f', 2);
+}
+
+QString formatEta(qint64 seconds)
+{
+    return QString("%1:%2:%3").arg(seconds / 3600)
+            .arg(seconds / 60 % 60, 2, 10, QChar('0'))
+            .arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+// The second and later profiles write next to the file of the first one,
+// with their number added to the name
+QString profileFile(const QString &path, int index)
+{
+    if (path.isEmpty() || index == 0) {
+        return path;
+    }
+    const QFileInfo fileInfo(path);
+    const QString suffix = fileInfo.suffix().isEmpty() ? QString() : "." + fileInfo.suffix();
+    return fileInfo.dir().filePath(QString("%1-%2%3").arg(fileInfo.completeBaseName()).arg(index + 1).arg(suffix));
+}
+
+// Put before the state of a paused profile
+const QString PausedPrefix = "Приостановлено. ";
+
+// Columns of the profile table
+enum ProfileColumn {
+    NameColumn,
+    StateColumn,
+    FilesColumn,
+    SpeedColumn
+};
+
+} // namespace
+
+MainWindow::MainWindow(QWidget *parent)
+    : QMainWindow(parent)
+    , ui(new Ui::MainWindow)
+    , m_timer(new QTimer(this))
+    , m_workerPool(new QThreadPool(this))
+    , m_openFilesLimit(0)
+    , m_currentProfile(0)
+    , m_showingProfile(false)
+    , m_running(false)
+{
+    ui->setupUi(this);
+    setupUI();
+    connectSignals();
+    loadSettings();
+    
+    setWindowTitle("File Modifier - Модификатор файлов");
+    resize(800, 600);
+}
+
+MainWindow::~MainWindow()
+{
+    saveSettings();
+    while (!m_jobs.isEmpty()) {
+        removeJob(int(m_jobs.size()) - 1);
+    }
+    delete ui;
+}
+
+void MainWindow::setupUI()
+{
+    QWidget *centralWidget = new QWidget(this);
+    setCentralWidget(centralWidget);
+    
+    QVBoxLayout *mainLayout = new QVBoxLayout(centralWidget);
+    
+    // Profiles: all of them run at once, the selected one is shown below
+    QGroupBox *profileGroup = new QGroupBox("Профили", centralWidget);
+    QVBoxLayout *profileLayout = new QVBoxLayout(profileGroup);
+    m_profileTable = new QTableWidget(0, 4, profileGroup);
+    m_profileTable->setHorizontalHeaderLabels(QStringList() << "Профиль" << "Состояние" << "Файлы" << "Скорость");
+    m_profileTable->horizontalHeader()->setSectionResizeMode(StateColumn, QHeaderView::Stretch);
+    m_profileTable->verticalHeader()->setVisible(false);
+    m_profileTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_profileTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_profileTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_profileTable->setMaximumHeight(120);
+    m_profileTable->setToolTip("Настройки ниже относятся к выбранному профилю");
+    profileLayout->addWidget(m_profileTable);
+    
+    QHBoxLayout *profileButtonLayout = new QHBoxLayout();
+    m_addProfileButton = new QPushButton("Добавить", profileGroup);
+    m_addProfileButton->setToolTip("Новый профиль с настройками выбранного");
+    m_renameProfileButton = new QPushButton("Переименовать", profileGroup);
+    m_removeProfileButton = new QPushButton("Удалить", profileGroup);
+    profileButtonLayout->addWidget(m_addProfileButton);
+    profileButtonLayout->addWidget(m_renameProfileButton);
+    profileButtonLayout->addWidget(m_removeProfileButton);
+    profileButtonLayout->addStretch();
+    profileLayout->addLayout(profileButtonLayout);
+    
+    mainLayout->addWidget(profileGroup);
+    
+    // Input Settings Group
+    QGroupBox *inputGroup = new QGroupBox("Настройки входных файлов", centralWidget);
+    QGridLayout *inputLayout = new QGridLayout(inputGroup);
+    
+    inputLayout->addWidget(new QLabel("Маска файлов:"), 0, 0);
+    m_inputMaskEdit = new QLineEdit("*.txt", inputGroup);
+    inputLayout->addWidget(m_inputMaskEdit, 0, 1);
+    
+    inputLayout->addWidget(new QLabel("Путь к файлам:"), 1, 0);
+    QHBoxLayout *inputPathLayout = new QHBoxLayout();
+    m_inputPathEdit = new QLineEdit(inputGroup);
+    m_inputPathEdit->setReadOnly(true);
+    m_inputPathEdit->setPlaceholderText("Выберите папку с файлами");
+    m_browseInputButton = new QPushButton("Обзор", inputGroup);
+    inputPathLayout->addWidget(m_inputPathEdit);
+    inputPathLayout->addWidget(m_browseInputButton);
+    inputLayout->addLayout(inputPathLayout, 1, 1);
+    
+    m_deleteInputCheckBox = new QCheckBox("Удалять входные файлы", inputGroup);
+    inputLayout->addWidget(m_deleteInputCheckBox, 2, 0, 1, 2);
+    
+    mainLayout->addWidget(inputGroup);
+    
+    // Output Settings Group
+    QGroupBox *outputGroup = new QGroupBox("Настройки выходных файлов", centralWidget);
+    QGridLayout *outputLayout = new QGridLayout(outputGroup);
+    
+    outputLayout->addWidget(new QLabel("Путь сохранения:"), 0, 0);
+    QHBoxLayout *outputPathLayout = new QHBoxLayout();
+    m_outputPathEdit = new QLineEdit(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation), outputGroup);
+    m_browseOutputButton = new QPushButton("Обзор", outputGroup);
+    outputPathLayout->addWidget(m_outputPathEdit);
+    outputPathLayout->addWidget(m_browseOutputButton);
+    outputLayout->addLayout(outputPathLayout, 0, 1);
+    
+    outputLayout->addWidget(new QLabel("При конфликте имен:"), 1, 0);
+    m_fileConflictComboBox = new QComboBox(outputGroup);
+    m_fileConflictComboBox->addItem("Перезаписать", 0);
+    m_fileConflictComboBox->addItem("Добавить счетчик", 1);
+    outputLayout->addWidget(m_fileConflictComboBox, 1, 1);
+    
+    outputLayout->addWidget(new QLabel("Сохранение на диск:"), 2, 0);
+    m_durabilityComboBox = new QComboBox(outputGroup);
+    m_durabilityComboBox->addItem("Без синхронизации", OutputCommitter::None);
+    m_durabilityComboBox->addItem("Группами файлов", OutputCommitter::Batch);
+    m_durabilityComboBox->addItem("Каждый файл", OutputCommitter::File);
+    m_durabilityComboBox->setToolTip("Файлы пишутся во временный файл и переименовываются, когда данные на диске; входные файлы удаляются только после этого");
+    outputLayout->addWidget(m_durabilityComboBox, 2, 1);
+    
+    outputLayout->addWidget(new QLabel("Контрольные суммы:"), 3, 0);
+    m_checksumComboBox = new QComboBox(outputGroup);
+    m_checksumComboBox->addItem("Не считать", IntegrityManifest::None);
+    m_checksumComboBox->addItem("Результат", IntegrityManifest::Output);
+    m_checksumComboBox->addItem("Исходные файлы и результат", IntegrityManifest::Both);
+    m_checksumComboBox->setToolTip("CRC-32C считается во время обработки, без повторного чтения; манифест filemodifier-<дата>-<время>.fmmanifest создаётся в папке сохранения");
+    outputLayout->addWidget(m_checksumComboBox, 3, 1);
+    
+    outputLayout->addWidget(new QLabel("Сжатие:"), 4, 0);
+    m_compressionSpinBox = new QSpinBox(outputGroup);
+    m_compressionSpinBox->setRange(0, 9);
+    m_compressionSpinBox->setValue(0);
+    m_compressionSpinBox->setSpecialValueText("Без сжатия");
+    m_compressionSpinBox->setToolTip("Уровень gzip от 1 (быстрее) до 9 (меньше); к имени добавляется .gz, большие файлы сжимаются на всех ядрах");
+    m_compressionSpinBox->setEnabled(FrameCodec::isAvailable());
+    outputLayout->addWidget(m_compressionSpinBox, 4, 1);
+    
+    m_restoreCheckBox = new QCheckBox("Восстановление (распаковать и отменить преобразование)", outputGroup);
+    m_restoreCheckBox->setToolTip("Сжатые программой файлы распаковываются, к данным применяется обратная цепочка преобразований, .gz убирается из имени");
+    outputLayout->addWidget(m_restoreCheckBox, 5, 0, 1, 2);
+    
+    m_bundleCheckBox = new QCheckBox("Собирать мелкие файлы в пакеты (.fmbundle)", outputGroup);
+    m_bundleCheckBox->setToolTip("Файлы до 64 КБ записываются не по одному, а пакетами с оглавлением; извлекаются кнопкой \"Распаковать...\"");
+    outputLayout->addWidget(m_bundleCheckBox, 6, 0, 1, 2);
+    
+    mainLayout->addWidget(outputGroup);
+    
+    // Processing Settings Group
+    QGroupBox *processingGroup = new QGroupBox("Настройки обработки", centralWidget);
+    QGridLayout *processingLayout = new QGridLayout(processingGroup);
+    
+    processingLayout->addWidget(new QLabel("Преобразование:"), 0, 0);
+    m_transformEdit = new QLineEdit("xor:0123456789ABCDEF", processingGroup);
+    m_transformEdit->setToolTip("Этапы через запятую, выполняются за один проход:\n"
+                                "xor:<hex> - XOR с ключом любой длины\n"
+                                "rolling:<hex> - XOR с потоком ключа из начального значения (до 8 байт) и смещения\n"
+                                "sbox:<hex> - замена байтов по таблице из начального значения (до 8 байт) или из 256 байт\n"
+                                "unsbox:<hex> - обратная замена для sbox с тем же значением");
+    processingLayout->addWidget(m_transformEdit, 0, 1);
+    
+    m_timerModeCheckBox = new QCheckBox("Режим таймера", processingGroup);
+    processingLayout->addWidget(m_timerModeCheckBox, 1, 0);
+    
+    processingLayout->addWidget(new QLabel("Интервал (мс):"), 2, 0);
+    m_timerIntervalSpinBox = new QSpinBox(processingGroup);
+    m_timerIntervalSpinBox->setRange(1000, 60000);
+    m_timerIntervalSpinBox->setValue(5000);
+    m_timerIntervalSpinBox->setSuffix(" мс");
+    processingLayout->addWidget(m_timerIntervalSpinBox, 2, 1);
+    
+    m_watchModeCheckBox = new QCheckBox("Отслеживать новые файлы без опроса", processingGroup);
+    m_watchModeCheckBox->setToolTip("Новые файлы обрабатываются сразу после записи; интервал используется, только если отслеживание недоступно");
+    m_watchModeCheckBox->setEnabled(DirectoryWatcher::isSupported());
+    processingLayout->addWidget(m_watchModeCheckBox, 1, 1);
+    
+    processingLayout->addWidget(new QLabel("Потоков обработки:"), 3, 0);
+    m_workerCountSpinBox = new QSpinBox(processingGroup);
+    m_workerCountSpinBox->setRange(0, 256);
+    m_workerCountSpinBox->setValue(0);
+    m_workerCountSpinBox->setSpecialValueText("Авто");
+    m_workerCountSpinBox->setToolTip("Потоки общие для всех профилей; профили обрабатывают файлы по очереди");
+    processingLayout->addWidget(m_workerCountSpinBox, 3, 1);
+    
+    m_splitLargeFilesCheckBox = new QCheckBox("Делить большие файлы между потоками", processingGroup);
+    processingLayout->addWidget(m_splitLargeFilesCheckBox, 4, 0);
+    
+    processingLayout->addWidget(new QLabel("Размер части:"), 5, 0);
+    m_splitChunkSizeSpinBox = new QSpinBox(processingGroup);
+    m_splitChunkSizeSpinBox->setRange(1, 4096);
+    m_splitChunkSizeSpinBox->setValue(64);
+    m_splitChunkSizeSpinBox->setSuffix(" МБ");
+    processingLayout->addWidget(m_splitChunkSizeSpinBox, 5, 1);
+    
+    m_scanIndexCheckBox = new QCheckBox("Пропускать уже обработанные файлы", processingGroup);
+    m_scanIndexCheckBox->setToolTip("Запоминает обработанные файлы и неизменившиеся папки, чтобы повторные запуски находили только новые и изменённые файлы");
+    processingLayout->addWidget(m_scanIndexCheckBox, 6, 0, 1, 2);
+    
+    processingLayout->addWidget(new QLabel("Файл метрик:"), 7, 0);
+    m_metricsFileEdit = new QLineEdit(processingGroup);
+    m_metricsFileEdit->setPlaceholderText("Не записывать");
+    m_metricsFileEdit->setToolTip("Обновляется каждую секунду во время обработки: JSON для файлов *.json, иначе текстовый формат Prometheus");
+    processingLayout->addWidget(m_metricsFileEdit, 7, 1);
+    
+    m_resumeCheckBox = new QCheckBox("Продолжать прерванную обработку", processingGroup);
+    m_resumeCheckBox->setToolTip("После остановки или сбоя следующий запуск пропускает готовые файлы и продолжает большие файлы с места остановки");
+    processingLayout->addWidget(m_resumeCheckBox, 8, 0, 1, 2);
+    
+    processingLayout->addWidget(new QLabel("Упреждающее чтение:"), 9, 0);
+    m_prefetchSpinBox = new QSpinBox(processingGroup);
+    m_prefetchSpinBox->setRange(0, 4096);
+    m_prefetchSpinBox->setValue(128);
+    m_prefetchSpinBox->setSuffix(" МБ");
+    m_prefetchSpinBox->setSpecialValueText("Выключено");
+    m_prefetchSpinBox->setToolTip("Следующие файлы очереди читаются в кэш, пока обрабатываются текущие; помогает на HDD и сетевых дисках");
+    m_prefetchSpinBox->setEnabled(Prefetcher::isSupported());
+    processingLayout->addWidget(m_prefetchSpinBox, 9, 1);
+    
+    m_dropCacheCheckBox = new QCheckBox("Не вытеснять кэш страниц других программ", processingGroup);
+    m_dropCacheCheckBox->setToolTip("Обработанные файлы удаляются из кэша страниц, чтобы длинная обработка не вытесняла данные других программ");
+    m_dropCacheCheckBox->setEnabled(Prefetcher::isSupported());
+    processingLayout->addWidget(m_dropCacheCheckBox, 10, 0, 1, 2);
+    
+    processingLayout->addWidget(new QLabel("Порядок обработки:"), 11, 0);
+    m_schedulingComboBox = new QComboBox(processingGroup);
+    m_schedulingComboBox->addItem("В порядке поиска", FileQueue::Fifo);
+    m_schedulingComboBox->addItem("Сначала маленькие", FileQueue::SmallestFirst);
+    m_schedulingComboBox->addItem("Сначала большие", FileQueue::LargestFirst);
+    m_schedulingComboBox->addItem("Сначала старые", FileQueue::OldestFirst);
+    m_schedulingComboBox->setToolTip("Какой из найденных файлов обрабатывается следующим; \"Сначала маленькие\" не даёт большому файлу задержать сотни мелких");
+    processingLayout->addWidget(m_schedulingComboBox, 11, 1);
+    
+    processingLayout->addWidget(new QLabel("Чтение не быстрее:"), 12, 0);
+    m_readLimitSpinBox = new QSpinBox(processingGroup);
+    m_readLimitSpinBox->setRange(0, 100000);
+    m_readLimitSpinBox->setSuffix(" МБ/с");
+    m_readLimitSpinBox->setSpecialValueText("Без ограничения");
+    m_readLimitSpinBox->setToolTip("Общая скорость чтения всех потоков и профилей, чтобы обработка оставляла диск другим программам");
+    processingLayout->addWidget(m_readLimitSpinBox, 12, 1);
+    
+    processingLayout->addWidget(new QLabel("Запись не быстрее:"), 13, 0);
+    m_writeLimitSpinBox = new QSpinBox(processingGroup);
+    m_writeLimitSpinBox->setRange(0, 100000);
+    m_writeLimitSpinBox->setSuffix(" МБ/с");
+    m_writeLimitSpinBox->setSpecialValueText("Без ограничения");
+    m_writeLimitSpinBox->setToolTip("Общая скорость записи всех потоков и профилей");
+    processingLayout->addWidget(m_writeLimitSpinBox, 13, 1);
+    
+    processingLayout->addWidget(new QLabel("Открытых файлов:"), 14, 0);
+    m_maxOpenFilesSpinBox = new QSpinBox(processingGroup);
+    m_maxOpenFilesSpinBox->setRange(0, 65536);
+    m_maxOpenFilesSpinBox->setSpecialValueText("Без ограничения");
+    m_maxOpenFilesSpinBox->setToolTip("Сколько файлов все профили вместе держат открытыми одновременно; при необходимости запускается меньше потоков");
+    processingLayout->addWidget(m_maxOpenFilesSpinBox, 14, 1);
+    
+    processingLayout->addWidget(new QLabel("Буфер конвейера:"), 15, 0);
+    m_bufferSizeSpinBox = new QSpinBox(processingGroup);
+    m_bufferSizeSpinBox->setRange(4, 65536);
+    m_bufferSizeSpinBox->setValue(1024);
+    m_bufferSizeSpinBox->setSuffix(" КБ");
+    m_bufferSizeSpinBox->setToolTip("Размер одного чтения и записи; файлы не больше буфера обрабатываются без конвейера");
+    processingLayout->addWidget(m_bufferSizeSpinBox, 15, 1);
+    
+    processingLayout->addWidget(new QLabel("Буферов в конвейере:"), 16, 0);
+    m_queueDepthSpinBox = new QSpinBox(processingGroup);
+    m_queueDepthSpinBox->setRange(1, 64);
+    m_queueDepthSpinBox->setValue(4);
+    m_queueDepthSpinBox->setSpecialValueText("Без конвейера");
+    m_queueDepthSpinBox->setToolTip("Сколько частей файла одновременно читается, преобразуется и пишется");
+    processingLayout->addWidget(m_queueDepthSpinBox, 16, 1);
+    
+    processingLayout->addWidget(new QLabel("Ввод-вывод:"), 17, 0);
+    m_ioBackendComboBox = new QComboBox(processingGroup);
+    m_ioBackendComboBox->addItem("Авто", IoPipeline::Auto);
+    m_ioBackendComboBox->addItem("Потоки чтения и записи", IoPipeline::Threads);
+    m_ioBackendComboBox->addItem("io_uring", IoPipeline::IoUring);
+    m_ioBackendComboBox->setToolTip("\"Авто\" использует io_uring, если он доступен, иначе отдельные потоки чтения и записи");
+    processingLayout->addWidget(m_ioBackendComboBox, 17, 1);
+    
+    mainLayout->addWidget(processingGroup);
+    
+    // Control Buttons
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    m_startButton = new QPushButton("Старт", centralWidget);
+    m_stopButton = new QPushButton("Стоп", centralWidget);
+    m_stopButton->setEnabled(false);
+    m_pauseButton = new QPushButton("Пауза", centralWidget);
+    m_pauseButton->setToolTip("Приостановить обработку, не прерывая текущие файлы");
+    m_pauseButton->setEnabled(false);
+    m_verifyButton = new QPushButton("Проверить...", centralWidget);
+    m_verifyButton->setToolTip("Сравнить файлы с контрольными суммами из манифеста");
+    m_extractButton = new QPushButton("Распаковать...", centralWidget);
+    m_extractButton->setToolTip("Извлечь файлы из пакетов .fmbundle");
+    buttonLayout->addWidget(m_startButton);
+    buttonLayout->addWidget(m_stopButton);
+    buttonLayout->addWidget(m_pauseButton);
+    buttonLayout->addWidget(m_verifyButton);
+    buttonLayout->addWidget(m_extractButton);
+    buttonLayout->addStretch();
+    mainLayout->addLayout(buttonLayout);
+    
+    // Progress and Status
+    m_statusLabel = new QLabel("Готов к работе", centralWidget);
+    mainLayout->addWidget(m_statusLabel);
+    
+    m_progressBar = new QProgressBar(centralWidget);
+    m_progressBar->setVisible(false);
+    mainLayout->addWidget(m_progressBar);
+    
+    m_metricsLabel = new QLabel(centralWidget);
+    m_metricsLabel->setVisible(false);
+    mainLayout->addWidget(m_metricsLabel);
+    
+    // Log
+    QGroupBox *logGroup = new QGroupBox("Лог операций", centralWidget);
+    QVBoxLayout *logLayout = new QVBoxLayout(logGroup);
+    
+    QHBoxLayout *logOptionsLayout = new QHBoxLayout();
+    logOptionsLayout->addWidget(new QLabel("Показывать:"));
+    m_logLevelComboBox = new QComboBox(logGroup);
+    m_logLevelComboBox->addItem("Все записи", OperationLog::Detail);
+    m_logLevelComboBox->addItem("Без обработанных файлов", OperationLog::Info);
+    m_logLevelComboBox->addItem("Предупреждения и ошибки", OperationLog::Warning);
+    m_logLevelComboBox->addItem("Только ошибки", OperationLog::Error);
+    logOptionsLayout->addWidget(m_logLevelComboBox);
+    logOptionsLayout->addWidget(new QLabel("Файл лога:"));
+    m_logFileEdit = new QLineEdit(logGroup);
+    m_logFileEdit->setPlaceholderText("Не записывать");
+    m_logFileEdit->setToolTip("Все записи дописываются в файл; при 10 МБ он переименовывается в .1, хранится до 5 старых файлов");
+    logOptionsLayout->addWidget(m_logFileEdit);
+    logLayout->addLayout(logOptionsLayout);
+    
+    // The window keeps the last 10000 entries; the view only lays out the
+    // rows that are visible
+    m_log = new OperationLog(10000, this);
+    m_logFilter = new OperationLogFilter(this);
+    m_logFilter->setSourceModel(m_log);
+    m_logView = new QListView(logGroup);
+    m_logView->setModel(m_logFilter);
+    m_logView->setUniformItemSizes(true);
+    m_logView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    m_logView->setMaximumHeight(150);
+    logLayout->addWidget(m_logView);
+    mainLayout->addWidget(logGroup);
+}
+
+void MainWindow::connectSignals()
+{
+    connect(m_startButton, &QPushButton::clicked, this, &MainWindow::onStartButtonClicked);
+    connect(m_stopButton, &QPushButton::clicked, this, &MainWindow::onStopButtonClicked);
+    connect(m_pauseButton, &QPushButton::clicked, this, &MainWindow::onPauseButtonClicked);
+    connect(m_extractButton, &QPushButton::clicked, this, &MainWindow::onExtractButtonClicked);
+    connect(m_verifyButton, &QPushButton::clicked, this, &MainWindow::onVerifyButtonClicked);
+    connect(m_browseInputButton, &QPushButton::clicked, this, &MainWindow::onBrowseInputPathClicked);
+    connect(m_browseOutputButton, &QPushButton::clicked, this, &MainWindow::onBrowseOutputPathClicked);
+    connect(m_addProfileButton, &QPushButton::clicked, this, &MainWindow::onAddProfileClicked);
+    connect(m_renameProfileButton, &QPushButton::clicked, this, &MainWindow::onRenameProfileClicked);
+    connect(m_removeProfileButton, &QPushButton::clicked, this, &MainWindow::onRemoveProfileClicked);
+    connect(m_profileTable, &QTableWidget::itemSelectionChanged, this, &MainWindow::onProfileSelected);
+    
+    connect(m_timer, &QTimer::timeout, this, &MainWindow::onTimerTimeout);
+    
+    // Taken over by a running job between two files
+    connect(m_inputMaskEdit, &QLineEdit::editingFinished, this, &MainWindow::onLiveSettingsChanged);
+    connect(m_outputPathEdit, &QLineEdit::editingFinished, this, &MainWindow::onLiveSettingsChanged);
+    connect(m_transformEdit, &QLineEdit::editingFinished, this, &MainWindow::onLiveSettingsChanged);
+    connect(m_deleteInputCheckBox, &QCheckBox::toggled, this, &MainWindow::onLiveSettingsChanged);
+    connect(m_fileConflictComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onLiveSettingsChanged);
+    connect(m_schedulingComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onLiveSettingsChanged);
+    connect(m_readLimitSpinBox, &QSpinBox::editingFinished, this, &MainWindow::onLiveSettingsChanged);
+    connect(m_writeLimitSpinBox, &QSpinBox::editingFinished, this, &MainWindow::onLiveSettingsChanged);
+    
+    connect(m_logLevelComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        m_logFilter->setMinimumLevel(OperationLog::Level(m_logLevelComboBox->currentData().toInt()));
+    });
+    connect(m_logFileEdit, &QLineEdit::editingFinished, this, &MainWindow::onLogFileChanged);
+    // Follow new entries unless the user scrolled up to read older ones
+    connect(m_logFilter, &QAbstractItemModel::rowsInserted, this, [this]() {
+        const QScrollBar *bar = m_logView->verticalScrollBar();
+        if (bar->value() >= bar->maximum()) {
+            m_logView->scrollToBottom();
+        }
+    });
+}
+
+void MainWindow::addJob(const JobProfile &profile)
+{
+    ProfileJob job;
+    job.processor = new FileProcessor();
+    job.processor->setWorkerPool(m_workerPool);
+    job.processor->setSharedLimits(&m_readThrottle, &m_writeThrottle, &m_openFiles);
+    job.thread = new QThread();
+    job.watcher = new DirectoryWatcher(this);
+    
+    connect(job.watcher, &DirectoryWatcher::filesAdded, this, &MainWindow::onWatchedFilesAdded);
+    connect(job.watcher, &DirectoryWatcher::rescanRequired, this, &MainWindow::onRescanRequired);
+    
+    // File processor signals; the slots tell the profiles apart by sender()
+    connect(job.processor, &FileProcessor::progressChanged, this, &MainWindow::onProcessingProgress);
+    connect(job.processor, &FileProcessor::processingFinished, this, &MainWindow::onProcessingFinished);
+    connect(job.processor, &FileProcessor::processingError, this, &MainWindow::onProcessingError);
+    connect(job.processor, &FileProcessor::progressUpdated, this, &MainWindow::onProgressUpdated);
+    connect(job.processor, &FileProcessor::filesProcessed, this, &MainWindow::onFilesProcessed);
+    connect(job.processor, &FileProcessor::statusChanged, this, &MainWindow::onStatusChanged);
+    connect(job.processor, &FileProcessor::metricsUpdated, this, &MainWindow::onMetricsUpdated);
+    connect(job.processor, &FileProcessor::idle, this, &MainWindow::onProcessorIdle);
+    
+    // The processor keeps its thread as long as the profile exists; runs
+    // are queued to it, and its workers come from m_workerPool
+    job.processor->moveToThread(job.thread);
+    job.thread->start();
+    
+    m_profiles.append(profile);
+    m_jobs.append(job);
+    
+    const int row = m_profileTable->rowCount();
+    m_profileTable->insertRow(row);
+    m_profileTable->setItem(row, NameColumn, new QTableWidgetItem(profile.name));
+    m_profileTable->setItem(row, StateColumn, new QTableWidgetItem("Остановлен"));
+    m_profileTable->setItem(row, FilesColumn, new QTableWidgetItem());
+    m_profileTable->setItem(row, SpeedColumn, new QTableWidgetItem());
+}
+
+void MainWindow::removeJob(int index)
+{
+    const ProfileJob job = m_jobs.takeAt(index);
+    m_profiles.removeAt(index);
+    job.watcher->stop();
+    job.processor->stopProcessing();
+    job.thread->quit();
+    job.thread->wait();
+    delete job.processor;
+    delete job.thread;
+    delete job.watcher;
+    m_profileTable->removeRow(index);
+}
+
+int MainWindow::jobIndex(QObject *object) const
+{
+    for (int i = 0; i < m_jobs.size(); ++i) {
+        if (m_jobs.at(i).processor == object || m_jobs.at(i).watcher == object) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QString MainWindow::profilePrefix(int index) const
+{
+    // With a single profile the log reads as before profiles existed
+    return m_profiles.size() > 1 ? QString("[%1] ").arg(m_profiles.at(index).name) : QString();
+}
+
+void MainWindow::storeProfile()
+{
+    JobProfile &profile = m_profiles[m_currentProfile];
+    profile.inputMask = m_inputMaskEdit->text();
+    profile.inputPath = m_inputPath;
+    profile.outputPath = m_outputPathEdit->text();
+    profile.transform = m_transformEdit->text();
+    profile.fileConflictMode = m_fileConflictComboBox->currentData().toInt();
+    profile.deleteInput = m_deleteInputCheckBox->isChecked();
+}
+
+void MainWindow::showProfile(int index)
+{
+    // Filling in the widgets fires their change signals, which must not be
+    // taken for edits of the profile
+    m_showingProfile = true;
+    m_currentProfile = index;
+    const JobProfile &profile = m_profiles.at(index);
+    m_inputMaskEdit->setText(profile.inputMask);
+    m_inputPath = profile.inputPath;
+    m_inputPathEdit->setText(m_inputPath);
+    m_outputPathEdit->setText(profile.outputPath);
+    m_transformEdit->setText(profile.transform);
+    m_fileConflictComboBox->setCurrentIndex(qMax(0, m_fileConflictComboBox->findData(profile.fileConflictMode)));
+    m_deleteInputCheckBox->setChecked(profile.deleteInput);
+    m_profileTable->selectRow(index);
+    m_showingProfile = false;
+    
+    // The figures below follow the profile; they fill in again with its
+    // next report
+    m_statusLabel->setText(m_profileTable->item(index, StateColumn)->text());
+    m_pauseButton->setText(m_jobs.at(index).processor->isPaused() ? "Продолжить" : "Пауза");
+    m_progressBar->setValue(0);
+    m_metricsLabel->setVisible(false);
+}
+
+void MainWindow::onProfileSelected()
+{
+    const QList<QTableWidgetItem *> selected = m_profileTable->selectedItems();
+    if (m_showingProfile || selected.isEmpty() || selected.first()->row() == m_currentProfile) {
+        return;
+    }
+    storeProfile();
+    showProfile(selected.first()->row());
+}
+
+void MainWindow::onAddProfileClicked()
+{
+    bool ok = false;
+    const QString name = QInputDialog::getText(this, "Новый профиль", "Название профиля:", QLineEdit::Normal,
+                                               QString("Профиль %1").arg(m_profiles.size() + 1), &ok).trimmed();
+    if (!ok || name.isEmpty()) {
+        return;
+    }
+    
+    storeProfile();
+    JobProfile profile = m_profiles.at(m_currentProfile);
+    profile.name = name;
+    addJob(profile);
+    showProfile(int(m_profiles.size()) - 1);
+    m_removeProfileButton->setEnabled(true);
+    m_log->append(OperationLog::Info, QString("Добавлен профиль: %1").arg(name));
+}
+
+void MainWindow::onRenameProfileClicked()
+{
+    bool ok = false;
+    const QString name = QInputDialog::getText(this, "Переименовать профиль", "Название профиля:", QLineEdit::Normal,
+                                               m_profiles.at(m_currentProfile).name, &ok).trimmed();
+    if (!ok || name.isEmpty()) {
+        return;
+    }
+    m_profiles[m_currentProfile].name = name;
+    m_profileTable->item(m_currentProfile, NameColumn)->setText(name);
+}
+
+void MainWindow::onRemoveProfileClicked()
+{
+    if (m_profiles.size() < 2) {
+        return;
+    }
+    const QString name = m_profiles.at(m_currentProfile).name;
+    if (QMessageBox::question(this, "Удалить профиль", QString("Удалить профиль \"%1\"?").arg(name))
+            != QMessageBox::Yes) {
+        return;
+    }
+    
+    const int index = m_currentProfile;
+    removeJob(index);
+    showProfile(qMin(index, int(m_profiles.size()) - 1));
+    m_removeProfileButton->setEnabled(m_profiles.size() > 1);
+    m_log->append(OperationLog::Info, QString("Удалён профиль: %1").arg(name));
+}
+
+void MainWindow::onStartButtonClicked()
+{
+    storeProfile();
+    if (!validateInputs()) {
+        return;
+    }
+    
+    // Configure processors; the settings outside the profiles apply to all
+    m_workerPool->setMaxThreadCount(m_workerCountSpinBox->value() > 0 ? m_workerCountSpinBox->value()
+                                                                      : QThread::idealThreadCount());
+    // Files still finishing after a stop hold part of the open-file budget;
+    // it can only be resized once all of it is back
+    const int maxOpenFiles = m_maxOpenFilesSpinBox->value();
+    if (maxOpenFiles != m_openFilesLimit) {
+        if (m_openFiles.tryAcquire(m_openFilesLimit)) {
+            m_openFiles.release(maxOpenFiles);
+            m_openFilesLimit = maxOpenFiles;
+        } else {
+            m_log->append(OperationLog::Warning, QString("Ограничение открытых файлов (%1) начнёт действовать после завершения текущих файлов")
+                                                 .arg(maxOpenFiles));
+        }
+    }
+    m_readThrottle.reset();
+    m_writeThrottle.reset();
+    for (int i = 0; i < m_jobs.size(); ++i) {
+        FileProcessor *processor = m_jobs.at(i).processor;
+        m_profiles.at(i).apply(processor);
+        processor->setDurability(OutputCommitter::Durability(m_durabilityComboBox->currentData().toInt()));
+        processor->setChecksums(IntegrityManifest::Coverage(m_checksumComboBox->currentData().toInt()));
+        processor->setCompressionLevel(FrameCodec::isAvailable() ? m_compressionSpinBox->value() : 0);
+        processor->setRestore(m_restoreCheckBox->isChecked());
+        processor->setBundleOutput(m_bundleCheckBox->isChecked());
+        processor->setWorkerCount(m_workerCountSpinBox->value());
+        processor->setSplitLargeFiles(m_splitLargeFilesCheckBox->isChecked());
+        processor->setSplitChunkSize(qint64(m_splitChunkSizeSpinBox->value()) * 1024 * 1024);
+        processor->setSplitThreadCount(m_workerCountSpinBox->value());
+        processor->setScanIndexDirectory(m_scanIndexCheckBox->isChecked()
+                                         ? QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation) + "/FileModifier"
+                                         : QString());
+        processor->setMetricsFile(profileFile(m_metricsFileEdit->text().trimmed(), i));
+        processor->setResume(m_resumeCheckBox->isChecked());
+        processor->setPrefetch(Prefetcher::DefaultLookahead, qint64(m_prefetchSpinBox->value()) * 1024 * 1024);
+        processor->setDropCache(m_dropCacheCheckBox->isChecked());
+        processor->setMaxOpenFiles(m_openFilesLimit);
+        processor->setBufferSize(m_bufferSizeSpinBox->value() * 1024);
+        processor->setQueueDepth(m_queueDepthSpinBox->value());
+        processor->setIoBackend(IoPipeline::Backend(m_ioBackendComboBox->currentData().toInt()));
+        // Figures shown in the window start from zero with every start
+        processor->resetMetrics();
+        m_profileTable->item(i, FilesColumn)->setText(QString());
+        m_profileTable->item(i, SpeedColumn)->setText(QString());
+    }
+    applyLiveSettings();
+    
+    updateUIState(true);
+    m_log->append(OperationLog::Info, "Начало обработки файлов...");
+    
+    if (m_timerModeCheckBox->isChecked() && m_watchModeCheckBox->isChecked()) {
+        QString error;
+        for (int i = 0; i < m_jobs.size() && error.isEmpty(); ++i) {
+            if (!startWatcher(i)) {
+                error = profilePrefix(i) + m_jobs.at(i).watcher->errorString();
+            }
+        }
+        if (error.isEmpty()) {
+            m_log->append(OperationLog::Info, "Отслеживание новых файлов запущено");
+            
+            // Catch up on files that arrived while nobody was watching
+            for (const ProfileJob &job : m_jobs) {
+                job.processor->queueRun();
+            }
+            return;
+        }
+        for (const ProfileJob &job : m_jobs) {
+            job.watcher->stop();
+        }
+        m_log->append(OperationLog::Warning, QString("Отслеживание недоступно (%1), используется опрос по таймеру").arg(error));
+    }
+    
+    if (m_timerModeCheckBox->isChecked()) {
+        m_timer->start(m_timerIntervalSpinBox->value());
+        m_log->append(OperationLog::Info, QString("Таймер запущен с интервалом %1 мс").arg(m_timerIntervalSpinBox->value()));
+    } else {
+        for (const ProfileJob &job : m_jobs) {
+            job.processor->queueRun();
+        }
+    }
+}
+
+void MainWindow::applyLiveSettings()
+{
+    // The settings outside the profiles that a run takes over; the
+    // bandwidth limits are shared by all profiles
+    m_readThrottle.setRate(qint64(m_readLimitSpinBox->value()) * 1024 * 1024);
+    m_writeThrottle.setRate(qint64(m_writeLimitSpinBox->value()) * 1024 * 1024);
+    for (const ProfileJob &job : m_jobs) {
+        job.processor->setSchedulingOrder(FileQueue::Order(m_schedulingComboBox->currentData().toInt()));
+    }
+}
+
+QStringList MainWindow::watchSettings(int index) const
+{
+    const JobProfile &profile = m_profiles.at(index);
+    return QStringList() << (profile.inputPath.isEmpty() ? QDir::currentPath() : profile.inputPath)
+                         << profile.inputMask << profile.outputPath;
+}
+
+bool MainWindow::startWatcher(int index)
+{
+    ProfileJob &job = m_jobs[index];
+    const JobProfile &profile = m_profiles.at(index);
+    const QString inputPath = profile.inputPath.isEmpty() ? QDir::currentPath() : profile.inputPath;
+    job.watcher->stop();
+    job.watcher->setFilter(GlobMatcher(profile.inputMask));
+    job.watcher->setExcludedPath(QDir(profile.outputPath) == QDir(inputPath) ? QString() : profile.outputPath);
+    job.watchedSettings = watchSettings(index);
+    return job.watcher->start(inputPath);
+}
+
+void MainWindow::onLiveSettingsChanged()
+{
+    if (m_showingProfile) {
+        return;
+    }
+    storeProfile();
+    
+    // Before a start everything is read when it is pressed
+    if (!m_running || !validateProfile(m_profiles.at(m_currentProfile))) {
+        return;
+    }
+    
+    ProfileJob &job = m_jobs[m_currentProfile];
+    m_profiles.at(m_currentProfile).apply(job.processor);
+    applyLiveSettings();
+    m_log->append(OperationLog::Info, profilePrefix(m_currentProfile) + "Настройки изменены, новые файлы обрабатываются с ними");
+    
+    if (job.watcher->isActive() && job.watchedSettings != watchSettings(m_currentProfile)) {
+        if (!startWatcher(m_currentProfile)) {
+            m_log->append(OperationLog::Warning, QString("%1Отслеживание недоступно (%2), используется опрос по таймеру")
+                          .arg(profilePrefix(m_currentProfile)).arg(job.watcher->errorString()));
+            m_timer->start(m_timerIntervalSpinBox->value());
+        }
+        // Files the new folder or mask already has
+        job.processor->queueRun();
+    }
+}
+
+void MainWindow::onStopButtonClicked()
+{
+    m_timer->stop();
+    for (const ProfileJob &job : m_jobs) {
+        job.watcher->stop();
+        job.processor->stopProcessing();
+    }
+    updateUIState(false);
+    m_log->append(OperationLog::Info, "Обработка остановлена");
+}
+
+void MainWindow::onPauseButtonClicked()
+{
+    // Only the selected profile; the others go on with the shared workers
+    FileProcessor *processor = m_jobs.at(m_currentProfile).processor;
+    QString state = m_profileTable->item(m_currentProfile, StateColumn)->text();
+    if (state.startsWith(PausedPrefix)) {
+        state = state.mid(PausedPrefix.size());
+    }
+    if (processor->isPaused()) {
+        processor->resumeProcessing();
+        m_pauseButton->setText("Пауза");
+        m_log->append(OperationLog::Info, profilePrefix(m_currentProfile) + "Обработка продолжена");
+    } else {
+        processor->pauseProcessing();
+        m_pauseButton->setText("Продолжить");
+        m_log->append(OperationLog::Info, profilePrefix(m_currentProfile) + "Обработка приостановлена");
+    }
+    showState(m_currentProfile, state);
+}
+
+void MainWindow::showState(int index, const QString &status)
+{
+    // A paused profile says so in front of its last report
+    const QString state = m_jobs.at(index).processor->isPaused() ? PausedPrefix + status : status;
+    m_profileTable->item(index, StateColumn)->setText(state);
+    if (index == m_currentProfile) {
+        m_statusLabel->setText(state);
+    }
+}
+
+void MainWindow::onVerifyButtonClicked()
+{
+    const QString manifest = QFileDialog::getOpenFileName(this, "Выберите манифест", m_outputPathEdit->text(),
+                                                          "Манифест (*.fmmanifest)");
+    if (manifest.isEmpty()) {
+        return;
+    }
+    
+    // The selected profile's processor carries the check
+    FileProcessor *processor = m_jobs.at(m_currentProfile).processor;
+    processor->setWorkerCount(m_workerCountSpinBox->value());
+    processor->resetMetrics();
+    updateUIState(true);
+    m_log->append(OperationLog::Info, QString("Проверка по манифесту: %1").arg(manifest));
+    processor->queueVerify(manifest);
+}
+
+void MainWindow::onExtractButtonClicked()
+{
+    const QStringList bundles = QFileDialog::getOpenFileNames(this, "Выберите пакеты", m_outputPathEdit->text(),
+                                                              "Пакеты (*.fmbundle)");
+    if (bundles.isEmpty()) {
+        return;
+    }
+    const QString directory = QFileDialog::getExistingDirectory(this, "Папка для извлечённых файлов",
+                                                                m_outputPathEdit->text());
+    if (directory.isEmpty()) {
+        return;
+    }
+    
+    // Bundles hold one batch of small files each, a few megabytes at most
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    int total = 0;
+    for (const QString &bundle : bundles) {
+        int extracted = 0;
+        QString error;
+        if (FileBundle::extract(bundle, directory, &extracted, &error)) {
+            m_log->append(OperationLog::Info, QString("Извлечено файлов из %1: %2").arg(bundle).arg(extracted));
+        } else {
+            m_log->append(OperationLog::Error, QString("Ошибка извлечения из %1: %2").arg(bundle).arg(error));
+        }
+        total += extracted;
+    }
+    QApplication::restoreOverrideCursor();
+    m_statusLabel->setText(QString("Извлечено файлов: %1").arg(total));
+}
+
+void MainWindow::onBrowseInputPathClicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "Выберите папку с файлами");
+    if (!dir.isEmpty()) {
+        m_inputPath = dir;
+        m_inputPathEdit->setText(dir);
+        m_log->append(OperationLog::Info, QString("Установлена папка: %1").arg(dir));
+        onLiveSettingsChanged();
+    }
+}
+
+void MainWindow::onBrowseOutputPathClicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "Выберите папку для сохранения");
+    if (!dir.isEmpty()) {
+        m_outputPathEdit->setText(dir);
+        onLiveSettingsChanged();
+    }
+}
+
+void MainWindow::onTimerTimeout()
+{
+    // A tick during a run is merged into one scan after it
+    for (const ProfileJob &job : m_jobs) {
+        job.processor->queueRun();
+    }
+}
+
+void MainWindow::onWatchedFilesAdded(const QStringList &files)
+{
+    // Files reported while a run is busy are collected for the next one
+    const int index = jobIndex(sender());
+    if (index >= 0) {
+        m_jobs.at(index).processor->queueRun(files);
+    }
+}
+
+void MainWindow::onRescanRequired()
+{
+    const int index = jobIndex(sender());
+    if (index < 0) {
+        return;
+    }
+    m_log->append(OperationLog::Warning, profilePrefix(index) + "Очередь событий переполнена, выполняется полное сканирование");
+    m_jobs.at(index).processor->queueRun();
+}
+
+void MainWindow::onProcessingProgress(int progress)
+{
+    if (jobIndex(sender()) == m_currentProfile) {
+        m_progressBar->setValue(progress);
+    }
+}
+
+void MainWindow::onProcessingFinished()
+{
+    const int index = jobIndex(sender());
+    if (index >= 0) {
+        m_log->append(OperationLog::Info, profilePrefix(index) + "Обработка завершена");
+    }
+}
+
+void MainWindow::onProcessorIdle()
+{
+    // Timer and watch modes keep running until stopped, and the other
+    // profiles may still be busy
+    if (m_timer->isActive()) {
+        return;
+    }
+    for (const ProfileJob &job : m_jobs) {
+        if (job.watcher->isActive() || job.processor->isBusy()) {
+            return;
+        }
+    }
+    updateUIState(false);
+}
+
+void MainWindow::onStatusChanged(const QString &status)
+{
+    const int index = jobIndex(sender());
+    if (index < 0) {
+        return;
+    }
+    showState(index, status);
+}
+
+void MainWindow::onProcessingError(const QString &error)
+{
+    // Only to the log: with several profiles a dialog per error would hold
+    // up the window
+    const int index = jobIndex(sender());
+    const QString prefix = index >= 0 ? profilePrefix(index) : QString();
+    m_log->append(OperationLog::Error, QString("%1Ошибка: %2").arg(prefix).arg(error));
+}
+
+void MainWindow::onProgressUpdated(const ProcessingProgress &progress)
+{
+    const int index = jobIndex(sender());
+    if (index < 0) {
+        return;
+    }
+    const QLocale locale;
+    m_profileTable->item(index, FilesColumn)->setText(progress.scanComplete
+                                                      ? QString("%1 из %2").arg(progress.filesDone).arg(progress.filesTotal)
+                                                      : QString("%1 из %2+").arg(progress.filesDone).arg(progress.filesTotal));
+    
+    if (!progress.scanComplete) {
+        showState(index, QString("Поиск файлов... найдено: %1, обработано: %2")
+                  .arg(progress.filesTotal).arg(progress.filesDone));
+        return;
+    }
+    
+    QString status = QString("Обработано %1 из %2 файлов (%3 из %4), %5/с")
+            .arg(progress.filesDone).arg(progress.filesTotal)
+            .arg(locale.formattedDataSize(progress.bytesDone))
+            .arg(locale.formattedDataSize(progress.bytesTotal))
+            .arg(locale.formattedDataSize(qint64(progress.bytesPerSecond)));
+    if (progress.etaSeconds >= 0) {
+        status += QString(", осталось %1").arg(formatEta(progress.etaSeconds));
+    }
+    if (!progress.currentFile.isEmpty() && progress.filesDone < progress.filesTotal) {
+        status += QString(" - %1").arg(progress.currentFile);
+    }
+    showState(index, status);
+}
+
+void MainWindow::onFilesProcessed(const QStringList &filenames)
+{
+    const int index = jobIndex(sender());
+    const QString prefix = index >= 0 ? profilePrefix(index) : QString();
+    QStringList messages;
+    messages.reserve(filenames.size());
+    for (const QString &filename : filenames) {
+        messages.append(QString("%1Обработан файл: %2").arg(prefix).arg(filename));
+    }
+    m_log->append(OperationLog::Detail, messages);
+}
+
+void MainWindow::onLogFileChanged()
+{
+    const QString path = m_logFileEdit->text().trimmed();
+    if (path == m_log->logFile()) {
+        return;
+    }
+    if (!m_log->setLogFile(path)) {
+        m_log->append(OperationLog::Error, QString("Не удалось открыть файл лога: %1").arg(path));
+    }
+}
+
+void MainWindow::onMetricsUpdated(const ProcessingMetrics::Snapshot &metrics)
+{
+    const int index = jobIndex(sender());
+    if (index < 0) {
+        return;
+    }
+    // Throughput over the time the profile was processing
+    m_profileTable->item(index, SpeedColumn)->setText(QString("%1 файлов/с, %2 МБ/с")
+                                                      .arg(metrics.filesPerSecond, 0, 'f', 1)
+                                                      .arg(metrics.bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1));
+    if (index != m_currentProfile) {
+        return;
+    }
+    
+    // Totals per stage show where the time goes: scanning, I/O or XOR
+    QStringList stages;
+    QStringList details;
+    for (int i = 0; i < ProcessingMetrics::StageCount; ++i) {
+        const ProcessingMetrics::Stats &stats = metrics.stages[i];
+        if (stats.count == 0) {
+            continue;
+        }
+        const char *name = ProcessingMetrics::stageName(ProcessingMetrics::Stage(i));
+        stages.append(QString("%1 %2").arg(name).arg(formatDuration(stats.totalNsecs)));
+        details.append(QString("%1: %2 операций, p50 %3, p90 %4, p99 %5, макс. %6")
+                       .arg(name).arg(stats.count)
+                       .arg(formatDuration(stats.p50Nsecs)).arg(formatDuration(stats.p90Nsecs))
+                       .arg(formatDuration(stats.p99Nsecs)).arg(formatDuration(stats.maxNsecs)));
+    }
+    
+    m_metricsLabel->setText(QString("Файлов: %1 (%2/с), %3 МБ (%4 МБ/с), на файл p50 %5, p99 %6\n%7")
+                            .arg(metrics.files)
+                            .arg(metrics.filesPerSecond, 0, 'f', 1)
+                            .arg(metrics.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                            .arg(metrics.bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1)
+                            .arg(formatDuration(metrics.fileLatency.p50Nsecs))
+                            .arg(formatDuration(metrics.fileLatency.p99Nsecs))
+                            .arg(stages.join(" · ")));
+    m_metricsLabel->setToolTip(details.join("\n"));
+    m_metricsLabel->setVisible(true);
+}
+
+void MainWindow::updateUIState(bool processing)
+{
+    m_running = processing;
+    m_startButton->setEnabled(!processing);
+    m_verifyButton->setEnabled(!processing);
+    m_extractButton->setEnabled(!processing);
+    m_stopButton->setEnabled(processing);
+    m_pauseButton->setEnabled(processing);
+    // Profiles are added and removed between runs
+    m_addProfileButton->setEnabled(!processing);
+    m_removeProfileButton->setEnabled(!processing && m_profiles.size() > 1);
+    m_pauseButton->setText("Пауза");
+    m_progressBar->setVisible(processing);
+    
+    if (processing) {
+        m_progressBar->setValue(0);
+    }
+}
+
+bool MainWindow::validateProfile(const JobProfile &profile)
+{
+    const QString title = m_profiles.size() > 1 ? QString("Ошибка в профиле %1").arg(profile.name) : QString("Ошибка");
+    if (profile.inputMask.isEmpty()) {
+        QMessageBox::warning(this, title, "Укажите маску файлов");
+        return false;
+    }
+    
+    if (profile.outputPath.isEmpty()) {
+        QMessageBox::warning(this, title, "Укажите путь для сохранения");
+        return false;
+    }
+    
+    if (!QDir(profile.outputPath).exists()) {
+        QMessageBox::warning(this, title, "Папка для сохранения не существует");
+        return false;
+    }
+    
+    TransformChain transform;
+    QString error;
+    if (!TransformChain::parse(profile.transform, &transform, &error)) {
+        QMessageBox::warning(this, title, QString("Неверное преобразование: %1").arg(error));
+        return false;
+    }
+    
+    return true;
+}
+
+bool MainWindow::validateInputs()
+{
+    QStringList outputPaths;
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        if (!validateProfile(m_profiles.at(i))) {
+            showProfile(i);
+            return false;
+        }
+        
+        // The journal, manifest and output names of a folder belong to one run
+        const QString outputPath = QDir::cleanPath(QFileInfo(m_profiles.at(i).outputPath).absoluteFilePath());
+        const int other = outputPaths.indexOf(outputPath);
+        if (other >= 0) {
+            showProfile(i);
+            QMessageBox::warning(this, "Ошибка", QString("Профили %1 и %2 сохраняют файлы в одну папку")
+                                 .arg(m_profiles.at(other).name).arg(m_profiles.at(i).name));
+            return false;
+        }
+        outputPaths.append(outputPath);
+    }
+    return true;
+}
+
+void MainWindow::saveSettings()
+{
+    QSettings settings("FileModifier", "Settings");
+    storeProfile();
+    JobProfile::save(settings, m_profiles);
+    settings.setValue("currentProfile", m_currentProfile);
+    // Kept in the profiles from now on
+    for (const char *key : {"inputMask", "inputPath", "outputPath", "deleteInput", "fileConflictMode", "transform", "xorValue"}) {
+        settings.remove(key);
+    }
+    settings.setValue("durability", m_durabilityComboBox->currentIndex());
+    settings.setValue("checksums", m_checksumComboBox->currentIndex());
+    settings.setValue("compressionLevel", m_compressionSpinBox->value());
+    settings.setValue("restore", m_restoreCheckBox->isChecked());
+    settings.setValue("bundleOutput", m_bundleCheckBox->isChecked());
+    settings.setValue("timerMode", m_timerModeCheckBox->isChecked());
+    settings.setValue("timerInterval", m_timerIntervalSpinBox->value());
+    settings.setValue("watchMode", m_watchModeCheckBox->isChecked());
+    settings.setValue("workerCount", m_workerCountSpinBox->value());
+    settings.setValue("splitLargeFiles", m_splitLargeFilesCheckBox->isChecked());
+    settings.setValue("splitChunkSize", m_splitChunkSizeSpinBox->value());
+    settings.setValue("scanIndex", m_scanIndexCheckBox->isChecked());
+    settings.setValue("metricsFile", m_metricsFileEdit->text());
+    settings.setValue("resume", m_resumeCheckBox->isChecked());
+    settings.setValue("prefetch", m_prefetchSpinBox->value());
+    settings.setValue("dropCache", m_dropCacheCheckBox->isChecked());
+    settings.setValue("schedulingOrder", m_schedulingComboBox->currentIndex());
+    settings.setValue("readLimit", m_readLimitSpinBox->value());
+    settings.setValue("writeLimit", m_writeLimitSpinBox->value());
+    settings.setValue("maxOpenFiles", m_maxOpenFilesSpinBox->value());
+    settings.setValue("bufferSize", m_bufferSizeSpinBox->value());
+    settings.setValue("queueDepth", m_queueDepthSpinBox->value());
+    settings.setValue("ioBackend", m_ioBackendComboBox->currentIndex());
+    settings.setValue("logLevel", m_logLevelComboBox->currentIndex());
+    settings.setValue("logFile", m_logFileEdit->text());
+}
+
+void MainWindow::loadSettings()
+{
+    QSettings settings("FileModifier", "Settings");
+    QList<JobProfile> profiles = JobProfile::load(settings);
+    if (profiles.isEmpty()) {
+        // Settings saved before profiles describe a single job
+        JobProfile profile;
+        profile.name = "Основной";
+        profile.inputMask = settings.value("inputMask", profile.inputMask).toString();
+        profile.inputPath = settings.value("inputPath", "").toString();
+        profile.outputPath = settings.value("outputPath", QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)).toString();
+        profile.deleteInput = settings.value("deleteInput", false).toBool();
+        profile.fileConflictMode = settings.value("fileConflictMode", 0).toInt();
+        // Settings saved before chains hold only the XOR key, which parses as an xor stage
+        profile.transform = settings.value("transform", settings.value("xorValue", profile.transform)).toString();
+        profiles.append(profile);
+    }
+    for (const JobProfile &profile : profiles) {
+        addJob(profile);
+    }
+    showProfile(qBound(0, settings.value("currentProfile", 0).toInt(), int(m_profiles.size()) - 1));
+    m_removeProfileButton->setEnabled(m_profiles.size() > 1);
+    
+    m_durabilityComboBox->setCurrentIndex(settings.value("durability", int(OutputCommitter::None)).toInt());
+    m_checksumComboBox->setCurrentIndex(settings.value("checksums", 0).toInt());
+    m_compressionSpinBox->setValue(settings.value("compressionLevel", 0).toInt());
+    m_restoreCheckBox->setChecked(settings.value("restore", false).toBool());
+    m_bundleCheckBox->setChecked(settings.value("bundleOutput", false).toBool());
+    m_timerModeCheckBox->setChecked(settings.value("timerMode", false).toBool());
+    m_timerIntervalSpinBox->setValue(settings.value("timerInterval", 5000).toInt());
+    m_watchModeCheckBox->setChecked(settings.value("watchMode", DirectoryWatcher::isSupported()).toBool());
+    m_workerCountSpinBox->setValue(settings.value("workerCount", 0).toInt());
+    m_splitLargeFilesCheckBox->setChecked(settings.value("splitLargeFiles", false).toBool());
+    m_splitChunkSizeSpinBox->setValue(settings.value("splitChunkSize", 64).toInt());
+    m_scanIndexCheckBox->setChecked(settings.value("scanIndex", false).toBool());
+    m_metricsFileEdit->setText(settings.value("metricsFile", "").toString());
+    m_resumeCheckBox->setChecked(settings.value("resume", true).toBool());
+    m_prefetchSpinBox->setValue(settings.value("prefetch", 128).toInt());
+    m_dropCacheCheckBox->setChecked(settings.value("dropCache", false).toBool());
+    m_schedulingComboBox->setCurrentIndex(settings.value("schedulingOrder", 0).toInt());
+    m_readLimitSpinBox->setValue(settings.value("readLimit", 0).toInt());
+    m_writeLimitSpinBox->setValue(settings.value("writeLimit", 0).toInt());
+    m_maxOpenFilesSpinBox->setValue(settings.value("maxOpenFiles", 0).toInt());
+    m_bufferSizeSpinBox->setValue(settings.value("bufferSize", 1024).toInt());
+    m_queueDepthSpinBox->setValue(settings.value("queueDepth", 4).toInt());
+    m_ioBackendComboBox->setCurrentIndex(settings.value("ioBackend", 0).toInt());
+    m_logLevelComboBox->setCurrentIndex(settings.value("logLevel", 0).toInt());
+    m_logFileEdit->setText(settings.value("logFile", "").toString());
+    onLogFileChanged();
+}
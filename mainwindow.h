@@ -1,82 +1,163 @@
-#ifndef MAINWINDOW_H
-#define MAINWINDOW_H
-
-#include <QMainWindow>
-#include <QTimer>
-#include <QThread>
-#include <QProgressBar>
-#include <QLabel>
-#include <QLineEdit>
-#include <QCheckBox>
-#include <QComboBox>
-#include <QSpinBox>
-#include <QPushButton>
-#include <QTextEdit>
-#include <QFileDialog>
-#include <QGroupBox>
-#include <QVBoxLayout>
-#include <QHBoxLayout>
-#include <QGridLayout>
-#include <QMessageBox>
-#include <QSettings>
-#include "fileprocessor.h"
-
-QT_BEGIN_NAMESPACE
-namespace Ui { class MainWindow; }
-QT_END_NAMESPACE
-
-class MainWindow : public QMainWindow
-{
-    Q_OBJECT
-
-public:
-    MainWindow(QWidget *parent = nullptr);
-    ~MainWindow();
-
-private slots:
-    void onStartButtonClicked();
-    void onStopButtonClicked();
-    void onBrowseInputPathClicked();
-    void onBrowseOutputPathClicked();
-    void onTimerTimeout();
-    void onProcessingProgress(int progress);
-    void onProcessingFinished();
-    void onProcessingError(const QString &error);
-    void onFileProcessed(const QString &filename);
-    void saveSettings();
-    void loadSettings();
-
-private:
-    Ui::MainWindow *ui;
-    QTimer *m_timer;
-    FileProcessor *m_processor;
-    QThread *m_processorThread;
-    QProgressBar *m_progressBar;
-    QLabel *m_statusLabel;
-    QTextEdit *m_logTextEdit;
-    
-    // UI Elements
-    QLineEdit *m_inputMaskEdit;
-    QLineEdit *m_inputPathEdit;
-    QCheckBox *m_deleteInputCheckBox;
-    QLineEdit *m_outputPathEdit;
-    QComboBox *m_fileConflictComboBox;
-    QCheckBox *m_timerModeCheckBox;
-    QSpinBox *m_timerIntervalSpinBox;
-    QLineEdit *m_xorValueEdit;
-    QPushButton *m_startButton;
-    QPushButton *m_stopButton;
-    QPushButton *m_browseInputButton;
-    QPushButton *m_browseOutputButton;
-    QString m_inputPath;
-    
-    void setupUI();
-    void connectSignals();
-    void updateUIState(bool processing);
-    bool validateInputs();
-    QString getXorValue();
-    bool isValidXorValue(const QString &value);
-    QByteArray parseXorValue(const QString &value);
-};
-
-#endif // MAINWINDOW_H 
\ No newline at end of file
+#ifndef MAINWINDOW_H
+#define MAINWINDOW_H
+
+#include <QMainWindow>
+#include <QTimer>
+#include <QThread>
+#include <QProgressBar>
+#include <QLabel>
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QPushButton>
+#include <QListView>
+#include <QTableWidget>
+#include <QThreadPool>
+#include <QFileDialog>
+#include <QGroupBox>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QGridLayout>
+#include <QMessageBox>
+#include <QSettings>
+#include <QSemaphore>
+#include "fileprocessor.h"
+#include "directorywatcher.h"
+#include "operationlog.h"
+#include "jobprofile.h"
+
+QT_BEGIN_NAMESPACE
+namespace Ui { class MainWindow; }
+QT_END_NAMESPACE
+
+class MainWindow : public QMainWindow
+{
+    Q_OBJECT
+
+public:
+    MainWindow(QWidget *parent = nullptr);
+    ~MainWindow();
+
+private slots:
+    void onStartButtonClicked();
+    void onStopButtonClicked();
+    void onPauseButtonClicked();
+    void onVerifyButtonClicked();
+    void onExtractButtonClicked();
+    void onAddProfileClicked();
+    void onRenameProfileClicked();
+    void onRemoveProfileClicked();
+    void onProfileSelected();
+    void onBrowseInputPathClicked();
+    void onBrowseOutputPathClicked();
+    void onTimerTimeout();
+    void onWatchedFilesAdded(const QStringList &files);
+    void onRescanRequired();
+    void onLiveSettingsChanged();
+    void onProcessingProgress(int progress);
+    void onProgressUpdated(const ProcessingProgress &progress);
+    void onProcessingFinished();
+    void onProcessorIdle();
+    void onStatusChanged(const QString &status);
+    void onProcessingError(const QString &error);
+    void onFilesProcessed(const QStringList &filenames);
+    void onMetricsUpdated(const ProcessingMetrics::Snapshot &metrics);
+    void onLogFileChanged();
+    void saveSettings();
+    void loadSettings();
+
+private:
+    // Runs one profile; created and removed with the profile
+    struct ProfileJob {
+        FileProcessor *processor;
+        QThread *thread;
+        DirectoryWatcher *watcher;
+        // Folder, mask and output path the watcher was started with
+        QStringList watchedSettings;
+    };
+    
+    Ui::MainWindow *ui;
+    QTimer *m_timer;
+    // Workers of all profiles
+    QThreadPool *m_workerPool;
+    // The bandwidth and open-file limits hold for all profiles together
+    Throttle m_readThrottle;
+    Throttle m_writeThrottle;
+    QSemaphore m_openFiles;
+    int m_openFilesLimit;           // permits of m_openFiles, 0 without a limit
+    QList<JobProfile> m_profiles;
+    QList<ProfileJob> m_jobs;       // in the order of m_profiles
+    int m_currentProfile;           // the one the settings above show
+    bool m_showingProfile;          // the settings are being filled in, not edited
+    bool m_running;
+    QTableWidget *m_profileTable;
+    QPushButton *m_addProfileButton;
+    QPushButton *m_renameProfileButton;
+    QPushButton *m_removeProfileButton;
+    QProgressBar *m_progressBar;
+    QLabel *m_statusLabel;
+    QLabel *m_metricsLabel;
+    OperationLog *m_log;
+    OperationLogFilter *m_logFilter;
+    QListView *m_logView;
+    QComboBox *m_logLevelComboBox;
+    QLineEdit *m_logFileEdit;
+    
+    // UI Elements
+    QLineEdit *m_inputMaskEdit;
+    QLineEdit *m_inputPathEdit;
+    QCheckBox *m_deleteInputCheckBox;
+    QLineEdit *m_outputPathEdit;
+    QComboBox *m_fileConflictComboBox;
+    QComboBox *m_durabilityComboBox;
+    QComboBox *m_checksumComboBox;
+    QSpinBox *m_compressionSpinBox;
+    QCheckBox *m_restoreCheckBox;
+    QCheckBox *m_bundleCheckBox;
+    QCheckBox *m_timerModeCheckBox;
+    QSpinBox *m_timerIntervalSpinBox;
+    QCheckBox *m_watchModeCheckBox;
+    QSpinBox *m_workerCountSpinBox;
+    QCheckBox *m_splitLargeFilesCheckBox;
+    QSpinBox *m_splitChunkSizeSpinBox;
+    QCheckBox *m_scanIndexCheckBox;
+    QLineEdit *m_metricsFileEdit;
+    QCheckBox *m_resumeCheckBox;
+    QSpinBox *m_prefetchSpinBox;
+    QCheckBox *m_dropCacheCheckBox;
+    QComboBox *m_schedulingComboBox;
+    QSpinBox *m_readLimitSpinBox;
+    QSpinBox *m_writeLimitSpinBox;
+    QSpinBox *m_maxOpenFilesSpinBox;
+    QSpinBox *m_bufferSizeSpinBox;
+    QSpinBox *m_queueDepthSpinBox;
+    QComboBox *m_ioBackendComboBox;
+    QLineEdit *m_transformEdit;
+    QPushButton *m_startButton;
+    QPushButton *m_stopButton;
+    QPushButton *m_pauseButton;
+    QPushButton *m_verifyButton;
+    QPushButton *m_extractButton;
+    QPushButton *m_browseInputButton;
+    QPushButton *m_browseOutputButton;
+    QString m_inputPath;
+    
+    void setupUI();
+    void connectSignals();
+    void updateUIState(bool processing);
+    void addJob(const JobProfile &profile);
+    void removeJob(int index);
+    int jobIndex(QObject *object) const;
+    QString profilePrefix(int index) const;
+    void storeProfile();
+    void showProfile(int index);
+    void showState(int index, const QString &status);
+    void applyLiveSettings();
+    QStringList watchSettings(int index) const;
+    bool startWatcher(int index);
+    bool validateProfile(const JobProfile &profile);
+    bool validateInputs();
+};
+
+#endif // MAINWINDOW_H 
@@ -0,0 +1,235 @@
+#include "operationlog.h"
+#include <QDateTime>
+#include <QColor>
+#include <QBrush>
+#include <QFileInfo>
+#include <QDir>
+
+namespace {
+
+// Batches appends; far below what a person can read, far above the rate
+// at which relayouts would cost anything
+const int FlushInterval = 100;
+
+const char *levelName(OperationLog::Level level)
+{
+    switch (level) {
+    case OperationLog::Detail:
+        return "DETAIL";
+    case OperationLog::Warning:
+        return "WARN";
+    case OperationLog::Error:
+        return "ERROR";
+    default:
+        return "INFO";
+    }
+}
+
+} // namespace
+
+OperationLog::OperationLog(int capacity, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_capacity(qMax(capacity, 1))
+    , m_entries(m_capacity)
+    , m_first(0)
+    , m_count(0)
+    , m_fileSize(0)
+    , m_maxFileBytes(0)
+    , m_maxFiles(0)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushInterval);
+    connect(&m_flushTimer, &QTimer::timeout, this, &OperationLog::flush);
+}
+
+bool OperationLog::setLogFile(const QString &path, qint64 maxBytes, int maxFiles)
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_maxFileBytes = qMax<qint64>(maxBytes, 4096);
+    m_maxFiles = qMax(maxFiles, 0);
+    m_fileSize = 0;
+    
+    if (path.isEmpty()) {
+        m_file.setFileName(QString());
+        return true;
+    }
+    
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        m_file.setFileName(QString());
+        return false;
+    }
+    m_fileSize = m_file.size();
+    return true;
+}
+
+QString OperationLog::logFile() const
+{
+    return m_file.fileName();
+}
+
+void OperationLog::append(Level level, const QString &message)
+{
+    addPending(Entry{QDateTime::currentMSecsSinceEpoch(), level, message});
+}
+
+void OperationLog::append(Level level, const QStringList &messages)
+{
+    const qint64 time = QDateTime::currentMSecsSinceEpoch();
+    for (const QString &message : messages) {
+        addPending(Entry{time, level, message});
+    }
+}
+
+void OperationLog::addPending(Entry &&entry)
+{
+    if (m_file.isOpen()) {
+        writeToFile(entry);
+    }
+    
+    // Entries that would be pushed out by the same flush never reach the
+    // views; trimming in halves keeps a large batch linear
+    if (m_pending.size() >= 2 * m_capacity) {
+        m_pending.erase(m_pending.begin(), m_pending.end() - m_capacity);
+    }
+    m_pending.append(std::move(entry));
+    
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void OperationLog::flush()
+{
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    
+    const int skipped = qMax(int(m_pending.size()) - m_capacity, 0);
+    const int incoming = int(m_pending.size()) - skipped;
+    const int overflow = m_count + incoming - m_capacity;
+    if (overflow > 0) {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        for (int i = 0; i < overflow; ++i) {
+            m_entries[(m_first + i) % m_capacity].message.clear();
+        }
+        m_first = (m_first + overflow) % m_capacity;
+        m_count -= overflow;
+        endRemoveRows();
+    }
+    
+    beginInsertRows(QModelIndex(), m_count, m_count + incoming - 1);
+    for (int i = skipped; i < m_pending.size(); ++i) {
+        m_entries[(m_first + m_count) % m_capacity] = std::move(m_pending[i]);
+        ++m_count;
+    }
+    endInsertRows();
+    m_pending.clear();
+    
+    if (m_file.isOpen()) {
+        m_file.flush();
+    }
+}
+
+void OperationLog::clear()
+{
+    beginResetModel();
+    m_entries = QVector<Entry>(m_capacity);
+    m_first = 0;
+    m_count = 0;
+    m_pending.clear();
+    endResetModel();
+}
+
+int OperationLog::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_count;
+}
+
+QVariant OperationLog::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_count) {
+        return QVariant();
+    }
+    
+    const Entry &entry = m_entries[(m_first + index.row()) % m_capacity];
+    switch (role) {
+    case Qt::DisplayRole:
+        return QString("[%1] %2")
+                .arg(QDateTime::fromMSecsSinceEpoch(entry.time).toString("hh:mm:ss"))
+                .arg(entry.message);
+    case Qt::ToolTipRole:
+        return QString("%1 %2")
+                .arg(QDateTime::fromMSecsSinceEpoch(entry.time).toString("yyyy-MM-dd hh:mm:ss.zzz"))
+                .arg(entry.message);
+    case Qt::ForegroundRole:
+        if (entry.level == Error) {
+            return QBrush(Qt::red);
+        }
+        if (entry.level == Warning) {
+            return QBrush(QColor(160, 100, 0));
+        }
+        return QVariant();
+    case LevelRole:
+        return int(entry.level);
+    default:
+        return QVariant();
+    }
+}
+
+void OperationLog::writeToFile(const Entry &entry)
+{
+    const QByteArray line = QDateTime::fromMSecsSinceEpoch(entry.time).toString("yyyy-MM-dd hh:mm:ss.zzz").toUtf8()
+            + ' ' + levelName(entry.level) + ' ' + entry.message.toUtf8() + '\n';
+    if (m_fileSize > 0 && m_fileSize + line.size() > m_maxFileBytes) {
+        rotateFile();
+        if (!m_file.isOpen()) {
+            return;
+        }
+    }
+    
+    // QFile buffers; the buffer is written out with every flush
+    m_file.write(line);
+    m_fileSize += line.size();
+}
+
+void OperationLog::rotateFile()
+{
+    const QString path = m_file.fileName();
+    m_file.close();
+    
+    if (m_maxFiles > 0) {
+        QFile::remove(QString("%1.%2").arg(path).arg(m_maxFiles));
+        for (int i = m_maxFiles - 1; i >= 1; --i) {
+            QFile::rename(QString("%1.%2").arg(path).arg(i), QString("%1.%2").arg(path).arg(i + 1));
+        }
+        QFile::rename(path, path + ".1");
+    }
+    
+    m_file.setFileName(path);
+    m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text);
+    m_fileSize = 0;
+}
+
+OperationLogFilter::OperationLogFilter(QObject *parent)
+    : QSortFilterProxyModel(parent)
+    , m_minimumLevel(OperationLog::Detail)
+{
+}
+
+void OperationLogFilter::setMinimumLevel(OperationLog::Level level)
+{
+    if (level != m_minimumLevel) {
+        m_minimumLevel = level;
+        invalidateFilter();
+    }
+}
+
+bool OperationLogFilter::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    const QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+    return sourceModel()->data(index, OperationLog::LevelRole).toInt() >= m_minimumLevel;
+}
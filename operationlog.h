@@ -0,0 +1,92 @@
+#ifndef OPERATIONLOG_H
+#define OPERATIONLOG_H
+
+#include <QAbstractListModel>
+#include <QSortFilterProxyModel>
+#include <QVector>
+#include <QTimer>
+#include <QFile>
+
+// Operation log for the window. Entries live in a ring of fixed capacity,
+// so memory stays bounded however long a watch session runs; the oldest
+// entries are dropped first. Appends are collected and handed to views
+// in one insert per flush interval, and display strings are only built
+// for the rows a view actually shows. Optionally every entry is also
+// written to a log file that is rotated by size.
+class OperationLog : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Level {
+        Detail,     // one line per processed file
+        Info,
+        Warning,
+        Error
+    };
+
+    enum Roles {
+        LevelRole = Qt::UserRole + 1
+    };
+
+    explicit OperationLog(int capacity = 10000, QObject *parent = nullptr);
+
+    // Appends go to path; once it reaches maxBytes it becomes path.1, path.1
+    // becomes path.2 and so on, keeping maxFiles old files. An empty path
+    // stops writing.
+    bool setLogFile(const QString &path, qint64 maxBytes = 10 * 1024 * 1024, int maxFiles = 5);
+    QString logFile() const;
+
+    void append(Level level, const QString &message);
+    void append(Level level, const QStringList &messages);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    // Hands pending entries to the views; called by the flush timer
+    void flush();
+    void clear();
+
+private:
+    struct Entry {
+        qint64 time;
+        Level level;
+        QString message;
+    };
+
+    int m_capacity;
+    QVector<Entry> m_entries;
+    int m_first;
+    int m_count;
+    QVector<Entry> m_pending;
+    QTimer m_flushTimer;
+
+    QFile m_file;
+    qint64 m_fileSize;
+    qint64 m_maxFileBytes;
+    int m_maxFiles;
+
+    void addPending(Entry &&entry);
+    void writeToFile(const Entry &entry);
+    void rotateFile();
+};
+
+// Shows the entries at or above a minimum level
+class OperationLogFilter : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit OperationLogFilter(QObject *parent = nullptr);
+
+    void setMinimumLevel(OperationLog::Level level);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+
+private:
+    OperationLog::Level m_minimumLevel;
+};
+
+#endif // OPERATIONLOG_H
@@ -0,0 +1,353 @@
+#include "outputcommitter.h"
+#include "processingmetrics.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QVector>
+#include <QAtomicInteger>
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdio>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+const char TemporarySuffix[] = ".fmtmp";
+
+const int DefaultBatchFiles = 256;
+const int DefaultBatchMsec = 1000;
+
+QAtomicInteger<quint64> s_temporaryCounter(0);
+
+bool syncFile(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#else
+    Q_UNUSED(path)
+    return true;
+#endif
+}
+
+// Makes renames and removals in the directory durable
+bool syncDirectory(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // Some file systems do not support fsync on directories and need none
+    const bool synced = ::fsync(fd) == 0 || errno == EINVAL;
+    ::close(fd);
+    return synced;
+#else
+    Q_UNUSED(path)
+    return true;
+#endif
+}
+
+// One syncfs per file system holding a directory; false if that is not
+// available, in which case the files are synced one by one
+bool syncFileSystems(const QSet<QString> &directories)
+{
+#ifdef Q_OS_LINUX
+    QSet<quint64> synced;
+    for (const QString &directory : directories) {
+        const int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        bool ok = ::fstat(fd, &info) == 0;
+        if (ok && !synced.contains(quint64(info.st_dev))) {
+            ok = ::syncfs(fd) == 0;
+            synced.insert(quint64(info.st_dev));
+        }
+        ::close(fd);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+#else
+    Q_UNUSED(directories)
+    return false;
+#endif
+}
+
+// Atomically replaces target where the platform allows it
+bool replaceFile(const QString &source, const QString &target)
+{
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#else
+    QFile::remove(target);
+    return QFile::rename(source, target);
+#endif
+}
+
+// Moves source to target only if target does not exist, atomically where
+// the file system allows it; the name is claimed by the rename itself
+bool renameNoReplace(const QString &source, const QString &target)
+{
+#ifdef Q_OS_UNIX
+    const QByteArray from = QFile::encodeName(source);
+    const QByteArray to = QFile::encodeName(target);
+#if defined(Q_OS_LINUX) && defined(SYS_renameat2)
+    const int RenameNoReplace = 1;  // RENAME_NOREPLACE
+    if (::syscall(SYS_renameat2, AT_FDCWD, from.constData(), AT_FDCWD, to.constData(), RenameNoReplace) == 0) {
+        return true;
+    }
+    if (errno != ENOSYS && errno != EINVAL) {
+        return false;
+    }
+#endif
+    // A hard link fails on an existing name just the same
+    if (::link(from.constData(), to.constData()) == 0) {
+        ::unlink(from.constData());
+        return true;
+    }
+    if (errno != EPERM && errno != ENOTSUP && errno != EOPNOTSUPP) {
+        return false;
+    }
+    // No hard links either; the check and the rename are not atomic
+    return !QFile::exists(target) && ::rename(from.constData(), to.constData()) == 0;
+#else
+    return QFile::rename(source, target);
+#endif
+}
+
+} // namespace
+
+OutputCommitter::OutputCommitter()
+    : m_durability(None)
+    , m_batchFiles(DefaultBatchFiles)
+    , m_batchMsec(DefaultBatchMsec)
+    , m_metrics(nullptr)
+{
+}
+
+void OutputCommitter::setDurability(Durability durability)
+{
+    commitAll();
+    m_durability = durability;
+}
+
+void OutputCommitter::setBatchLimits(int files, int msec)
+{
+    m_batchFiles = qMax(files, 1);
+    m_batchMsec = qMax(msec, 0);
+}
+
+void OutputCommitter::setMetrics(ProcessingMetrics *metrics)
+{
+    m_metrics = metrics;
+}
+
+QString OutputCommitter::temporaryPath(const QString &target)
+{
+    const QFileInfo info(target);
+    return QString("%1/.%2.%3-%4%5").arg(info.absolutePath()).arg(info.fileName())
+            .arg(QCoreApplication::applicationPid()).arg(s_temporaryCounter.fetchAndAddRelaxed(1))
+            .arg(TemporarySuffix);
+}
+
+bool OutputCommitter::isTemporaryFile(const QString &fileName)
+{
+    return fileName.endsWith(TemporarySuffix) && QFileInfo(fileName).fileName().startsWith('.');
+}
+
+void OutputCommitter::removeStaleTemporaryFiles(const QString &directory, const QSet<QString> &keep)
+{
+    QDir dir(directory);
+    const QStringList names = dir.entryList(QStringList() << QString("*%1").arg(TemporarySuffix),
+                                            QDir::Files | QDir::Hidden);
+    for (const QString &name : names) {
+        if (!isTemporaryFile(name) || keep.contains(dir.absoluteFilePath(name))) {
+            continue;
+        }
+        // ".<file>.<pid>-<counter>.fmtmp"; files of live processes are in use
+        const QString stem = name.left(name.size() - int(sizeof(TemporarySuffix)) + 1);
+        const qint64 pid = stem.mid(stem.lastIndexOf('.') + 1).section('-', 0, 0).toLongLong();
+        if (pid <= 0 || pid == QCoreApplication::applicationPid()) {
+            continue;
+        }
+#ifdef Q_OS_UNIX
+        if (::kill(pid_t(pid), 0) == 0 || errno != ESRCH) {
+            continue;
+        }
+#endif
+        dir.remove(name);
+    }
+}
+
+void OutputCommitter::add(const Entry &entry)
+{
+    if (m_durability != Batch) {
+        QList<Entry> entries;
+        entries.append(entry);
+        commit(entries, m_durability == File);
+        return;
+    }
+
+    bool due;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pending.isEmpty()) {
+            m_batchAge.start();
+        }
+        m_pending.append(entry);
+        due = m_pending.size() >= m_batchFiles || m_batchAge.elapsed() >= m_batchMsec;
+    }
+    if (due) {
+        commitPending(true);
+    }
+}
+
+void OutputCommitter::commitIfDue()
+{
+    commitPending(true);
+}
+
+void OutputCommitter::commitAll()
+{
+    commitPending(false);
+}
+
+void OutputCommitter::commitPending(bool onlyIfDue)
+{
+    // A worker that finds a commit in progress goes back to work; its entry
+    // is picked up by the next batch
+    if (onlyIfDue) {
+        if (!m_commitMutex.tryLock()) {
+            return;
+        }
+    } else {
+        m_commitMutex.lock();
+    }
+
+    QList<Entry> entries;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!onlyIfDue || m_pending.size() >= m_batchFiles || m_batchAge.elapsed() >= m_batchMsec) {
+            entries.swap(m_pending);
+        }
+    }
+    if (!entries.isEmpty()) {
+        commit(entries, false);
+    }
+    m_commitMutex.unlock();
+}
+
+void OutputCommitter::commit(QList<Entry> &entries, bool syncEachFile)
+{
+    QVector<QString> errors(entries.size());
+    // The output is at its target, whatever happens to the directory sync
+    QVector<bool> inPlace(entries.size(), false);
+    QElapsedTimer timer;
+
+    // Data first: a rename must never become durable before the data it
+    // points to
+    if (m_durability != None) {
+        timer.start();
+        QSet<QString> directories;
+        for (const Entry &entry : entries) {
+            directories.insert(QFileInfo(entry.target).absolutePath());
+        }
+        if (syncEachFile || !syncFileSystems(directories)) {
+            for (int i = 0; i < entries.size(); ++i) {
+                if (!syncFile(entries.at(i).source)) {
+                    errors[i] = QString("Не удалось сохранить файл на диск: %1").arg(entries.at(i).source);
+                }
+            }
+        }
+        if (m_metrics) {
+            m_metrics->record(ProcessingMetrics::Fsync, timer.nsecsElapsed());
+        }
+    }
+
+    timer.start();
+    QSet<QString> directories;
+    int renamed = 0;
+    for (int i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries.at(i);
+        if (errors.at(i).isEmpty() && entry.source != entry.target) {
+            ++renamed;
+            if (entry.keepExisting ? renameNoReplace(entry.source, entry.target)
+                                   : replaceFile(entry.source, entry.target)) {
+                directories.insert(QFileInfo(entry.source).absolutePath());
+            } else {
+                errors[i] = QString("Не удалось переместить файл %1 в %2").arg(entry.source).arg(entry.target);
+            }
+        }
+        if (errors.at(i).isEmpty()) {
+            inPlace[i] = true;
+            directories.insert(QFileInfo(entry.target).absolutePath());
+        } else if (isTemporaryFile(entry.source)) {
+            QFile::remove(entry.source);
+        }
+    }
+    if (m_metrics && renamed > 0) {
+        m_metrics->record(ProcessingMetrics::Rename, timer.nsecsElapsed());
+    }
+
+    // One fsync per directory makes the whole batch of renames durable
+    QSet<QString> failedDirectories;
+    if (m_durability != None) {
+        timer.start();
+        for (const QString &directory : directories) {
+            if (!syncDirectory(directory)) {
+                failedDirectories.insert(directory);
+            }
+        }
+        if (m_metrics) {
+            m_metrics->record(ProcessingMetrics::Fsync, timer.nsecsElapsed());
+        }
+    }
+
+    // The output is in place but may not survive a crash while its
+    // directory is not synced; the input is kept so that nothing is lost
+    timer.start();
+    int removed = 0;
+    for (int i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries.at(i);
+        const QString directory = QFileInfo(entry.target).absolutePath();
+        if (errors.at(i).isEmpty() && failedDirectories.contains(directory)) {
+            errors[i] = QString("Не удалось сохранить на диск папку: %1").arg(directory);
+        } else if (errors.at(i).isEmpty()) {
+            for (const QString &path : entry.removeAfter) {
+                QFile::remove(path);
+                ++removed;
+            }
+        }
+    }
+    if (m_metrics && removed > 0) {
+        m_metrics->record(ProcessingMetrics::Delete, timer.nsecsElapsed());
+    }
+
+    for (int i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries.at(i);
+        if (entry.done) {
+            entry.done(inPlace.at(i), errors.at(i));
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef OUTPUTCOMMITTER_H
+#define OUTPUTCOMMITTER_H
+
+#include <QString>
+#include <QList>
+#include <QStringList>
+#include <QSet>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <functional>
+
+class ProcessingMetrics;
+
+// Makes finished outputs visible under their final names. Data is written
+// to a hidden temporary file next to the output and renamed over it once it
+// is durable, so a crash never leaves a truncated file that looks finished.
+// In Batch mode the cost of syncing is shared by a group of files: one
+// syncfs per file system (or one fsync per file where syncfs is missing),
+// the renames, then one fsync per touched directory. Inputs are deleted only
+// after the batch that holds their output is durable.
+class OutputCommitter
+{
+public:
+    enum Durability {
+        None,   // renamed at once, nothing is synced
+        Batch,  // group commit every batchFiles files or batchMsec ms
+        File    // every file is synced before its rename
+    };
+
+    // Called once per entry on whichever thread committed it
+    typedef std::function<void(bool committed, const QString &error)> Callback;
+
+    struct Entry {
+        QString source;           // finished data; renamed to target unless equal
+        QString target;
+        QStringList removeAfter;  // deleted once target is durable
+        bool keepExisting = false;  // an existing target fails the rename instead of being replaced
+        Callback done;
+    };
+
+    OutputCommitter();
+
+    void setDurability(Durability durability);
+    Durability durability() const { return m_durability; }
+    void setBatchLimits(int files, int msec);
+    void setMetrics(ProcessingMetrics *metrics);
+
+    // None and File commit the entry before returning; Batch queues it and
+    // commits the batch on the calling thread when it is full or old enough
+    void add(const Entry &entry);
+    // Commits the pending batch if its time limit has passed
+    void commitIfDue();
+    // Commits everything pending; called at the end of a run
+    void commitAll();
+
+    // Unique hidden name in the directory of target
+    static QString temporaryPath(const QString &target);
+    static bool isTemporaryFile(const QString &fileName);
+    // Removes temporary files left behind by a process that is no longer
+    // alive, except those in keep
+    static void removeStaleTemporaryFiles(const QString &directory, const QSet<QString> &keep);
+
+private:
+    Durability m_durability;
+    int m_batchFiles;
+    int m_batchMsec;
+    ProcessingMetrics *m_metrics;
+
+    QMutex m_mutex;          // guards m_pending and m_batchAge
+    QList<Entry> m_pending;
+    QElapsedTimer m_batchAge;
+    QMutex m_commitMutex;    // batches are committed one at a time, in order
+
+    void commitPending(bool onlyIfDue);
+    void commit(QList<Entry> &entries, bool syncEachFile);
+};
+
+#endif // OUTPUTCOMMITTER_H
@@ -0,0 +1,78 @@
+#include "outputnametable.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <QMutexLocker>
+
+QString OutputNameTable::numberedName(const QString &fileName, int counter)
+{
+    const QFileInfo info(fileName);
+    const QString suffix = info.completeSuffix();
+    if (suffix.isEmpty()) {
+        return QString("%1_%2").arg(info.baseName()).arg(counter);
+    }
+    return QString("%1_%2.%3").arg(info.baseName()).arg(counter).arg(suffix);
+}
+
+OutputNameTable::Directory &OutputNameTable::directoryFor(const QString &directory)
+{
+    auto it = m_directories.find(directory);
+    if (it != m_directories.end()) {
+        return it.value();
+    }
+
+    // The one listing of this directory; later files are tracked in the table
+    Directory &names = m_directories[directory];
+    const QStringList entries = QDir(directory).entryList(QDir::AllEntries | QDir::Hidden | QDir::System
+                                                          | QDir::NoDotAndDotDot);
+    names.taken.reserve(entries.size());
+    for (const QString &entry : entries) {
+        names.taken.insert(entry);
+    }
+    return names;
+}
+
+QString OutputNameTable::reserve(const QString &directory, const QString &fileName)
+{
+    const QString path = QDir::cleanPath(QDir(directory).absolutePath());
+
+    QMutexLocker locker(&m_mutex);
+    Directory &names = directoryFor(path);
+
+    QString name = fileName;
+    if (names.taken.contains(name)) {
+        // Counters only move forward, so each number is tried once per name
+        int &counter = names.nextCounter[fileName];
+        do {
+            name = numberedName(fileName, ++counter);
+        } while (names.taken.contains(name));
+    }
+
+    names.taken.insert(name);
+    return path + '/' + name;
+}
+
+void OutputNameTable::markTaken(const QString &path)
+{
+    const QFileInfo info(path);
+
+    QMutexLocker locker(&m_mutex);
+    directoryFor(info.absolutePath()).taken.insert(info.fileName());
+}
+
+void OutputNameTable::release(const QString &path)
+{
+    const QFileInfo info(path);
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_directories.find(info.absolutePath());
+    if (it != m_directories.end()) {
+        it.value().taken.remove(info.fileName());
+    }
+}
+
+void OutputNameTable::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_directories.clear();
+}
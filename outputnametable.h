@@ -0,0 +1,41 @@
+#ifndef OUTPUTNAMETABLE_H
+#define OUTPUTNAMETABLE_H
+
+#include <QString>
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+
+// Hands out free output names for the "add counter" conflict mode. Each
+// output directory is listed once; after that a name is found from the
+// table instead of probing the disk with _1, _2, ... for every file.
+// Reserved names stay taken until released, so concurrent workers never get
+// the same name. Files created by other programs after the listing are
+// caught by the caller, which checks the reserved name or claims it with an
+// exclusive create or rename, and calls markTaken on failure.
+class OutputNameTable
+{
+public:
+    // Returns directory/fileName if that name is free, otherwise the first
+    // free "base_N.suffix" for N = 1, 2, ...
+    QString reserve(const QString &directory, const QString &fileName);
+    void markTaken(const QString &path);
+    void release(const QString &path);
+    void clear();
+
+    // "a.tar.gz", 2 -> "a_2.tar.gz"; the counter goes before the first dot
+    static QString numberedName(const QString &fileName, int counter);
+
+private:
+    struct Directory {
+        QSet<QString> taken;
+        QHash<QString, int> nextCounter;
+    };
+
+    QHash<QString, Directory> m_directories;
+    QMutex m_mutex;
+
+    Directory &directoryFor(const QString &directory);
+};
+
+#endif // OUTPUTNAMETABLE_H
@@ -0,0 +1,134 @@
+#include "prefetcher.h"
+#include "filequeue.h"
+#include "processingmetrics.h"
+#include <QFile>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Prefetcher::Prefetcher()
+    : m_lookahead(0)
+    , m_budget(0)
+    , m_dropCache(false)
+    , m_metrics(nullptr)
+    , m_advisedBytes(0)
+{
+}
+
+bool Prefetcher::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Prefetcher::setLookahead(int files, qint64 budget)
+{
+    m_lookahead = qMax(0, files);
+    m_budget = qMax<qint64>(0, budget);
+}
+
+void Prefetcher::setDropCache(bool drop)
+{
+    m_dropCache = drop;
+}
+
+void Prefetcher::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_advised.clear();
+    m_advisedBytes = 0;
+}
+
+void Prefetcher::advance(const FileQueue &queue)
+{
+#ifdef Q_OS_LINUX
+    if (m_lookahead == 0 || m_budget == 0) {
+        return;
+    }
+
+    const QStringList upcoming = queue.upcoming(m_lookahead);
+    for (const QString &file : upcoming) {
+        qint64 available = 0;
+        {
+            // Claimed before the file is opened, so that two workers never
+            // advise the same file
+            QMutexLocker locker(&m_mutex);
+            available = m_budget - m_advisedBytes;
+            if (available <= 0) {
+                return;
+            }
+            if (m_advised.contains(file)) {
+                continue;
+            }
+            m_advised.insert(file, 0);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        qint64 length = 0;
+        const int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+                // A file larger than what is left gets its head read; the
+                // kernel's own read-ahead takes over from there
+                length = qMin<qint64>(st.st_size, available);
+                if (length > 0) {
+                    posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+                }
+            }
+            ::close(fd);
+        }
+        if (m_metrics) {
+            m_metrics->record(ProcessingMetrics::Prefetch, timer.nsecsElapsed(), length);
+        }
+
+        QMutexLocker locker(&m_mutex);
+        // Released meanwhile by a worker that was faster than the advice
+        auto it = m_advised.find(file);
+        if (it != m_advised.end()) {
+            it.value() = length;
+            m_advisedBytes += length;
+        }
+    }
+#else
+    Q_UNUSED(queue)
+#endif
+}
+
+void Prefetcher::release(const QString &file)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_advised.find(file);
+    if (it != m_advised.end()) {
+        m_advisedBytes -= it.value();
+        m_advised.erase(it);
+    }
+}
+
+void Prefetcher::drop(const QString &file)
+{
+#ifdef Q_OS_LINUX
+    if (!m_dropCache) {
+        return;
+    }
+    const int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // Dirty pages are only written back here and stay cached; outputs
+        // are dropped after their commit, when they are usually clean
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(file)
+#endif
+}
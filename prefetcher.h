@@ -0,0 +1,59 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QHash>
+#include <QMutex>
+
+class FileQueue;
+class ProcessingMetrics;
+
+// Asks the kernel to read the next files in the queue into the page cache
+// while the workers are busy with the current ones, so that on disks with
+// slow seeks a file is no longer opened cold after the previous one is
+// written. At most lookahead files and budget bytes are advised ahead of
+// the workers; a file's share is returned once a worker is done with it.
+// Optionally drops the pages of finished files again, so that a long run
+// does not push everything else out of the page cache.
+class Prefetcher
+{
+public:
+    // Files advised ahead of the workers unless set otherwise
+    static const int DefaultLookahead = 16;
+
+    Prefetcher();
+
+    // Zero files or bytes turns read-ahead off
+    void setLookahead(int files, qint64 budget);
+    void setDropCache(bool drop);
+    bool dropCache() const { return m_dropCache; }
+
+    // Advice calls are recorded there when set
+    void setMetrics(ProcessingMetrics *metrics) { m_metrics = metrics; }
+
+    // Forgets what the previous run advised
+    void reset();
+
+    // Called by a worker after it took a file from the queue
+    void advance(const FileQueue &queue);
+    // The worker is done reading the file
+    void release(const QString &file);
+    // A finished output, or an input that stays behind
+    void drop(const QString &file);
+
+    static bool isSupported();
+
+private:
+    int m_lookahead;
+    qint64 m_budget;
+    bool m_dropCache;
+    ProcessingMetrics *m_metrics;
+
+    // Files advised and not yet released, with the bytes each one holds
+    QMutex m_mutex;
+    QHash<QString, qint64> m_advised;
+    qint64 m_advisedBytes;
+};
+
+#endif // PREFETCHER_H
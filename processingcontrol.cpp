@@ -0,0 +1,77 @@
+#include "processingcontrol.h"
+#include "processingmetrics.h"
+#include <QMutexLocker>
+
+ProcessingControl::ProcessingControl()
+    : m_state(Running)
+    , m_requestedAt(0)
+    , m_metrics(nullptr)
+{
+    m_clock.start();
+}
+
+void ProcessingControl::requestStop()
+{
+    // Under the mutex, so that a worker about to wait for resume() sees it.
+    // A stop also ends a pause, which would otherwise hold the next run.
+    QMutexLocker locker(&m_mutex);
+    if (!(m_state.loadRelaxed() & Stopped)) {
+        stampRequest();
+    }
+    m_state.storeRelease(Stopped);
+    m_resumed.wakeAll();
+}
+
+void ProcessingControl::clearStop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.fetchAndAndOrdered(~Stopped);
+    m_requestedAt.storeRelease(0);
+}
+
+void ProcessingControl::pause()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!(m_state.loadRelaxed() & Paused)) {
+        stampRequest();
+        m_state.fetchAndOrOrdered(Paused);
+    }
+}
+
+void ProcessingControl::resume()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_state.fetchAndAndOrdered(~Paused) & Paused) {
+        // A pause nobody reached is not a latency sample
+        m_requestedAt.storeRelease(0);
+    }
+    m_resumed.wakeAll();
+}
+
+bool ProcessingControl::wait(int state)
+{
+    acknowledge();
+    if (state & Stopped) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    while ((m_state.loadAcquire() & (Stopped | Paused)) == Paused) {
+        m_resumed.wait(&m_mutex);
+    }
+    return !(m_state.loadAcquire() & Stopped);
+}
+
+void ProcessingControl::acknowledge()
+{
+    // Only the first worker to notice a request records it
+    const qint64 requestedAt = m_requestedAt.loadAcquire();
+    if (requestedAt > 0 && m_requestedAt.testAndSetOrdered(requestedAt, 0) && m_metrics) {
+        m_metrics->record(ProcessingMetrics::Control, m_clock.nsecsElapsed() - requestedAt);
+    }
+}
+
+void ProcessingControl::stampRequest()
+{
+    m_requestedAt.storeRelease(qMax<qint64>(1, m_clock.nsecsElapsed()));
+}
@@ -0,0 +1,64 @@
+#ifndef PROCESSINGCONTROL_H
+#define PROCESSINGCONTROL_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+
+class ProcessingMetrics;
+
+// Stop and pause requests for a run, shared by every thread that works on
+// it. Workers call checkpoint() between chunks; while nothing is requested
+// that is a single atomic load. A pause blocks the workers at their next
+// checkpoint until resume() or a stop, so both take effect within one chunk
+// even in the middle of a large file. The time from a request to the first
+// checkpoint that sees it is recorded as the Control stage.
+class ProcessingControl
+{
+public:
+    ProcessingControl();
+
+    void setMetrics(ProcessingMetrics *metrics) { m_metrics = metrics; }
+
+    // All of these may be called from any thread. A stop ends a pause.
+    void requestStop();
+    // Withdraws a stop request; a pause stays in effect
+    void clearStop();
+    void pause();
+    void resume();
+
+    bool isStopRequested() const { return m_state.loadAcquire() & Stopped; }
+    bool isPaused() const { return m_state.loadAcquire() & Paused; }
+
+    // False once a stop was requested; blocks while paused
+    bool checkpoint()
+    {
+        const int state = m_state.loadAcquire();
+        return state == Running || wait(state);
+    }
+
+private:
+    enum State {
+        Running = 0,
+        Stopped = 1,
+        Paused = 2
+    };
+
+    QAtomicInt m_state;
+    // m_clock time of the request no checkpoint has seen yet, 0 if none
+    QAtomicInteger<qint64> m_requestedAt;
+    QElapsedTimer m_clock;
+    QMutex m_mutex;
+    QWaitCondition m_resumed;
+    ProcessingMetrics *m_metrics;
+
+    bool wait(int state);
+    void acknowledge();
+    void stampRequest();
+
+    Q_DISABLE_COPY(ProcessingControl)
+};
+
+#endif // PROCESSINGCONTROL_H
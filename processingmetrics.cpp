@@ -0,0 +1,292 @@
+#include "processingmetrics.h"
+
+namespace {
+
+QJsonObject statsToJson(const ProcessingMetrics::Stats &stats)
+{
+    QJsonObject object;
+    object["count"] = qint64(stats.count);
+    object["bytes"] = stats.bytes;
+    object["totalSeconds"] = stats.totalNsecs / 1e9;
+    object["p50Seconds"] = stats.p50Nsecs / 1e9;
+    object["p90Seconds"] = stats.p90Nsecs / 1e9;
+    object["p99Seconds"] = stats.p99Nsecs / 1e9;
+    object["maxSeconds"] = stats.maxNsecs / 1e9;
+    return object;
+}
+
+void appendMetric(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+    out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+}
+
+void appendValue(QByteArray &out, const char *name, const QByteArray &labels, double value)
+{
+    out += name;
+    if (!labels.isEmpty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += QByteArray::number(value, 'g', 12);
+    out += '\n';
+}
+
+} // namespace
+
+ProcessingMetrics::Histogram::Histogram()
+{
+    reset();
+}
+
+void ProcessingMetrics::Histogram::reset()
+{
+    for (QAtomicInteger<quint64> &bucket : m_buckets) {
+        bucket.storeRelaxed(0);
+    }
+    m_count.storeRelaxed(0);
+    m_bytes.storeRelaxed(0);
+    m_totalNsecs.storeRelaxed(0);
+    m_maxNsecs.storeRelaxed(0);
+}
+
+int ProcessingMetrics::Histogram::bucketFor(quint64 nsecs)
+{
+    if (nsecs < 4) {
+        return int(nsecs);
+    }
+    // Four linear sub-buckets per power of two
+    int msb = 63;
+    while (!(nsecs >> msb)) {
+        --msb;
+    }
+    const int sub = int((nsecs >> (msb - 2)) & 3);
+    return 4 + (msb - 2) * 4 + sub;
+}
+
+qint64 ProcessingMetrics::Histogram::bucketValue(int bucket)
+{
+    if (bucket < 4) {
+        return bucket;
+    }
+    // Middle of the bucket's range
+    const int msb = (bucket - 4) / 4 + 2;
+    const int sub = (bucket - 4) % 4;
+    const quint64 lower = quint64(4 + sub) << (msb - 2);
+    return qint64(lower + ((quint64(1) << (msb - 2)) >> 1));
+}
+
+void ProcessingMetrics::Histogram::record(qint64 nsecs, qint64 bytes)
+{
+    nsecs = qMax<qint64>(nsecs, 0);
+    m_buckets[bucketFor(quint64(nsecs))].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_bytes.fetchAndAddRelaxed(bytes);
+    m_totalNsecs.fetchAndAddRelaxed(nsecs);
+    
+    qint64 max = m_maxNsecs.loadRelaxed();
+    while (nsecs > max && !m_maxNsecs.testAndSetRelaxed(max, nsecs, max)) {
+    }
+}
+
+ProcessingMetrics::Stats ProcessingMetrics::Histogram::stats() const
+{
+    Stats stats;
+    quint64 counts[BucketCount];
+    quint64 total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        counts[i] = m_buckets[i].loadRelaxed();
+        total += counts[i];
+    }
+    
+    stats.count = m_count.loadRelaxed();
+    stats.bytes = m_bytes.loadRelaxed();
+    stats.totalNsecs = m_totalNsecs.loadRelaxed();
+    stats.maxNsecs = m_maxNsecs.loadRelaxed();
+    if (total == 0) {
+        return stats;
+    }
+    
+    // Concurrent recording can make the buckets and the count disagree
+    // slightly; percentiles are taken from the buckets alone
+    const quint64 ranks[3] = { (total * 50 + 99) / 100, (total * 90 + 99) / 100, (total * 99 + 99) / 100 };
+    qint64 *targets[3] = { &stats.p50Nsecs, &stats.p90Nsecs, &stats.p99Nsecs };
+    quint64 seen = 0;
+    int next = 0;
+    for (int i = 0; i < BucketCount && next < 3; ++i) {
+        seen += counts[i];
+        while (next < 3 && seen >= ranks[next]) {
+            *targets[next++] = qMin(bucketValue(i), stats.maxNsecs);
+        }
+    }
+    return stats;
+}
+
+ProcessingMetrics::ProcessingMetrics()
+    : m_failedFiles(0)
+    , m_runStartedAt(-1)
+    , m_busyNsecs(0)
+{
+    m_clock.start();
+}
+
+void ProcessingMetrics::reset()
+{
+    for (Histogram &histogram : m_stages) {
+        histogram.reset();
+    }
+    m_files.reset();
+    m_failedFiles.storeRelaxed(0);
+    m_busyNsecs.storeRelaxed(0);
+    if (m_runStartedAt.loadRelaxed() >= 0) {
+        m_runStartedAt.storeRelaxed(m_clock.nsecsElapsed());
+    }
+}
+
+void ProcessingMetrics::runStarted()
+{
+    m_runStartedAt.storeRelaxed(m_clock.nsecsElapsed());
+}
+
+void ProcessingMetrics::runFinished()
+{
+    const qint64 startedAt = m_runStartedAt.fetchAndStoreRelaxed(-1);
+    if (startedAt >= 0) {
+        m_busyNsecs.fetchAndAddRelaxed(m_clock.nsecsElapsed() - startedAt);
+    }
+}
+
+void ProcessingMetrics::record(Stage stage, qint64 nsecs, qint64 bytes)
+{
+    m_stages[stage].record(nsecs, bytes);
+}
+
+void ProcessingMetrics::recordFile(qint64 nsecs, qint64 bytes, bool succeeded)
+{
+    if (succeeded) {
+        m_files.record(nsecs, bytes);
+    } else {
+        m_failedFiles.fetchAndAddRelaxed(1);
+    }
+}
+
+ProcessingMetrics::Snapshot ProcessingMetrics::snapshot() const
+{
+    Snapshot snapshot;
+    for (int i = 0; i < StageCount; ++i) {
+        snapshot.stages[i] = m_stages[i].stats();
+    }
+    snapshot.fileLatency = m_files.stats();
+    snapshot.files = snapshot.fileLatency.count;
+    snapshot.bytes = snapshot.fileLatency.bytes;
+    snapshot.failedFiles = m_failedFiles.loadRelaxed();
+    
+    const qint64 startedAt = m_runStartedAt.loadRelaxed();
+    snapshot.running = startedAt >= 0;
+    snapshot.busyNsecs = m_busyNsecs.loadRelaxed() + (snapshot.running ? m_clock.nsecsElapsed() - startedAt : 0);
+    if (snapshot.busyNsecs > 0) {
+        snapshot.filesPerSecond = snapshot.files * 1e9 / snapshot.busyNsecs;
+        snapshot.bytesPerSecond = snapshot.bytes * 1e9 / snapshot.busyNsecs;
+    }
+    return snapshot;
+}
+
+const char *ProcessingMetrics::stageName(Stage stage)
+{
+    switch (stage) {
+    case Scan:
+        return "scan";
+    case Prefetch:
+        return "prefetch";
+    case Open:
+        return "open";
+    case Read:
+        return "read";
+    case Transform:
+        return "transform";
+    case Checksum:
+        return "checksum";
+    case Compress:
+        return "compress";
+    case Write:
+        return "write";
+    case Fsync:
+        return "fsync";
+    case Rename:
+        return "rename";
+    case Delete:
+        return "delete";
+    case Control:
+        return "control";
+    case Throttle:
+        return "throttle";
+    default:
+        return "unknown";
+    }
+}
+
+QJsonObject ProcessingMetrics::toJson(const Snapshot &snapshot)
+{
+    QJsonObject stages;
+    for (int i = 0; i < StageCount; ++i) {
+        stages[stageName(Stage(i))] = statsToJson(snapshot.stages[i]);
+    }
+    
+    QJsonObject object;
+    object["running"] = snapshot.running;
+    object["busySeconds"] = snapshot.busyNsecs / 1e9;
+    object["files"] = qint64(snapshot.files);
+    object["failedFiles"] = qint64(snapshot.failedFiles);
+    object["bytes"] = snapshot.bytes;
+    object["filesPerSecond"] = snapshot.filesPerSecond;
+    object["bytesPerSecond"] = snapshot.bytesPerSecond;
+    object["fileLatency"] = statsToJson(snapshot.fileLatency);
+    object["stages"] = stages;
+    return object;
+}
+
+QByteArray ProcessingMetrics::toPrometheus(const Snapshot &snapshot)
+{
+    QByteArray out;
+    
+    appendMetric(out, "filemodifier_files_total", "counter", "Files processed.");
+    appendValue(out, "filemodifier_files_total", "result=\"ok\"", double(snapshot.files));
+    appendValue(out, "filemodifier_files_total", "result=\"failed\"", double(snapshot.failedFiles));
+    
+    appendMetric(out, "filemodifier_bytes_total", "counter", "Input bytes of processed files.");
+    appendValue(out, "filemodifier_bytes_total", QByteArray(), double(snapshot.bytes));
+    
+    appendMetric(out, "filemodifier_busy_seconds_total", "counter", "Time spent in runs.");
+    appendValue(out, "filemodifier_busy_seconds_total", QByteArray(), snapshot.busyNsecs / 1e9);
+    
+    appendMetric(out, "filemodifier_running", "gauge", "1 while a run is in progress.");
+    appendValue(out, "filemodifier_running", QByteArray(), snapshot.running ? 1 : 0);
+    
+    appendMetric(out, "filemodifier_file_seconds", "summary", "Processing time per file.");
+    const Stats &files = snapshot.fileLatency;
+    appendValue(out, "filemodifier_file_seconds", "quantile=\"0.5\"", files.p50Nsecs / 1e9);
+    appendValue(out, "filemodifier_file_seconds", "quantile=\"0.9\"", files.p90Nsecs / 1e9);
+    appendValue(out, "filemodifier_file_seconds", "quantile=\"0.99\"", files.p99Nsecs / 1e9);
+    appendValue(out, "filemodifier_file_seconds_sum", QByteArray(), files.totalNsecs / 1e9);
+    appendValue(out, "filemodifier_file_seconds_count", QByteArray(), double(files.count));
+    
+    appendMetric(out, "filemodifier_stage_seconds", "summary", "Duration of single stage operations.");
+    for (int i = 0; i < StageCount; ++i) {
+        const QByteArray stage = QByteArray("stage=\"") + stageName(Stage(i)) + '"';
+        const Stats &stats = snapshot.stages[i];
+        appendValue(out, "filemodifier_stage_seconds", stage + ",quantile=\"0.5\"", stats.p50Nsecs / 1e9);
+        appendValue(out, "filemodifier_stage_seconds", stage + ",quantile=\"0.9\"", stats.p90Nsecs / 1e9);
+        appendValue(out, "filemodifier_stage_seconds", stage + ",quantile=\"0.99\"", stats.p99Nsecs / 1e9);
+        appendValue(out, "filemodifier_stage_seconds_sum", stage, stats.totalNsecs / 1e9);
+        appendValue(out, "filemodifier_stage_seconds_count", stage, double(stats.count));
+    }
+    
+    appendMetric(out, "filemodifier_stage_bytes_total", "counter", "Bytes moved by a stage.");
+    for (int i = 0; i < StageCount; ++i) {
+        appendValue(out, "filemodifier_stage_bytes_total", QByteArray("stage=\"") + stageName(Stage(i)) + '"',
+                    double(snapshot.stages[i].bytes));
+    }
+    return out;
+}
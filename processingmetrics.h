@@ -0,0 +1,112 @@
+#ifndef PROCESSINGMETRICS_H
+#define PROCESSINGMETRICS_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QMetaType>
+#include <QJsonObject>
+
+// Counters and latency histograms for the stages of a run. Recording is a
+// handful of relaxed atomic adds, so it can be done from every worker for
+// every chunk. Histograms use four buckets per power of two, which puts
+// the reported percentiles within about 10% of the exact value.
+//
+// Values accumulate over the lifetime of the object (like Prometheus
+// counters) until reset() is called; rates refer to the time spent in runs.
+class ProcessingMetrics
+{
+public:
+    enum Stage {
+        Scan,       // listing one directory
+        Prefetch,   // asking the kernel to read ahead one upcoming file
+        Open,
+        Read,
+        Transform,
+        Checksum,   // CRC-32C for the manifest
+        Compress,   // compressing or decompressing one frame
+        Write,
+        Fsync,
+        Rename,     // moving finished outputs to their final names
+        Delete,     // removing or moving away the input
+        Control,    // from a stop or pause request until a worker acted on it
+        Throttle,   // waiting for the bandwidth limit
+        StageCount
+    };
+
+    struct Stats {
+        quint64 count = 0;
+        qint64 bytes = 0;
+        qint64 totalNsecs = 0;
+        qint64 maxNsecs = 0;
+        qint64 p50Nsecs = 0;
+        qint64 p90Nsecs = 0;
+        qint64 p99Nsecs = 0;
+    };
+
+    struct Snapshot {
+        bool running = false;
+        qint64 busyNsecs = 0;
+        quint64 files = 0;
+        quint64 failedFiles = 0;
+        qint64 bytes = 0;
+        double filesPerSecond = 0;
+        double bytesPerSecond = 0;
+        Stats stages[StageCount];
+        Stats fileLatency;
+    };
+
+    ProcessingMetrics();
+
+    // Not thread safe against concurrent recording; call between runs
+    void reset();
+
+    void runStarted();
+    void runFinished();
+
+    void record(Stage stage, qint64 nsecs, qint64 bytes = 0);
+    // Whole file, from picking it up to its output being complete
+    void recordFile(qint64 nsecs, qint64 bytes, bool succeeded);
+
+    Snapshot snapshot() const;
+
+    static const char *stageName(Stage stage);
+    static QJsonObject toJson(const Snapshot &snapshot);
+    // Text exposition format, e.g. for the node_exporter textfile collector
+    static QByteArray toPrometheus(const Snapshot &snapshot);
+
+private:
+    class Histogram
+    {
+    public:
+        Histogram();
+        void reset();
+        void record(qint64 nsecs, qint64 bytes);
+        Stats stats() const;
+
+    private:
+        enum { BucketCount = 256 };
+        QAtomicInteger<quint64> m_buckets[BucketCount];
+        QAtomicInteger<quint64> m_count;
+        QAtomicInteger<qint64> m_bytes;
+        QAtomicInteger<qint64> m_totalNsecs;
+        QAtomicInteger<qint64> m_maxNsecs;
+
+        static int bucketFor(quint64 nsecs);
+        static qint64 bucketValue(int bucket);
+    };
+
+    Histogram m_stages[StageCount];
+    Histogram m_files;
+    QAtomicInteger<quint64> m_failedFiles;
+    QElapsedTimer m_clock;
+    QAtomicInteger<qint64> m_runStartedAt;     // m_clock time, -1 between runs
+    QAtomicInteger<qint64> m_busyNsecs;
+
+    Q_DISABLE_COPY(ProcessingMetrics)
+};
+
+Q_DECLARE_METATYPE(ProcessingMetrics::Snapshot)
+
+#endif // PROCESSINGMETRICS_H
@@ -0,0 +1,223 @@
+#include "scanindex.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QDateTime>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const quint32 IndexMagic = 0x464D5349; // "FMSI"
+const quint32 IndexVersion = 1;
+
+// Directory timestamps are only as fine as the filesystem clock tick; an
+// mtime this recent may not move when the directory changes again
+const qint64 SettleTime = Q_INT64_C(2000000000);
+
+} // namespace
+
+ScanIndex::ScanIndex(const QString &directory, const QString &rootPath, const QString &mask)
+    : m_rootPath(QDir::cleanPath(QDir(rootPath).absolutePath()))
+    , m_scanComplete(false)
+{
+    // One index per input tree and mask: a different mask matches files the
+    // index has never considered, so unchanged directories must not be skipped
+    const QByteArray id = QCryptographicHash::hash((m_rootPath + '\n' + mask).toUtf8(),
+                                                   QCryptographicHash::Sha1).toHex().left(16);
+    m_fileName = QString("%1/scanindex-%2.dat").arg(directory).arg(QString::fromLatin1(id));
+}
+
+bool ScanIndex::fileKey(const QString &path, FileKey *key)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return false;
+    }
+    key->device = quint64(st.st_dev);
+    key->inode = quint64(st.st_ino);
+    key->size = qint64(st.st_size);
+#ifdef Q_OS_MACOS
+    key->mtime = qint64(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    key->mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+#else
+    // No inode numbers through Qt; the path stands in for the file identity
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        return false;
+    }
+    key->device = 0;
+    key->inode = qHash(info.absoluteFilePath());
+    key->size = info.size();
+    key->mtime = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    return true;
+#endif
+}
+
+QString ScanIndex::relativePath(const QString &directory) const
+{
+    return directory.mid(m_rootPath.size());
+}
+
+bool ScanIndex::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = qUncompress(file.readAll());
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> count;
+    if (magic != IndexMagic || version != IndexVersion) {
+        return false;
+    }
+
+    m_directories.clear();
+    m_directories.reserve(int(count));
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString path;
+        DirectoryRecord record;
+        quint32 fileCount = 0;
+        in >> path >> record.mtime >> record.subdirectories >> fileCount;
+        record.files.reserve(int(fileCount));
+        for (quint32 j = 0; j < fileCount && in.status() == QDataStream::Ok; ++j) {
+            FileKey key;
+            in >> key.device >> key.inode >> key.size >> key.mtime;
+            record.files.insert(key);
+        }
+        m_directories.insert(m_rootPath + path, record);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        m_directories.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ScanIndex::save()
+{
+    QMutexLocker locker(&m_mutex);
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+
+    // After a full walk, directories that were neither visited nor written to
+    // have left the tree
+    QList<QString> directories;
+    for (auto it = m_directories.constBegin(); it != m_directories.constEnd(); ++it) {
+        if (it.value().visited || !m_scanComplete) {
+            directories.append(it.key());
+        }
+    }
+
+    out << IndexMagic << IndexVersion << quint32(directories.size());
+    for (const QString &directory : directories) {
+        const DirectoryRecord &record = m_directories[directory];
+
+        // Files of this directory that were found but not processed must be
+        // found again, so the directory is listed on the next scan
+        out << relativePath(directory) << (record.pending > 0 ? qint64(-1) : record.mtime)
+            << record.subdirectories << quint32(record.files.size());
+        for (const FileKey &key : record.files) {
+            out << key.device << key.inode << key.size << key.mtime;
+        }
+    }
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(qCompress(data));
+    return file.commit();
+}
+
+bool ScanIndex::isUnchanged(const QString &directory, qint64 mtime, QStringList *subdirectories)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_directories.find(directory);
+    if (it == m_directories.end() || it->mtime < 0 || it->mtime != mtime) {
+        return false;
+    }
+    it->visited = true;
+    *subdirectories = it->subdirectories;
+    return true;
+}
+
+void ScanIndex::updateDirectory(const QString &directory, qint64 mtime, const QStringList &subdirectories,
+                                QStringList *files)
+{
+    // Stat outside the lock; this is the only per-file cost of the index
+    QList<FileKey> keys;
+    QStringList candidates;
+    const QStringList listed = *files;
+    keys.reserve(listed.size());
+    for (const QString &file : listed) {
+        FileKey key;
+        if (fileKey(file, &key)) {
+            keys.append(key);
+            candidates.append(file);
+        }
+    }
+    files->clear();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch() * 1000000;
+
+    QMutexLocker locker(&m_mutex);
+    DirectoryRecord &record = m_directories[directory];
+    record.mtime = mtime < now - SettleTime ? mtime : -1;
+    record.subdirectories = subdirectories;
+    record.visited = true;
+
+    QSet<FileKey> seen;
+    for (int i = 0; i < keys.size(); ++i) {
+        if (record.files.contains(keys.at(i))) {
+            seen.insert(keys.at(i));
+        } else {
+            files->append(candidates.at(i));
+        }
+    }
+    record.files.swap(seen);
+    record.pending = files->size();
+}
+
+void ScanIndex::markProcessed(const QString &file)
+{
+    FileKey key;
+    if (!fileKey(file, &key)) {
+        return;
+    }
+
+    const QString directory = QFileInfo(file).absolutePath();
+    if (directory != m_rootPath && !directory.startsWith(m_rootPath + '/')) {
+        return;
+    }
+
+    // Outputs written into the tree are recorded too, so they are never
+    // picked up as new inputs
+    QMutexLocker locker(&m_mutex);
+    DirectoryRecord &record = m_directories[directory];
+    record.files.insert(key);
+    record.visited = true;
+    if (record.pending > 0) {
+        record.pending--;
+    }
+}
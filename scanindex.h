@@ -0,0 +1,85 @@
+#ifndef SCANINDEX_H
+#define SCANINDEX_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+
+// Remembers which files of an input tree were already processed, so that a
+// scan returns only new or changed files. Files are identified by
+// (device, inode, size, mtime): a rewritten file gets a new identity, a
+// renamed one keeps it. Directories whose mtime is unchanged since they were
+// last listed are not listed again; their known subdirectories are visited
+// directly. The index is kept per input root and mask in a compressed binary
+// file.
+class ScanIndex
+{
+public:
+    struct FileKey {
+        quint64 device;
+        quint64 inode;
+        qint64 size;
+        qint64 mtime;
+
+        bool operator==(const FileKey &other) const
+        {
+            return device == other.device && inode == other.inode
+                    && size == other.size && mtime == other.mtime;
+        }
+    };
+
+    ScanIndex(const QString &directory, const QString &rootPath, const QString &mask);
+
+    QString fileName() const { return m_fileName; }
+    bool load();
+    bool save();
+
+    // Stats path; mtime is in nanoseconds
+    static bool fileKey(const QString &path, FileKey *key);
+
+    // The following are safe to call from several scanner threads.
+
+    // True if directory has not changed since it was listed; subdirectories
+    // then receives the subdirectories found at that time
+    bool isUnchanged(const QString &directory, qint64 mtime, QStringList *subdirectories);
+
+    // Records a fresh listing of directory and removes the files that were
+    // already processed from files. Known files that were not listed again
+    // are forgotten.
+    void updateDirectory(const QString &directory, qint64 mtime, const QStringList &subdirectories,
+                         QStringList *files);
+    // The whole tree was walked; directories not reached have gone away
+    void setScanComplete() { m_scanComplete = true; }
+
+    // Called from worker threads once a file has been processed successfully
+    void markProcessed(const QString &file);
+
+private:
+    struct DirectoryRecord {
+        qint64 mtime;
+        QStringList subdirectories;
+        QSet<FileKey> files;
+        int pending;
+        bool visited;
+
+        DirectoryRecord() : mtime(-1), pending(0), visited(false) {}
+    };
+
+    QString m_fileName;
+    QString m_rootPath;
+    QHash<QString, DirectoryRecord> m_directories;
+    QMutex m_mutex;
+    bool m_scanComplete;
+
+    QString relativePath(const QString &directory) const;
+};
+
+inline uint qHash(const ScanIndex::FileKey &key, uint seed = 0)
+{
+    return qHash(key.inode ^ (key.device << 32), seed) ^ qHash(key.mtime ^ key.size, seed);
+}
+
+#endif // SCANINDEX_H
@@ -0,0 +1,12 @@
+QT = core testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_filemodifier
+TEMPLATE = app
+
+include(../core.pri)
+
+SOURCES += \
+    tst_filemodifier.cpp
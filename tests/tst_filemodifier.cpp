@@ -0,0 +1,420 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QRandomGenerator>
+#include <QtEndian>
+
+#include "fileprocessor.h"
+#include "xorkernel.h"
+#include "transformchain.h"
+#include "iopipeline.h"
+#include "jobjournal.h"
+#include "scanindex.h"
+#include "framecodec.h"
+#include "processingcontrol.h"
+
+namespace {
+
+// Rolling stage depends on the offset, so a chunk written at the wrong
+// position shows up as a mismatch
+const char *const ChainSpec = "xor:0123456789ABCDEF,rolling:0011223344556677";
+const qint64 MiB = 1024 * 1024;
+
+QByteArray randomBytes(qint64 size, quint32 seed)
+{
+    QByteArray data(int(size), Qt::Uninitialized);
+    QRandomGenerator generator(seed);
+    for (qint64 i = 0; i < size; ++i) {
+        data[int(i)] = char(generator.generate() & 0xFF);
+    }
+    return data;
+}
+
+bool writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+QByteArray readFile(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+TransformChain chain()
+{
+    TransformChain transform;
+    QString error;
+    TransformChain::parse(ChainSpec, &transform, &error);
+    return transform;
+}
+
+QByteArray transformed(QByteArray data, qint64 offset = 0)
+{
+    chain().apply(data.data(), data.size(), offset);
+    return data;
+}
+
+}
+
+class FileModifierTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void xorKernelMatchesScalar();
+    void processingPaths_data();
+    void processingPaths();
+    void pipelineResume_data();
+    void pipelineResume();
+    void journalResume_data();
+    void journalResume();
+    void compressRestoreRoundTrip();
+    void frameHeaderLimits();
+
+private:
+    void runProcessor(FileProcessor *processor);
+};
+
+void FileModifierTest::runProcessor(FileProcessor *processor)
+{
+    QStringList errors;
+    connect(processor, &FileProcessor::processingError, this, [&errors](const QString &error) {
+        errors.append(error);
+    });
+    processor->startProcessing();
+    QVERIFY2(errors.isEmpty(), qPrintable(errors.join('\n')));
+}
+
+void FileModifierTest::xorKernelMatchesScalar()
+{
+    const XorKernel::Implementation original = XorKernel::activeImplementation();
+    const quint64 key = XorKernel::keyFromBytes(QByteArray::fromHex("0123456789ABCDEF"));
+    const QByteArray source = randomBytes(64 * 1024 + 77, 1);
+    const QList<qint64> sizes = { 0, 1, 7, 8, 15, 31, 63, 64, 65, 127, 255, 1000, 4097, 64 * 1024 };
+    const QList<qint64> offsets = { 0, 1, 3, 8, 13 };
+
+    for (int impl = XorKernel::Sse2; impl <= XorKernel::Avx512; ++impl) {
+        if (!XorKernel::isSupported(XorKernel::Implementation(impl))) {
+            continue;
+        }
+        // Unaligned source and destination pointers and every key phase
+        for (int misalign = 0; misalign < 3; ++misalign) {
+            for (qint64 size : sizes) {
+                for (qint64 offset : offsets) {
+                    const char *src = source.constData() + misalign;
+                    QByteArray expected(int(size) + 3, 0);
+                    QByteArray actual(int(size) + 3, 0);
+
+                    XorKernel::setImplementation(XorKernel::Scalar);
+                    XorKernel::apply(src, expected.data() + misalign, size, key, offset);
+                    XorKernel::setImplementation(XorKernel::Implementation(impl));
+                    XorKernel::apply(src, actual.data() + misalign, size, key, offset);
+                    if (actual != expected) {
+                        XorKernel::setImplementation(original);
+                        QFAIL(qPrintable(QString("%1: size %2, offset %3, misalign %4")
+                                         .arg(XorKernel::implementationName(XorKernel::Implementation(impl)))
+                                         .arg(size).arg(offset).arg(misalign)));
+                    }
+
+                    // In-place variant
+                    QByteArray inPlace(src, int(size));
+                    XorKernel::apply(inPlace.data(), size, key, offset);
+                    if (inPlace != expected.mid(misalign, int(size))) {
+                        XorKernel::setImplementation(original);
+                        QFAIL(qPrintable(QString("%1 in place: size %2, offset %3")
+                                         .arg(XorKernel::implementationName(XorKernel::Implementation(impl)))
+                                         .arg(size).arg(offset)));
+                    }
+                }
+            }
+        }
+    }
+    XorKernel::setImplementation(original);
+}
+
+void FileModifierTest::processingPaths_data()
+{
+    QTest::addColumn<QString>("mode");
+
+    QTest::newRow("direct") << QString("direct");
+    QTest::newRow("threads") << QString("threads");
+    QTest::newRow("io_uring") << QString("io_uring");
+    QTest::newRow("mmap") << QString("mmap");
+    QTest::newRow("split") << QString("split");
+    QTest::newRow("small") << QString("small");
+    QTest::newRow("in-place") << QString("in-place");
+}
+
+// Every path has to produce the same bytes as the transform applied in memory
+void FileModifierTest::processingPaths()
+{
+    QFETCH(QString, mode);
+    if (mode == "io_uring" && !IoPipeline::isIoUringAvailable()) {
+        QSKIP("io_uring недоступен");
+    }
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString inputPath = dir.filePath("in");
+    const QString outputPath = dir.filePath("out");
+    QVERIFY(QDir().mkpath(inputPath));
+    QVERIFY(QDir().mkpath(outputPath));
+
+    const QList<qint64> sizes = { 0, 1, 4095, 100 * 1000, 3 * MiB + 17 };
+    QHash<QString, QByteArray> originals;
+    for (int i = 0; i < sizes.size(); ++i) {
+        const QString name = QString("file%1.bin").arg(i);
+        originals.insert(name, randomBytes(sizes.at(i), quint32(100 + i)));
+        QVERIFY(writeFile(inputPath + '/' + name, originals.value(name)));
+    }
+
+    FileProcessor processor;
+    processor.setInputPath(inputPath);
+    processor.setInputMask("*.bin");
+    processor.setOutputPath(outputPath);
+    processor.setTransform(chain());
+    processor.setWorkerCount(2);
+    processor.setBufferSize(256 * 1024);
+    processor.setQueueDepth(4);
+    processor.setMmapThreshold(0);
+    processor.setSmallFileLimit(0);
+    processor.setIoBackend(IoPipeline::Threads);
+
+    if (mode == "direct") {
+        processor.setQueueDepth(1);
+    } else if (mode == "io_uring") {
+        processor.setIoBackend(IoPipeline::IoUring);
+    } else if (mode == "mmap") {
+        processor.setMmapThreshold(1);
+    } else if (mode == "split") {
+        processor.setSplitLargeFiles(true);
+        processor.setSplitChunkSize(MiB);
+        processor.setSplitThreadCount(4);
+    } else if (mode == "small") {
+        processor.setSmallFileLimit(128 * 1024);
+    } else if (mode == "in-place") {
+        processor.setDeleteInput(true);
+        processor.setInPlace(true);
+    }
+
+    runProcessor(&processor);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+
+    for (auto it = originals.constBegin(); it != originals.constEnd(); ++it) {
+        QVERIFY2(QFile::exists(outputPath + '/' + it.key()), qPrintable(it.key()));
+        QVERIFY2(readFile(outputPath + '/' + it.key()) == transformed(it.value()), qPrintable(it.key()));
+        if (mode == "in-place") {
+            QVERIFY(!QFile::exists(inputPath + '/' + it.key()));
+        }
+    }
+}
+
+void FileModifierTest::pipelineResume_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::addColumn<int>("queueDepth");
+
+    QTest::newRow("direct") << int(IoPipeline::Threads) << 1;
+    QTest::newRow("threads") << int(IoPipeline::Threads) << 4;
+    QTest::newRow("io_uring") << int(IoPipeline::IoUring) << 4;
+    QTest::newRow("auto") << int(IoPipeline::Auto) << 4;
+}
+
+// The pipeline continues from wherever both files are positioned
+void FileModifierTest::pipelineResume()
+{
+    QFETCH(int, backend);
+    QFETCH(int, queueDepth);
+    if (backend == IoPipeline::IoUring && !IoPipeline::isIoUringAvailable()) {
+        QSKIP("io_uring недоступен");
+    }
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray original = randomBytes(5 * MiB + 123, 7);
+    const qint64 resumeAt = 2 * MiB + 7;
+    QVERIFY(writeFile(dir.filePath("in.bin"), original));
+    // Stands for the part written before the interruption; left untouched
+    QVERIFY(writeFile(dir.filePath("out.bin"), QByteArray(int(resumeAt), 'P')));
+
+    QFile input(dir.filePath("in.bin"));
+    QFile output(dir.filePath("out.bin"));
+    QVERIFY(input.open(QIODevice::ReadOnly));
+    QVERIFY(output.open(QIODevice::ReadWrite));
+    QVERIFY(input.seek(resumeAt));
+    QVERIFY(output.seek(resumeAt));
+
+    const TransformChain transform = chain();
+    ProcessingControl control;
+    IoPipeline pipeline(256 * 1024, queueDepth, IoPipeline::Backend(backend));
+    const bool ok = pipeline.run(input, output, [&transform](char *data, qint64 size, qint64 offset) {
+        transform.apply(data, size, resumeAt + offset);
+    }, &control);
+    QVERIFY2(ok, qPrintable(pipeline.errorString()));
+    QCOMPARE(pipeline.writtenOffset(), original.size() - resumeAt);
+    output.close();
+
+    const QByteArray expected = QByteArray(int(resumeAt), 'P') + transformed(original.mid(int(resumeAt)), resumeAt);
+    QVERIFY(readFile(dir.filePath("out.bin")) == expected);
+}
+
+void FileModifierTest::journalResume_data()
+{
+    pipelineResume_data();
+}
+
+// A file recorded in the job journal is continued from its completed prefix
+void FileModifierTest::journalResume()
+{
+    QFETCH(int, backend);
+    QFETCH(int, queueDepth);
+    if (backend == IoPipeline::IoUring && !IoPipeline::isIoUringAvailable()) {
+        QSKIP("io_uring недоступен");
+    }
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString inputPath = dir.filePath("in");
+    const QString outputPath = dir.filePath("out");
+    QVERIFY(QDir().mkpath(inputPath));
+    QVERIFY(QDir().mkpath(outputPath));
+
+    const QString inputFile = inputPath + "/big.bin";
+    const QString outputFile = outputPath + "/big.bin";
+    const QByteArray original = randomBytes(5 * MiB + 123, 11);
+    const qint64 resumeAt = 2 * MiB + 7;
+    QVERIFY(writeFile(inputFile, original));
+    // The completed prefix is kept as is; the stale bytes after it must be
+    // overwritten
+    QVERIFY(writeFile(outputFile, QByteArray(int(resumeAt), 'P') + QByteArray(int(MiB), 'G')));
+
+    {
+        JobJournal journal(outputPath);
+        QVERIFY(journal.open());
+        ScanIndex::FileKey key;
+        QVERIFY(ScanIndex::fileKey(inputFile, &key));
+        JobJournal::FileState state = journal.resumable(inputFile, key);
+        state.target = outputFile;
+        state.partial = outputFile;
+        journal.addRange(&state, 0, resumeAt);
+    }
+
+    FileProcessor processor;
+    processor.setFileList(QStringList() << inputFile);
+    processor.setOutputPath(outputPath);
+    processor.setTransform(chain());
+    processor.setResume(true);
+    processor.setBufferSize(256 * 1024);
+    processor.setQueueDepth(queueDepth);
+    processor.setIoBackend(IoPipeline::Backend(backend));
+    processor.setMmapThreshold(0);
+    processor.setSmallFileLimit(0);
+
+    runProcessor(&processor);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+
+    const QByteArray expected = QByteArray(int(resumeAt), 'P') + transformed(original.mid(int(resumeAt)), resumeAt);
+    const QByteArray actual = readFile(outputFile);
+    QCOMPARE(actual.size(), expected.size());
+    QVERIFY(actual == expected);
+}
+
+void FileModifierTest::compressRestoreRoundTrip()
+{
+    if (!FrameCodec::isAvailable()) {
+        QSKIP("Сжатие недоступно в этой сборке");
+    }
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString inputPath = dir.filePath("in");
+    const QString compressedPath = dir.filePath("compressed");
+    const QString restoredPath = dir.filePath("restored");
+    QVERIFY(QDir().mkpath(inputPath));
+    QVERIFY(QDir().mkpath(compressedPath));
+    QVERIFY(QDir().mkpath(restoredPath));
+
+    // Empty, single-frame and multi-frame inputs; the last one is partly
+    // compressible
+    QHash<QString, QByteArray> originals;
+    originals.insert("empty.bin", QByteArray());
+    originals.insert("small.bin", randomBytes(1000, 21));
+    originals.insert("large.bin", randomBytes(MiB + 5, 22) + QByteArray(int(3 * MiB / 2), 'z'));
+    for (auto it = originals.constBegin(); it != originals.constEnd(); ++it) {
+        QVERIFY(writeFile(inputPath + '/' + it.key(), it.value()));
+    }
+
+    FileProcessor compressor;
+    compressor.setInputPath(inputPath);
+    compressor.setInputMask("*.bin");
+    compressor.setOutputPath(compressedPath);
+    compressor.setTransform(chain());
+    compressor.setCompressionLevel(6);
+    runProcessor(&compressor);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+
+    for (auto it = originals.constBegin(); it != originals.constEnd(); ++it) {
+        QVERIFY2(QFile::exists(compressedPath + '/' + it.key() + FrameCodec::suffix()), qPrintable(it.key()));
+    }
+
+    FileProcessor restorer;
+    restorer.setInputPath(compressedPath);
+    restorer.setInputMask(QString("*") + FrameCodec::suffix());
+    restorer.setOutputPath(restoredPath);
+    restorer.setTransform(chain());
+    restorer.setRestore(true);
+    runProcessor(&restorer);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+
+    for (auto it = originals.constBegin(); it != originals.constEnd(); ++it) {
+        const QByteArray restored = readFile(restoredPath + '/' + it.key());
+        QCOMPARE(restored.size(), it.value().size());
+        QVERIFY2(restored == it.value(), qPrintable(it.key()));
+    }
+}
+
+// Sizes in a header decide how much a reader allocates and reads, so a
+// crafted archive must not get past parseHeader() with more than a frame
+void FileModifierTest::frameHeaderLimits()
+{
+    if (!FrameCodec::isAvailable()) {
+        QSKIP("Сжатие недоступно в этой сборке");
+    }
+
+    FrameCodec codec(9);
+    QByteArray member;
+    const QByteArray frame = randomBytes(FrameCodec::FrameSize, 31);
+    QVERIFY(codec.compress(frame.constData(), frame.size(), &member));
+    QVERIFY(member.size() <= FrameCodec::maxMemberSize());
+
+    qint64 memberSize = 0;
+    qint64 dataSize = 0;
+    QVERIFY(FrameCodec::parseHeader(member.constData(), member.size(), &memberSize, &dataSize));
+    QCOMPARE(memberSize, qint64(member.size()));
+    QCOMPARE(dataSize, qint64(frame.size()));
+
+    QByteArray header = member.left(FrameCodec::HeaderSize);
+    qToLittleEndian<quint32>(quint32(1) << 31, reinterpret_cast<uchar *>(header.data()) + 16);
+    QVERIFY(!FrameCodec::parseHeader(header.constData(), header.size(), &memberSize, &dataSize));
+    qToLittleEndian<quint32>(quint32(FrameCodec::maxMemberSize() + 1), reinterpret_cast<uchar *>(header.data()) + 16);
+    QVERIFY(!FrameCodec::parseHeader(header.constData(), header.size(), &memberSize, &dataSize));
+
+    header = member.left(FrameCodec::HeaderSize);
+    qToLittleEndian<quint32>(quint32(FrameCodec::FrameSize + 1), reinterpret_cast<uchar *>(header.data()) + 20);
+    QVERIFY(!FrameCodec::parseHeader(header.constData(), header.size(), &memberSize, &dataSize));
+}
+
+QTEST_GUILESS_MAIN(FileModifierTest)
+
+#include "tst_filemodifier.moc"
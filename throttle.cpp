@@ -0,0 +1,82 @@
+#include "throttle.h"
+#include "processingmetrics.h"
+#include "processingcontrol.h"
+#include <QMutexLocker>
+#include <QThread>
+
+namespace {
+
+// Unused rate saved up, as a share of one second
+const double BurstSeconds = 0.25;
+
+// Longest single sleep, which bounds how late a stop is noticed
+const qint64 SleepSliceUsecs = 50 * 1000;
+
+} // namespace
+
+Throttle::Throttle()
+    : m_rate(0)
+    , m_metrics(nullptr)
+    , m_control(nullptr)
+    , m_bucket(this)
+    , m_tokens(0)
+    , m_refilledAt(0)
+{
+    m_clock.start();
+}
+
+void Throttle::setRate(qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&m_mutex);
+    m_rate.storeRelaxed(qMax<qint64>(0, bytesPerSecond));
+    // Debt run up under the old rate would otherwise be paid at the new one
+    m_tokens = qMax(0.0, m_tokens);
+    m_refilledAt = m_clock.nsecsElapsed();
+}
+
+void Throttle::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_tokens = double(m_rate.loadRelaxed()) * BurstSeconds;
+    m_refilledAt = m_clock.nsecsElapsed();
+}
+
+void Throttle::acquire(qint64 bytes)
+{
+    Throttle *bucket = m_bucket;
+    if (bytes <= 0 || bucket->m_rate.loadRelaxed() == 0) {
+        return;
+    }
+
+    qint64 waitNsecs = 0;
+    {
+        QMutexLocker locker(&bucket->m_mutex);
+        const qint64 rate = bucket->m_rate.loadRelaxed();
+        if (rate == 0) {
+            return;
+        }
+        const qint64 now = bucket->m_clock.nsecsElapsed();
+        bucket->m_tokens = qMin(double(rate) * BurstSeconds,
+                                bucket->m_tokens + double(now - bucket->m_refilledAt) * rate / 1e9);
+        bucket->m_refilledAt = now;
+        bucket->m_tokens -= double(bytes);
+        if (bucket->m_tokens < 0) {
+            waitNsecs = qint64(-bucket->m_tokens * 1e9 / rate);
+        }
+    }
+    if (waitNsecs == 0) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 elapsed = 0; elapsed < waitNsecs; elapsed = timer.nsecsElapsed()) {
+        if (m_control && m_control->isStopRequested()) {
+            break;
+        }
+        QThread::usleep(qMin(SleepSliceUsecs, (waitNsecs - elapsed) / 1000 + 1));
+    }
+    if (m_metrics) {
+        m_metrics->record(ProcessingMetrics::Throttle, timer.nsecsElapsed(), bytes);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+
+class ProcessingMetrics;
+class ProcessingControl;
+
+// Token bucket that limits the bytes per second passing through it, shared
+// by every thread that reads (or writes) for a run. A caller takes the
+// tokens for its transfer at once, going into debt if there are not enough,
+// and then sleeps until the debt is paid off; concurrent callers queue up
+// behind that debt, which keeps the total at the rate however many workers
+// there are. Up to a quarter second of unused rate is saved up as burst.
+class Throttle
+{
+public:
+    Throttle();
+
+    // Bytes per second; 0 removes the limit. May be changed during a run.
+    void setRate(qint64 bytesPerSecond);
+    qint64 rate() const { return m_rate.loadRelaxed(); }
+
+    // The time spent waiting is recorded there as the Throttle stage
+    void setMetrics(ProcessingMetrics *metrics) { m_metrics = metrics; }
+    // A stop request ends a wait early
+    void setControl(ProcessingControl *control) { m_control = control; }
+    // Takes the tokens from bucket's limit instead of this one's, so that
+    // several runs stay below one rate together; waits are still recorded
+    // and cut short through this throttle. Null returns to the own limit.
+    void shareBucket(Throttle *bucket) { m_bucket = bucket ? bucket : this; }
+
+    // Fills the bucket and forgets the debt of a previous run
+    void reset();
+
+    // Accounts for bytes, blocking while the limit is exceeded. Free while
+    // no rate is set.
+    void acquire(qint64 bytes);
+
+private:
+    QAtomicInteger<qint64> m_rate;
+    ProcessingMetrics *m_metrics;
+    ProcessingControl *m_control;
+    Throttle *m_bucket;     // this unless shared
+
+    QMutex m_mutex;
+    QElapsedTimer m_clock;
+    double m_tokens;        // negative while in debt
+    qint64 m_refilledAt;    // m_clock time of the last refill
+
+    Q_DISABLE_COPY(Throttle)
+};
+
+#endif // THROTTLE_H
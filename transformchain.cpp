@@ -0,0 +1,367 @@
+#include "transformchain.h"
+#include "xorkernel.h"
+#include <QStringList>
+#include <QRegularExpression>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+// Every stage of a block runs while the block is still in L1/L2
+const qint64 FusedBlockSize = 16 * 1024;
+
+const quint64 Gamma = Q_UINT64_C(0x9E3779B97F4A7C15);
+
+// splitmix64 finalizer
+quint64 mix64(quint64 z)
+{
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+// Keystream word for the 8 bytes at file position word * 8
+inline quint64 rollingWord(quint64 seed, qint64 word)
+{
+    return mix64(seed + quint64(word + 1) * Gamma);
+}
+
+template <int Period>
+void xorFixedPeriod(const char *src, char *dst, qint64 size, const char *stream)
+{
+    // The key stays in registers; the inner loop unrolls completely
+    quint64 key[Period / 8];
+    std::memcpy(key, stream, sizeof(key));
+
+    qint64 i = 0;
+    for (; i + Period <= size; i += Period) {
+        quint64 w[Period / 8];
+        std::memcpy(w, src + i, sizeof(w));
+        for (int k = 0; k < Period / 8; ++k) {
+            w[k] ^= key[k];
+        }
+        std::memcpy(dst + i, w, sizeof(w));
+    }
+    for (int k = 0; i < size; ++i, ++k) {
+        dst[i] = char(src[i] ^ stream[k]);
+    }
+}
+
+void xorPeriod(const char *src, char *dst, qint64 size, const char *stream, int period)
+{
+    qint64 i = 0;
+    for (; i + period <= size; i += period) {
+        for (int k = 0; k < period; k += 8) {
+            quint64 w;
+            quint64 key;
+            std::memcpy(&w, src + i + k, sizeof(w));
+            std::memcpy(&key, stream + k, sizeof(key));
+            w ^= key;
+            std::memcpy(dst + i + k, &w, sizeof(w));
+        }
+    }
+    for (int k = 0; i < size; ++i, ++k) {
+        dst[i] = char(src[i] ^ stream[k]);
+    }
+}
+
+void xorRolling(const char *src, char *dst, qint64 size, qint64 offset, quint64 seed)
+{
+    qint64 i = 0;
+    for (; i < size && ((offset + i) & 7); ++i) {
+        const qint64 position = offset + i;
+        dst[i] = char(src[i] ^ char(rollingWord(seed, position >> 3) >> ((position & 7) * 8)));
+    }
+    for (; i + 8 <= size; i += 8) {
+        quint64 w;
+        std::memcpy(&w, src + i, sizeof(w));
+        w ^= qToLittleEndian(rollingWord(seed, (offset + i) >> 3));
+        std::memcpy(dst + i, &w, sizeof(w));
+    }
+    for (; i < size; ++i) {
+        const qint64 position = offset + i;
+        dst[i] = char(src[i] ^ char(rollingWord(seed, position >> 3) >> ((position & 7) * 8)));
+    }
+}
+
+void substitute(const char *src, char *dst, qint64 size, const uchar *table)
+{
+    const uchar *in = reinterpret_cast<const uchar *>(src);
+    uchar *out = reinterpret_cast<uchar *>(dst);
+    qint64 i = 0;
+    for (; i + 4 <= size; i += 4) {
+        const uchar a = table[in[i]];
+        const uchar b = table[in[i + 1]];
+        const uchar c = table[in[i + 2]];
+        const uchar d = table[in[i + 3]];
+        out[i] = a;
+        out[i + 1] = b;
+        out[i + 2] = c;
+        out[i + 3] = d;
+    }
+    for (; i < size; ++i) {
+        out[i] = table[in[i]];
+    }
+}
+
+// Fisher-Yates over 0..255 driven by splitmix64
+QByteArray permutationFromSeed(quint64 seed)
+{
+    QByteArray table(256, Qt::Uninitialized);
+    for (int i = 0; i < 256; ++i) {
+        table[i] = char(i);
+    }
+    quint64 state = seed;
+    for (int i = 255; i > 0; --i) {
+        state += Gamma;
+        const int j = int(mix64(state) % quint64(i + 1));
+        const char swapped = table.at(i);
+        table[i] = table.at(j);
+        table[j] = swapped;
+    }
+    return table;
+}
+
+int greatestCommonDivisor(int a, int b)
+{
+    while (b != 0) {
+        const int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+const char *stageName(TransformChain::StageType type)
+{
+    switch (type) {
+    case TransformChain::RollingXor:
+        return "rolling";
+    case TransformChain::Substitute:
+        return "sbox";
+    case TransformChain::InverseSubstitute:
+        return "unsbox";
+    default:
+        return "xor";
+    }
+}
+
+} // namespace
+
+TransformChain::TransformChain()
+{
+}
+
+bool TransformChain::makeStage(StageType type, const QByteArray &value, Stage *stage, QString *error)
+{
+    stage->type = type;
+    stage->value = value;
+    stage->keyWord = 0;
+    stage->period = 0;
+    stage->seed = 0;
+
+    switch (type) {
+    case Xor:
+        if (value.isEmpty()) {
+            *error = "пустой ключ XOR";
+            return false;
+        }
+        if (8 % value.size() == 0) {
+            stage->keyWord = XorKernel::keyFromBytes(value);
+        } else {
+            // Twice the period, so that any phase can be read as one run
+            stage->period = value.size() / greatestCommonDivisor(value.size(), 8) * 8;
+            stage->keyStream = value.repeated(stage->period * 2 / value.size());
+        }
+        return true;
+    case RollingXor:
+        if (value.isEmpty() || value.size() > 8) {
+            *error = "начальное значение rolling должно быть от 1 до 8 байт";
+            return false;
+        }
+        stage->seed = XorKernel::keyFromBytes(value);
+        return true;
+    case Substitute:
+    case InverseSubstitute:
+        if (value.size() == 256) {
+            stage->table = value;
+            QByteArray seen(256, 0);
+            for (int i = 0; i < 256; ++i) {
+                seen[uchar(value.at(i))] = 1;
+            }
+            if (seen.contains(char(0))) {
+                *error = "таблица замены должна содержать каждый байт ровно один раз";
+                return false;
+            }
+        } else if (!value.isEmpty() && value.size() <= 8) {
+            stage->table = permutationFromSeed(XorKernel::keyFromBytes(value));
+        } else {
+            *error = "для sbox нужно начальное значение до 8 байт или таблица из 256 байт";
+            return false;
+        }
+        if (type == InverseSubstitute) {
+            QByteArray inverse(256, Qt::Uninitialized);
+            for (int i = 0; i < 256; ++i) {
+                inverse[uchar(stage->table.at(i))] = char(i);
+            }
+            stage->table = inverse;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TransformChain::parse(const QString &spec, TransformChain *chain, QString *error)
+{
+    static const QRegularExpression hexValue("^([0-9A-Fa-f]{2})+$");
+
+    TransformChain result;
+    const QStringList parts = spec.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        const QString text = part.trimmed();
+        const int colon = text.indexOf(':');
+        const QString name = colon < 0 ? QString("xor") : text.left(colon).trimmed().toLower();
+        const QString value = colon < 0 ? text : text.mid(colon + 1).trimmed();
+
+        StageType type;
+        if (name == "xor") {
+            type = Xor;
+        } else if (name == "rolling") {
+            type = RollingXor;
+        } else if (name == "sbox") {
+            type = Substitute;
+        } else if (name == "unsbox") {
+            type = InverseSubstitute;
+        } else {
+            *error = QString("неизвестный этап \"%1\"").arg(name);
+            return false;
+        }
+
+        if (!hexValue.match(value).hasMatch()) {
+            *error = QString("значение этапа %1 должно быть чётным числом hex-символов").arg(name);
+            return false;
+        }
+
+        Stage stage;
+        if (!makeStage(type, QByteArray::fromHex(value.toLatin1()), &stage, error)) {
+            return false;
+        }
+        result.m_stages.append(stage);
+    }
+
+    if (result.isEmpty()) {
+        *error = "не задано ни одного преобразования";
+        return false;
+    }
+    *chain = result;
+    return true;
+}
+
+TransformChain TransformChain::xorKey(const QByteArray &key)
+{
+    TransformChain chain;
+    Stage stage;
+    QString error;
+    if (makeStage(Xor, key, &stage, &error)) {
+        chain.m_stages.append(stage);
+    }
+    return chain;
+}
+
+QString TransformChain::toString() const
+{
+    QStringList parts;
+    for (const Stage &stage : m_stages) {
+        parts.append(QString("%1:%2").arg(stageName(stage.type)).arg(QString::fromLatin1(stage.value.toHex().toUpper())));
+    }
+    return parts.join(',');
+}
+
+TransformChain TransformChain::inverse() const
+{
+    TransformChain chain;
+    for (int i = m_stages.size() - 1; i >= 0; --i) {
+        const Stage &stage = m_stages.at(i);
+        StageType type = stage.type;
+        if (type == Substitute) {
+            type = InverseSubstitute;
+        } else if (type == InverseSubstitute) {
+            type = Substitute;
+        }
+
+        Stage inverted;
+        QString error;
+        makeStage(type, stage.value, &inverted, &error);
+        chain.m_stages.append(inverted);
+    }
+    return chain;
+}
+
+bool TransformChain::isKernelXor() const
+{
+    return m_stages.size() == 1 && m_stages.first().type == Xor && m_stages.first().keyStream.isEmpty();
+}
+
+quint64 TransformChain::fingerprint() const
+{
+    if (isKernelXor()) {
+        return m_stages.first().keyWord;
+    }
+
+    // FNV-1a over the canonical spec
+    quint64 hash = Q_UINT64_C(0xCBF29CE484222325);
+    const QByteArray text = toString().toUtf8();
+    for (char c : text) {
+        hash = (hash ^ uchar(c)) * Q_UINT64_C(0x100000001B3);
+    }
+    return hash;
+}
+
+void TransformChain::applyStage(const Stage &stage, const char *src, char *dst, qint64 size, qint64 offset)
+{
+    switch (stage.type) {
+    case Xor:
+        if (stage.keyStream.isEmpty()) {
+            XorKernel::apply(src, dst, size, stage.keyWord, offset);
+        } else {
+            const char *stream = stage.keyStream.constData() + offset % stage.period;
+            if (stage.period == 16) {
+                xorFixedPeriod<16>(src, dst, size, stream);
+            } else if (stage.period == 32) {
+                xorFixedPeriod<32>(src, dst, size, stream);
+            } else {
+                xorPeriod(src, dst, size, stream, stage.period);
+            }
+        }
+        break;
+    case RollingXor:
+        xorRolling(src, dst, size, offset, stage.seed);
+        break;
+    case Substitute:
+    case InverseSubstitute:
+        substitute(src, dst, size, reinterpret_cast<const uchar *>(stage.table.constData()));
+        break;
+    }
+}
+
+void TransformChain::apply(const char *src, char *dst, qint64 size, qint64 offset) const
+{
+    if (m_stages.isEmpty()) {
+        if (src != dst) {
+            std::memmove(dst, src, size_t(size));
+        }
+        return;
+    }
+    if (m_stages.size() == 1) {
+        applyStage(m_stages.first(), src, dst, size, offset);
+        return;
+    }
+
+    for (qint64 done = 0; done < size; done += FusedBlockSize) {
+        const qint64 length = qMin(FusedBlockSize, size - done);
+        applyStage(m_stages.first(), src + done, dst + done, length, offset + done);
+        for (int i = 1; i < m_stages.size(); ++i) {
+            applyStage(m_stages.at(i), dst + done, dst + done, length, offset + done);
+        }
+    }
+}
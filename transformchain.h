@@ -0,0 +1,75 @@
+#ifndef TRANSFORMCHAIN_H
+#define TRANSFORMCHAIN_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+// A sequence of byte transforms applied to a file in one pass. Every stage
+// depends only on a byte's value and its offset in the file, so a file can
+// be transformed in pieces and in any order (split mode, resumed runs).
+// Stages are fused: data is taken in cache-sized blocks and each block runs
+// through the whole chain before the next one is touched.
+//
+// A chain is written as stages separated by commas, e.g.
+// "xor:00112233445566778899AABBCCDDEEFF,sbox:1F2E3D4C5B6A7988":
+//   xor:<hex>       XOR with a repeating key of any length; 1, 2, 4 and 8
+//                   byte keys use the SIMD kernel, 16 and 32 byte keys have
+//                   their own unrolled kernels
+//   rolling:<hex>   XOR with a keystream generated from a 64-bit seed and
+//                   the offset, so the key never repeats
+//   sbox:<hex>      byte substitution through a table; a 16-digit seed
+//                   generates a permutation, 512 digits give the table itself
+//   unsbox:<hex>    the inverse substitution of sbox with the same value
+// A bare hex string is read as an xor stage.
+class TransformChain
+{
+public:
+    enum StageType {
+        Xor,
+        RollingXor,
+        Substitute,
+        InverseSubstitute
+    };
+
+    TransformChain();
+
+    static bool parse(const QString &spec, TransformChain *chain, QString *error);
+    static TransformChain xorKey(const QByteArray &key);
+
+    QString toString() const;
+    bool isEmpty() const { return m_stages.isEmpty(); }
+    int stageCount() const { return m_stages.size(); }
+    // A single XOR stage run entirely by the SIMD kernel (key length divides 8)
+    bool isKernelXor() const;
+
+    // Undoes this chain: stages in reverse order, each one inverted
+    TransformChain inverse() const;
+
+    // Identifies the chain in progress records; a chain that is a single
+    // XOR with a key of up to 8 bytes keeps the key word used before chains
+    quint64 fingerprint() const;
+
+    // offset is the file position of src[0]; src and dst may be equal
+    void apply(const char *src, char *dst, qint64 size, qint64 offset) const;
+    void apply(char *data, qint64 size, qint64 offset) const { apply(data, data, size, offset); }
+
+private:
+    struct Stage {
+        StageType type;
+        QByteArray value;       // as given in the spec
+        quint64 keyWord;        // Xor with a key length dividing 8
+        QByteArray keyStream;   // Xor: key repeated to twice its period
+        int period;             // Xor: lcm(key length, 8)
+        quint64 seed;           // RollingXor
+        QByteArray table;       // Substitute: 256 entries
+    };
+
+    QList<Stage> m_stages;
+
+    static bool makeStage(StageType type, const QByteArray &value, Stage *stage, QString *error);
+    static void applyStage(const Stage &stage, const char *src, char *dst, qint64 size, qint64 offset);
+};
+
+#endif // TRANSFORMCHAIN_H
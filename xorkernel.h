@@ -0,0 +1,41 @@
+#ifndef XORKERNEL_H
+#define XORKERNEL_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+// XOR transform with a repeating 8-byte key. The key is applied as whole
+// 64-bit words; the widest SIMD path supported by the CPU is selected once at
+// runtime. All implementations produce bit-identical output.
+namespace XorKernel
+{
+    enum Implementation {
+        Scalar,
+        Sse2,
+        Avx2,
+        Avx512
+    };
+
+    // Packs up to 8 key bytes (in file order) into a key word. Shorter keys
+    // are repeated to fill the word.
+    quint64 keyFromBytes(const QByteArray &value);
+
+    // offset is the stream position of the first byte, so that the key phase
+    // (offset % 8) is kept when a file is transformed chunk by chunk.
+    void apply(char *data, qint64 size, quint64 key, qint64 offset = 0);
+    void apply(const char *src, char *dst, qint64 size, quint64 key, qint64 offset = 0);
+
+    Implementation activeImplementation();
+    const char *implementationName(Implementation impl);
+
+    // Forces a specific implementation (falls back to Scalar if the CPU lacks
+    // support). Used by benchmarks and for verifying the SIMD paths.
+    void setImplementation(Implementation impl);
+    bool isSupported(Implementation impl);
+
+    // Runs the active implementation over an in-memory buffer of the given
+    // size and returns the throughput in GB/s.
+    double measureThroughput(qint64 bufferSize, int iterations);
+}
+
+#endif // XORKERNEL_H